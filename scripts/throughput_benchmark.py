@@ -0,0 +1,373 @@
+#!/usr/bin/env python
+"""End-to-end throughput of twpipe on synthetic data.
+
+It generates synthetic tweet corpora in CoNLL-U format, trains tiny
+deterministic models for the builder options and measures sentences/sec,
+tokens/sec and the peak RSS of each pipeline mode. Nothing is downloaded,
+so it runs offline, e.g.
+
+    python scripts/throughput_benchmark.py --twpipe bin/twpipe --workdir /tmp/twpipe-bench --output report.json
+"""
+from __future__ import print_function
+import io
+import os
+import re
+import sys
+import json
+import time
+import random
+import zlib
+import argparse
+import subprocess
+
+try:
+    unichr
+except NameError:
+    unichr = chr
+
+POSTAGS = ['ADJ', 'ADP', 'ADV', 'AUX', 'CCONJ', 'DET', 'INTJ', 'NOUN', 'NUM', 'PART', 'PRON',
+           'PROPN', 'PUNCT', 'SCONJ', 'SYM', 'VERB', 'X']
+DEPRELS = ['nsubj', 'obj', 'iobj', 'obl', 'advmod', 'amod', 'nmod', 'det', 'case', 'cc', 'conj',
+           'punct', 'compound', 'discourse', 'parataxis']
+PUNCTS = [u',', u'.', u'!', u'?', u'...', u':']
+
+# (first, last) code points of the scripts the words are drawn from.
+SCRIPTS = {
+    'ascii': [(0x61, 0x7a)],
+    'latin': [(0xe0, 0xf6), (0xf8, 0xff)],
+    'cyrillic': [(0x430, 0x44f)],
+    'cjk': [(0x4e00, 0x4fff)],
+    'emoji': [(0x1f600, 0x1f64f)],
+}
+
+TOKENIZERS = ['bi-gru', 'bi-lstm', 'seg-gru', 'seg-lstm']
+SEGMENTORS = ['bi-gru', 'bi-lstm']
+POSTAGGERS = ['char-gru', 'char-lstm', 'char-cnn-gru', 'char-cnn-lstm', 'char-gru-crf',
+              'char-lstm-crf', 'word-gru', 'word-lstm', 'word-char-gru', 'word-char-lstm']
+PARSE_ARCHS = ['dyer15', 'ballesteros15', 'kiperwasser16']
+PARSE_SYSTEMS = ['arcstd', 'arceager', 'archybrid', 'swap']
+
+
+def parse_mix(payload):
+    """Parse 'ascii=0.7,emoji=0.1' into a list of (script, weight)."""
+    mix = []
+    for item in payload.split(','):
+        name, weight = item.split('=')
+        if name not in SCRIPTS:
+            raise ValueError('unknown script: {0}'.format(name))
+        mix.append((name, float(weight)))
+    return mix
+
+
+def parse_length(payload):
+    """Parse the sentence length distribution [fixed:N|uniform:MIN:MAX|normal:MEAN:STD|zipf:A]."""
+    fields = payload.split(':')
+    name, params = fields[0], [float(x) for x in fields[1:]]
+    expected = {'fixed': 1, 'uniform': 2, 'normal': 2, 'zipf': 1}
+    if name not in expected or len(params) != expected[name]:
+        raise ValueError('illegal length distribution: {0}'.format(payload))
+    return name, params
+
+
+class Generator(object):
+    def __init__(self, args, seed):
+        self.rng = random.Random(seed)
+        self.mix = parse_mix(args.unicode_mix)
+        self.length = parse_length(args.length)
+        self.max_length = args.max_length
+        self.twitter_ratio = args.twitter_ratio
+        self.punct_ratio = args.punct_ratio
+        # the vocabulary is shared by the corpora, so the heldout and test
+        # words are mostly known.
+        vocab_rng = random.Random(args.seed)
+        self.vocab = [self.make_word(vocab_rng) for _ in range(args.vocab_size)]
+        self.weights = [1. / (i + 1) for i in range(args.vocab_size)]
+        self.total_weight = sum(self.weights)
+
+    def pick_script(self, rng):
+        r = rng.random() * sum(w for _, w in self.mix)
+        for name, weight in self.mix:
+            r -= weight
+            if r <= 0:
+                return name
+        return self.mix[-1][0]
+
+    def make_word(self, rng):
+        r = rng.random()
+        if r < self.twitter_ratio:
+            kind = rng.randint(0, 3)
+            n = rng.randint(1, 999)
+            if kind == 0:
+                return u'@user{0}'.format(n)
+            if kind == 1:
+                return u'#tag{0}'.format(n)
+            if kind == 2:
+                return u'http://t.co/{0}'.format(n)
+            return u'{0}'.format(n)
+        script = self.pick_script(rng)
+        n_chars = 1 if script == 'emoji' else rng.randint(1, 4 if script == 'cjk' else 8)
+        chars = []
+        for _ in range(n_chars):
+            first, last = rng.choice(SCRIPTS[script])
+            chars.append(unichr(rng.randint(first, last)))
+        return u''.join(chars)
+
+    def sample_length(self):
+        name, params = self.length
+        if name == 'fixed':
+            n = int(params[0])
+        elif name == 'uniform':
+            n = self.rng.randint(int(params[0]), int(params[1]))
+        elif name == 'normal':
+            n = int(round(self.rng.gauss(params[0], params[1])))
+        else:
+            n = int(self.rng.paretovariate(params[0]))
+        return max(1, min(n, self.max_length))
+
+    def sample_word(self):
+        r = self.rng.random() * self.total_weight
+        for i, w in enumerate(self.weights):
+            r -= w
+            if r <= 0:
+                return self.vocab[i]
+        return self.vocab[-1]
+
+    def attach(self, begin, end, parent, heads):
+        # random projective tree over [begin, end).
+        while begin < end:
+            root = self.rng.randint(begin, end - 1)
+            heads[root] = parent
+            self.attach(begin, root, root, heads)
+            begin, parent = root + 1, root
+
+    def sentence(self):
+        n = self.sample_length()
+        words, space_after = [], []
+        for _ in range(n):
+            if words and self.rng.random() < self.punct_ratio:
+                words.append(self.rng.choice(PUNCTS))
+                space_after[-1] = False
+            else:
+                words.append(self.sample_word())
+            space_after.append(True)
+        heads = [0] * (len(words) + 1)
+        self.attach(1, len(words) + 1, 0, heads)
+        # the tags and relations are functions of the words, so they can be learned.
+        postags = [('PUNCT' if w in PUNCTS else POSTAGS[zlib.crc32(w.encode('utf-8')) % len(POSTAGS)]) for w in words]
+        deprels = [('root' if heads[i + 1] == 0 else DEPRELS[POSTAGS.index(postags[i]) % len(DEPRELS)])
+                   for i in range(len(words))]
+        text = u''.join(w + (u' ' if s else u'') for w, s in zip(words, space_after)).strip()
+        lines = [u'# text = ' + text]
+        for i, word in enumerate(words):
+            lines.append(u'\t'.join([str(i + 1), word, u'_', postags[i], u'_', u'_', str(heads[i + 1]),
+                                     deprels[i], u'_', u'_' if space_after[i] else u'SpaceAfter=No']))
+        return text, u'\n'.join(lines) + u'\n'
+
+
+def generate(args, path, n_sentences, seed, raw_path=None):
+    generator = Generator(args, seed)
+    n_tokens = 0
+    with io.open(path, 'w', encoding='utf-8') as ofs:
+        raw = io.open(raw_path, 'w', encoding='utf-8') if raw_path else None
+        for _ in range(n_sentences):
+            text, conllu = generator.sentence()
+            ofs.write(conllu + u'\n')
+            n_tokens += conllu.count(u'\n') - 1
+            if raw:
+                raw.write(text + u'\n')
+        if raw:
+            raw.close()
+    print('generated {0} sentences, {1} tokens to {2}'.format(n_sentences, n_tokens, path), file=sys.stderr)
+
+
+def fixtures(args):
+    """Return the list of (name, training options, inference runs), each run is (mode, options, input)."""
+    dim = str(args.dim)
+    tok_dims = ['--tok-char-dim', dim, '--tok-hidden-dim', dim, '--tok-seg-dim', dim, '--tok-n-layer', '1']
+    pos_dims = ['--pos-char-dim', dim, '--pos-char-hidden-dim', dim, '--pos-char-n-layer', '1',
+                '--pos-word-dim', dim, '--pos-word-hidden-dim', dim, '--pos-word-n-layer', '1',
+                '--pos-pos-dim', dim, '--embedding-dim', dim]
+    parse_dims = ['--parse-char-dim', dim, '--parse-word-dim', dim, '--parse-pos-dim', dim,
+                  '--parse-pretrained-dim', dim, '--parse-action-dim', dim, '--parse-label-dim', dim,
+                  '--parse-lstm-input-dim', dim, '--parse-hidden-dim', dim, '--parse-n-layer', '1',
+                  '--embedding-dim', dim]
+    ret = []
+    for name in TOKENIZERS:
+        ret.append(('tokenize/' + name,
+                    ['--train-tokenizer', 'true', '--tok-model-name', name] + tok_dims,
+                    [('tokenize', ['--tokenize'], 'raw')]))
+    for name in SEGMENTORS:
+        ret.append(('segment-and-tokenize/' + name,
+                    ['--train-segmentor-and-tokenizer', 'true', '--tok-model-name', name] + tok_dims,
+                    [('segment-and-tokenize', ['--segment-and-tokenize'], 'raw')]))
+    for name in POSTAGGERS:
+        ret.append(('postag/' + name,
+                    ['--train-postagger', 'true', '--pos-model-name', name] + pos_dims,
+                    [('postag', ['--postag', '--format', 'conll'], 'conll')]))
+    for arch in PARSE_ARCHS:
+        for system in PARSE_SYSTEMS:
+            ret.append(('parse/{0}/{1}'.format(arch, system),
+                        ['--train-parser', 'true', '--parse-arch', arch, '--parse-system', system] + parse_dims,
+                        [('parse', ['--parse', '--format', 'conll'], 'conll')]))
+    # the whole pipeline on raw text, with each stage added in turn.
+    ret.append(('pipeline/bi-gru+char-gru+ballesteros15',
+                ['--train-segmentor-and-tokenizer', 'true', '--tok-model-name', 'bi-gru',
+                 '--train-postagger', 'true', '--pos-model-name', 'char-gru',
+                 '--train-parser', 'true', '--parse-arch', 'ballesteros15', '--parse-system', 'archybrid'] +
+                tok_dims + pos_dims + parse_dims[:-2],
+                [('segment-and-tokenize', ['--segment-and-tokenize'], 'raw'),
+                 ('postag', ['--postag'], 'raw'),
+                 ('parse', ['--parse'], 'raw')]))
+    if args.filter:
+        pattern = re.compile(args.filter)
+        ret = [f for f in ret if pattern.search(f[0])]
+    return ret
+
+
+def run(command, stdout_path, log_path, timeout):
+    """Run the command, return (exit status, seconds, peak rss in KB)."""
+    start = time.time()
+    with open(stdout_path, 'wb') as stdout, open(log_path, 'ab') as log:
+        log.write((' '.join(command) + '\n').encode('utf-8'))
+        log.flush()
+        proc = subprocess.Popen(command, stdout=stdout, stderr=log)
+        # wait4 reports the usage of this child only, unlike getrusage(RUSAGE_CHILDREN).
+        while True:
+            pid, status, usage = os.wait4(proc.pid, os.WNOHANG)
+            if pid != 0:
+                break
+            if timeout > 0 and time.time() - start > timeout:
+                proc.kill()
+                pid, status, usage = os.wait4(proc.pid, 0)
+                break
+            time.sleep(0.01)
+    if os.WIFEXITED(status):
+        status = os.WEXITSTATUS(status)
+    else:
+        status = -os.WTERMSIG(status)
+    proc.returncode = status
+    return status, time.time() - start, usage.ru_maxrss
+
+
+def count_output(path):
+    n_sentences, n_tokens, in_sentence = 0, 0, False
+    with io.open(path, 'r', encoding='utf-8', errors='replace') as ifs:
+        for line in ifs:
+            line = line.strip()
+            if not line:
+                if in_sentence:
+                    n_sentences += 1
+                in_sentence = False
+            elif not line.startswith('#'):
+                n_tokens += 1
+                in_sentence = True
+    if in_sentence:
+        n_sentences += 1
+    return n_sentences, n_tokens
+
+
+def main():
+    cmd = argparse.ArgumentParser(description='End-to-end throughput benchmark of twpipe on synthetic data.')
+    cmd.add_argument('--twpipe', default='bin/twpipe', help='the path to the twpipe executable.')
+    cmd.add_argument('--workdir', default='twpipe-bench', help='the directory of the corpora, models and outputs.')
+    cmd.add_argument('--output', help='write the json report to the file, default to stdout.')
+    cmd.add_argument('--seed', type=int, default=1, help='the seed of the corpora and the models.')
+    cmd.add_argument('--train-sentences', type=int, default=200, help='the number of training sentences.')
+    cmd.add_argument('--heldout-sentences', type=int, default=50, help='the number of heldout sentences.')
+    cmd.add_argument('--test-sentences', type=int, default=500, help='the number of test sentences.')
+    cmd.add_argument('--vocab-size', type=int, default=2000, help='the size of the vocabulary.')
+    cmd.add_argument('--length', default='normal:15:8',
+                     help='the sentence length distribution [fixed:N|uniform:MIN:MAX|normal:MEAN:STD|zipf:A].')
+    cmd.add_argument('--max-length', type=int, default=80, help='the maximum sentence length.')
+    cmd.add_argument('--unicode-mix', default='ascii=0.75,latin=0.1,cyrillic=0.05,cjk=0.05,emoji=0.05',
+                     help='the weights of the scripts the words are drawn from.')
+    cmd.add_argument('--twitter-ratio', type=float, default=0.1, help='the ratio of mentions, hashtags, urls and numbers.')
+    cmd.add_argument('--punct-ratio', type=float, default=0.1, help='the ratio of punctuations glued to the previous word.')
+    cmd.add_argument('--dim', type=int, default=16, help='the dimension of all the layers of the models.')
+    cmd.add_argument('--max-iter', type=int, default=1, help='the number of training iterations.')
+    cmd.add_argument('--repeat', type=int, default=1, help='run each inference n times and keep the fastest.')
+    cmd.add_argument('--filter', help='only run the fixtures whose name matches the regex.')
+    cmd.add_argument('--timeout', type=float, default=0, help='kill a run after n seconds, 0 for no limit.')
+    cmd.add_argument('--generate-only', action='store_true', default=False, help='only generate the corpora.')
+    cmd.add_argument('--list', action='store_true', default=False, help='list the fixtures and exit.')
+    args = cmd.parse_args()
+
+    if args.list:
+        for name, _, runs in fixtures(args):
+            print('{0}\t{1}'.format(name, ','.join(r[0] for r in runs)))
+        return
+
+    if not os.path.isdir(args.workdir):
+        os.makedirs(args.workdir)
+    train_path = os.path.join(args.workdir, 'train.conllu')
+    heldout_path = os.path.join(args.workdir, 'heldout.conllu')
+    test_path = os.path.join(args.workdir, 'test.conllu')
+    raw_path = os.path.join(args.workdir, 'test.txt')
+    generate(args, train_path, args.train_sentences, args.seed)
+    generate(args, heldout_path, args.heldout_sentences, args.seed + 1)
+    generate(args, test_path, args.test_sentences, args.seed + 2, raw_path)
+    if args.generate_only:
+        return
+
+    inputs = {'raw': raw_path, 'conll': test_path}
+    log_path = os.path.join(args.workdir, 'twpipe.log')
+    dynet_opts = ['--dynet-seed', str(args.seed)]
+    report = {'config': vars(args), 'fixtures': []}
+    n_failed = 0
+    for name, train_opts, runs in fixtures(args):
+        prefix = os.path.join(args.workdir, name.replace('/', '_').replace('+', '_'))
+        model_path = prefix + '.model'
+        result = {'name': name, 'runs': []}
+        report['fixtures'].append(result)
+
+        command = ([args.twpipe] + dynet_opts + ['--train', '--model', model_path, '--heldout', heldout_path,
+                   '--max-iter', str(args.max_iter)] + train_opts + [train_path])
+        status, seconds, rss = run(command, prefix + '.train.out', log_path, args.timeout)
+        result['train'] = {'status': status, 'seconds': seconds, 'peak_rss_kb': rss}
+        if status != 0 or not os.path.exists(model_path):
+            print('{0}: training failed, see {1}'.format(name, log_path), file=sys.stderr)
+            n_failed += 1
+            continue
+
+        for mode, opts, input_name in runs:
+            best = None
+            for _ in range(args.repeat):
+                output_path = '{0}.{1}.out'.format(prefix, mode)
+                command = [args.twpipe] + dynet_opts + ['--model', model_path] + opts + [inputs[input_name]]
+                status, seconds, rss = run(command, output_path, log_path, args.timeout)
+                if status != 0:
+                    break
+                n_sentences, n_tokens = count_output(output_path)
+                payload = {
+                    'mode': mode,
+                    'input': input_name,
+                    'seconds': seconds,
+                    'sentences': n_sentences,
+                    'tokens': n_tokens,
+                    'sentences_per_second': n_sentences / seconds,
+                    'tokens_per_second': n_tokens / seconds,
+                    'peak_rss_kb': rss,
+                }
+                if best is None or seconds < best['seconds']:
+                    best = payload
+            if status != 0:
+                print('{0}: {1} failed, see {2}'.format(name, mode, log_path), file=sys.stderr)
+                result['runs'].append({'mode': mode, 'input': input_name, 'status': status})
+                n_failed += 1
+                continue
+            result['runs'].append(best)
+            print('{0}\t{1}\t{2:.1f} sent/s\t{3:.1f} tok/s\t{4} KB'.format(
+                name, mode, best['sentences_per_second'], best['tokens_per_second'], best['peak_rss_kb']),
+                file=sys.stderr)
+
+    payload = json.dumps(report, indent=2, sort_keys=True)
+    if args.output:
+        with open(args.output, 'w') as ofs:
+            ofs.write(payload + '\n')
+    else:
+        print(payload)
+    sys.exit(1 if n_failed > 0 else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -2,21 +2,28 @@
 #include "twpipe/logging.h"
 #include "twpipe/corpus.h"
 #include "twpipe/alphabet_collection.h"
+#include <boost/algorithm/string/case_conv.hpp>
 
 namespace twpipe {
 
 ArcEager::ArcEager() : TransitionSystem() {
   Alphabet & map = AlphabetCollection::get()->deprel_map;
   n_actions = 2 + 2 * map.size();
+  root_deprel = Corpus::BAD_DEL;
   action_names.push_back("SHIFT");  // 0
   action_names.push_back("REDUCE"); // 1
   for (unsigned i = 0; i < map.size(); ++i) {
     action_names.push_back("LEFT-" + map.get(i));
     action_names.push_back("RIGHT-" + map.get(i));
+    if (boost::algorithm::to_lower_copy(map.get(i)) == "root") { root_deprel = i; }
   }
-  _INFO << "[parse|arceager] show action names:";
+  if (root_deprel == Corpus::BAD_DEL) {
+    _ERROR << "[parse|arceager] no root label in the deprels, the words left without head can't be attached.";
+    exit(1);
+  }
+  _TRACE << "[parse|arceager] show action names:";
   for (const auto& action_name : action_names) {
-    _INFO << "- " << action_name;
+    _TRACE << "- " << action_name;
   }
 }
 
@@ -68,7 +75,14 @@ void ArcEager::right_unsafe(State& state, const unsigned& deprel) const {
 }
 
 void ArcEager::reduce_unsafe(State& state) const {
+  unsigned mod = state.stack.back();
   state.stack.pop_back();
+  // a word without head is only reduced once the buffer is empty, it goes to
+  // the pseudo root then.
+  if (state.heads[mod] == Corpus::BAD_HED) {
+    state.heads[mod] = 0;
+    state.deprels[mod] = root_deprel;
+  }
 }
 
 float ArcEager::shift_dynamic_loss_unsafe(State& state,
@@ -194,53 +208,6 @@ void ArcEager::perform_action(State& state, const unsigned& action) {
   }
 }
 
-bool ArcEager::is_valid_action(const State & state, const unsigned & act) const {
-  return false;
-}
-
-void ArcEager::get_valid_actions(const State& state, std::vector<unsigned>& valid_actions) {
-  BOOST_ASSERT_MSG(false, "Unimplemented.");
-  valid_actions.clear();
-  unsigned root_id = state.heads.size() - 1;
-  unsigned b = state.buffer.back();
-
-  // count the empty heads
-  unsigned n_empty_heads = 0;
-  for (unsigned i = 1; i < state.stack.size(); ++i) {
-    unsigned s = state.stack[i];
-    if (state.heads[s] == Corpus::BAD_HED) { n_empty_heads++; }
-  }
-
-  if (b < root_id - 1 ||
-    (b == root_id - 1 && n_empty_heads == 0) ||
-      (b == root_id && state.stack.size() == 1)) {
-    valid_actions.push_back(get_shift_id());
-  }
-
-  if (state.stack.size() > 1) {
-    unsigned s = state.stack.back();
-    if (state.heads[s] != Corpus::BAD_HED) {
-      valid_actions.push_back(get_reduce_id());
-    } else {
-      // try LeftArc
-      if (b < root_id) {
-        for (unsigned i = 0; i < num_deprels(); ++i) {
-          unsigned act = get_left_id(i);
-        }
-      } else {
-      }
-    }
-
-    // try RightArc
-    if (b < root_id - 1 || (b == root_id - 1 && n_empty_heads == 1)) {
-      for (unsigned i = 0; i < num_deprels(); ++i) {
-        unsigned act = get_right_id(i);
-      }
-    }
-  }
-  BOOST_ASSERT_MSG(valid_actions.size() > 0, "There should be one or more valid action.");
-}
-
 unsigned ArcEager::parse_label(const unsigned& action) {
   BOOST_ASSERT_MSG(action > 1, "SHIFT/REDUCE do not have label.");
   return (action % 2 == 0 ? (action - 2) / 2 : (action - 3) / 2);
@@ -259,8 +226,29 @@ void ArcEager::get_oracle_actions(const std::vector<unsigned>& ref_heads,
   }
 }
 
-unsigned ArcEager::get_structure_action(const unsigned & action) {
-  return (action < 3 ? action : (action % 2 == 1 ? 3 : 4));
+unsigned ArcEager::get_structure_action(const unsigned & action) const {
+  // SHIFT, REDUCE, LEFT, RIGHT
+  return (action < 2 ? action : (action % 2 == 0 ? 2 : 3));
+}
+
+unsigned ArcEager::num_structure_actions() const { return 4; }
+
+unsigned ArcEager::get_valid_structure_actions(const State& state) const {
+  // stack[1] is the pseduo root, which is shifted first and never gets a head.
+  unsigned mask = 0;
+  unsigned stack_size = state.stack.size();
+  bool buffer_empty = (state.buffer.size() <= 1);
+  if (!buffer_empty) {
+    mask |= (1u << 0);
+    if (stack_size > 1) { mask |= (1u << 3); }
+  }
+  if (stack_size > 2) {
+    bool has_head = (state.heads[state.stack.back()] != Corpus::BAD_HED);
+    // REDUCE: words without head can only be reduced when the buffer is empty.
+    if (has_head || buffer_empty) { mask |= (1u << 1); }
+    if (!has_head && !buffer_empty) { mask |= (1u << 2); }
+  }
+  return mask;
 }
 
 void ArcEager::get_oracle_actions_onestep(const std::vector<unsigned>& ref_heads,
@@ -0,0 +1,117 @@
+#include "arceager.h"
+#include "twpipe/corpus.h"
+#include "twpipe/alphabet_collection.h"
+#include <iostream>
+#include <climits>
+#include <string>
+#include <vector>
+
+// Decode with ArcEager the way ParseModel::predict does, with a scorer that
+// always prefers the first valid action, i.e. shifts whenever possible. All
+// the words reach the end of the buffer without head, so the final stack
+// holds all of them.
+
+namespace {
+
+unsigned n_failures = 0;
+
+void expect(bool cond, const std::string & message) {
+  if (!cond) {
+    std::cerr << "FAILED: " << message << std::endl;
+    n_failures++;
+  }
+}
+
+/// The first valid structure action, SHIFT before REDUCE before LEFT before RIGHT.
+unsigned first_valid_action(const twpipe::ArcEager & sys, const twpipe::State & state) {
+  unsigned mask = sys.get_valid_structure_actions(state);
+  if (mask & (1u << 0)) { return twpipe::ArcEager::get_shift_id(); }
+  if (mask & (1u << 1)) { return twpipe::ArcEager::get_reduce_id(); }
+  if (mask & (1u << 2)) { return twpipe::ArcEager::get_left_id(0); }
+  if (mask & (1u << 3)) { return twpipe::ArcEager::get_right_id(0); }
+  return UINT_MAX;
+}
+
+/// The same initial state as ParseModel::initialize_state, len includes the pseudo root.
+void initialize_state(unsigned len, twpipe::State & state) {
+  state.buffer.resize(len + 1);
+  for (unsigned i = 0; i < len; ++i) { state.buffer[len - i] = i; }
+  state.buffer[0] = twpipe::Corpus::BAD_HED;
+  state.stack.push_back(twpipe::Corpus::BAD_HED);
+}
+
+void decode(twpipe::ArcEager & sys,
+            const std::vector<unsigned> & prefix,
+            twpipe::State & state) {
+  for (unsigned action : prefix) {
+    expect(sys.is_valid_action(state, action), "prefix action " + sys.name(action) + " is valid");
+    sys.perform_action(state, action);
+  }
+  unsigned n_steps = 0;
+  while (!state.terminated()) {
+    unsigned action = first_valid_action(sys, state);
+    if (action == UINT_MAX) {
+      expect(false, "a valid action before the state terminates");
+      return;
+    }
+    sys.perform_action(state, action);
+    if (++n_steps > 4 * state.heads.size()) {
+      expect(false, "decoding terminates");
+      return;
+    }
+  }
+}
+
+void test_headless_stack(twpipe::ArcEager & sys) {
+  const unsigned len = 5;
+  twpipe::State state(len);
+  initialize_state(len, state);
+  decode(sys, {}, state);
+
+  for (unsigned i = 1; i < len; ++i) {
+    expect(state.heads[i] == 0, "word " + std::to_string(i) + " is attached to the pseudo root");
+    expect(state.deprels[i] == sys.root_deprel, "word " + std::to_string(i) + " has the root label");
+  }
+}
+
+void test_partially_attached_stack(twpipe::ArcEager & sys) {
+  // SHIFT the pseudo root, SHIFT 1, LEFT 1 <- 2, SHIFT 2, RIGHT 2 -> 3, SHIFT 4,
+  // then 2, 4 and 5 end on the stack without head.
+  const unsigned len = 6;
+  unsigned nsubj = twpipe::AlphabetCollection::get()->deprel_map.get("nsubj");
+  unsigned obj = twpipe::AlphabetCollection::get()->deprel_map.get("obj");
+  twpipe::State state(len);
+  initialize_state(len, state);
+  decode(sys, {twpipe::ArcEager::get_shift_id(),
+               twpipe::ArcEager::get_shift_id(),
+               twpipe::ArcEager::get_left_id(nsubj),
+               twpipe::ArcEager::get_shift_id(),
+               twpipe::ArcEager::get_right_id(obj),
+               twpipe::ArcEager::get_shift_id()}, state);
+
+  expect(state.heads[1] == 2 && state.deprels[1] == nsubj, "word 1 keeps its left arc");
+  expect(state.heads[3] == 2 && state.deprels[3] == obj, "word 3 keeps its right arc");
+  expect(state.heads[2] == 0, "word 2 is attached to the pseudo root");
+  expect(state.heads[4] == 0, "word 4 is attached to the pseudo root");
+  expect(state.heads[5] == 0, "word 5 is attached to the pseudo root");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  twpipe::Alphabet & deprel_map = twpipe::AlphabetCollection::get()->deprel_map;
+  deprel_map.insert("nsubj");
+  deprel_map.insert("root");
+  deprel_map.insert("obj");
+
+  twpipe::ArcEager sys;
+  test_headless_stack(sys);
+  test_partially_attached_stack(sys);
+
+  if (n_failures > 0) {
+    std::cerr << n_failures << " check(s) failed." << std::endl;
+    return 1;
+  }
+  std::cout << "all checks passed." << std::endl;
+  return 0;
+}
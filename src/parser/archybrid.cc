@@ -15,9 +15,9 @@ ArcHybrid::ArcHybrid() {
     action_names.push_back("LEFT-" + map.get(i));
     action_names.push_back("RIGHT-" + map.get(i));
   }
-  _INFO << "[parse|archybrid] show action names:";
+  _TRACE << "[parse|archybrid] show action names:";
   for (const auto& action_name : action_names) {
-    _INFO << "- " << action_name;
+    _TRACE << "- " << action_name;
   }
 }
 
@@ -188,30 +188,6 @@ bool ArcHybrid::is_shift(const unsigned & action) { return action == 0; }
 bool ArcHybrid::is_left(const unsigned & action) { return (action % 2 == 1); }
 bool ArcHybrid::is_right(const unsigned & action) { return (action > 0 && action % 2 == 0); }
 
-bool ArcHybrid::is_valid_action(const State& state, const unsigned& act) const {
-  if (is_shift(act)) {
-    /// guard should not be shifted.
-    if (state.buffer.size() <= 1) { return false; }
-  } else if (is_left(act)) {
-    /// guard not should not be head.
-    if (state.buffer.size() < 2) { return false; }
-    /// pseduo root should not be reduced.
-    if (state.stack.size() < 3) { return false; }
-  } else {
-    if (state.stack.size() < 3) { return false; }
-  }
-  return true;
-}
-
-void ArcHybrid::get_valid_actions(const State& state, std::vector<unsigned>& valid_actions) {
-  valid_actions.clear();
-  for (unsigned a = 0; a < n_actions; ++a) {
-    if (!is_valid_action(state, a)) { continue; }
-    valid_actions.push_back(a);
-  }
-  BOOST_ASSERT_MSG(valid_actions.size() > 0, "There should be one or more valid action.");
-}
-
 unsigned ArcHybrid::parse_label(const unsigned& action) {
   BOOST_ASSERT_MSG(action > 0, "SHITF do not have label.");
   return (action - 1) / 2;
@@ -231,10 +207,24 @@ void ArcHybrid::get_oracle_actions(const std::vector<unsigned>& heads,
   }
 }
 
-unsigned ArcHybrid::get_structure_action(const unsigned & action) {
+unsigned ArcHybrid::get_structure_action(const unsigned & action) const {
   return (action == 0 ? action : (action % 2 == 1 ? 1 : 2));
 }
 
+unsigned ArcHybrid::num_structure_actions() const { return 3; }
+
+unsigned ArcHybrid::get_valid_structure_actions(const State& state) const {
+  unsigned mask = 0;
+  /// SHIFT: guard should not be shifted.
+  if (state.buffer.size() > 1) { mask |= (1u << 0); }
+  if (state.stack.size() > 2) {
+    /// LEFT: guard should not be head, pseduo root should not be reduced.
+    if (state.buffer.size() > 1) { mask |= (1u << 1); }
+    mask |= (1u << 2);
+  }
+  return mask;
+}
+
 void ArcHybrid::get_oracle_actions_onestep(const std::vector<unsigned>& heads,
                                            const std::vector<unsigned>& deprels,
                                            std::vector<unsigned>& sigma,
@@ -17,9 +17,9 @@ ArcStandard::ArcStandard() {
     action_names.push_back("LEFT-" + map.get(i));
     action_names.push_back("RIGHT-" + map.get(i));
   }
-  _INFO << "[parse|arcstd] show action names:";
+  _TRACE << "[parse|arcstd] show action names:";
   for (const auto& action_name : action_names) {
-    _INFO << "- " << action_name;
+    _TRACE << "- " << action_name;
   }
 }
 
@@ -67,8 +67,8 @@ unsigned ArcStandard::cost(const State& state,
   // ref_heads is counted as [0, ... , N], the index of the first legal word is 0.
   // there is a guard in state.stack and state.buffer and the indices in the state
   // is counted as [0, ..., N], N is the root.
-  const std::vector<unsigned>& stack = state.stack;
-  const std::vector<unsigned>& buffer = state.buffer;
+  const FixedVector& stack = state.stack;
+  const FixedVector& buffer = state.buffer;
 
   if (stack.size() == 1) { return 0; }
   std::vector< std::vector<unsigned> > tree(ref_heads.size());
@@ -205,10 +205,24 @@ void ArcStandard::get_transition_costs(const State & state,
   }
 }
 
-unsigned ArcStandard::get_structure_action(const unsigned & action) {
+unsigned ArcStandard::get_structure_action(const unsigned & action) const {
   return (action < 1 ? action : (action % 2 == 1 ? 1 : 2));
 }
 
+unsigned ArcStandard::num_structure_actions() const { return 3; }
+
+unsigned ArcStandard::get_valid_structure_actions(const State& state) const {
+  unsigned mask = 0;
+  // SHIFT: the guard should not be shifted.
+  if (state.buffer.size() > 1) { mask |= (1u << 0); }
+  if (state.stack.size() > 2) {
+    // LEFT: should not left the root.
+    if (state.stack[state.stack.size() - 2] != 0) { mask |= (1u << 1); }
+    mask |= (1u << 2);
+  }
+  return mask;
+}
+
 void ArcStandard::perform_action(State & state, const unsigned& action) {
   if (is_shift(action)) {
     // SHITF: counting for the last GUARD
@@ -232,27 +246,6 @@ bool ArcStandard::is_shift(const unsigned& action) { return action == 0; }
 bool ArcStandard::is_left(const unsigned& action) { return action % 2 == 1; }
 bool ArcStandard::is_right(const unsigned& action) { return (action > 1 && action % 2 == 0); }
 
-bool ArcStandard::is_valid_action(const State& state, const unsigned& act) const {
-  if (is_shift(act)) {
-    if (state.buffer.size() == 1) { return false; }
-  } else {
-    if (state.stack.size() < 3) { return false; }
-    /* should not left the root. */
-    if (is_left(act) && state.stack[state.stack.size() - 2] == 0) { return false; }
-  }
-  return true;
-}
-
-void ArcStandard::get_valid_actions(const State& state, std::vector<unsigned>& valid_actions) {
-  valid_actions.clear();
-  for (unsigned a = 0; a < n_actions; ++a) {
-    //if (!is_valid_action(state, action_names[a])) { continue; }
-    if (!is_valid_action(state, a)) { continue; }
-    valid_actions.push_back(a);
-  }
-  BOOST_ASSERT_MSG(valid_actions.size() > 0, "There should be one or more valid action.");
-}
-
 unsigned ArcStandard::parse_label(const unsigned& action) const {
   BOOST_ASSERT_MSG(action > 0, "SHIFT do not have label.");
   return (action - 1) / 2;
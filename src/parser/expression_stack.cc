@@ -0,0 +1,58 @@
+#include "expression_stack.h"
+#include <boost/assert.hpp>
+
+namespace twpipe {
+
+ExpressionStack::ExpressionStack() : arena(nullptr), top(nullptr) {
+}
+
+ExpressionStack::ExpressionStack(ExpressionStackArena * arena) : arena(arena), top(nullptr) {
+}
+
+void ExpressionStack::push_back(const dynet::Expression & value) {
+  BOOST_ASSERT_MSG(arena != nullptr, "stack is not bound to an arena.");
+  top = arena->allocate(value, top);
+}
+
+void ExpressionStack::pop_back() {
+  BOOST_ASSERT_MSG(top != nullptr, "pop from an empty stack.");
+  top = top->prev;
+}
+
+const dynet::Expression & ExpressionStack::back(unsigned k) const {
+  const Node * node = top;
+  for (unsigned i = 0; i < k; ++i) {
+    BOOST_ASSERT_MSG(node != nullptr, "stack is not deep enough.");
+    node = node->prev;
+  }
+  BOOST_ASSERT_MSG(node != nullptr, "stack is not deep enough.");
+  return node->value;
+}
+
+unsigned ExpressionStack::size() const {
+  return (top == nullptr ? 0 : top->size);
+}
+
+bool ExpressionStack::empty() const {
+  return top == nullptr;
+}
+
+void ExpressionStack::clear() {
+  top = nullptr;
+}
+
+const ExpressionStack::Node * ExpressionStackArena::allocate(const dynet::Expression & value,
+                                                             const ExpressionStack::Node * prev) {
+  ExpressionStack::Node node;
+  node.value = value;
+  node.prev = prev;
+  node.size = (prev == nullptr ? 1 : prev->size + 1);
+  nodes.push_back(node);
+  return &nodes.back();
+}
+
+void ExpressionStackArena::clear() {
+  nodes.clear();
+}
+
+}
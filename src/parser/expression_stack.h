@@ -0,0 +1,54 @@
+#ifndef __TWPIPE_PARSER_EXPRESSION_STACK_H__
+#define __TWPIPE_PARSER_EXPRESSION_STACK_H__
+
+#include "dynet/expr.h"
+#include <deque>
+
+namespace twpipe {
+
+struct ExpressionStackArena;
+
+/// A persistent (shared-tail) stack of expressions. Push and pop never modify
+/// the existing nodes, so copying a stack is O(1) and the copies share their
+/// common prefix. The nodes are owned by an ExpressionStackArena.
+struct ExpressionStack {
+  struct Node {
+    dynet::Expression value;
+    const Node * prev;
+    unsigned size;
+  };
+
+  ExpressionStackArena * arena;
+  const Node * top;
+
+  ExpressionStack();
+  explicit ExpressionStack(ExpressionStackArena * arena);
+
+  void push_back(const dynet::Expression & value);
+
+  void pop_back();
+
+  /// The k-th expression from the top, back(0) is the top.
+  const dynet::Expression & back(unsigned k = 0) const;
+
+  unsigned size() const;
+
+  bool empty() const;
+
+  void clear();
+};
+
+/// Per-graph storage for the stack nodes. The nodes hold expressions of a
+/// single computation graph, so the arena is cleared when a new graph starts.
+struct ExpressionStackArena {
+  std::deque<ExpressionStack::Node> nodes;
+
+  const ExpressionStack::Node * allocate(const dynet::Expression & value,
+                                         const ExpressionStack::Node * prev);
+
+  void clear();
+};
+
+}
+
+#endif  //  end for __TWPIPE_PARSER_EXPRESSION_STACK_H__
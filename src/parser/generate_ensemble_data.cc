@@ -2,6 +2,7 @@
 #include <fstream>
 #include "dynet/dynet.h"
 #include "twpipe/logging.h"
+#include "twpipe/input_reader.h"
 #include "twpipe/embedding.h"
 #include "twpipe/trainer.h"
 #include "twpipe/model.h"
@@ -9,6 +10,7 @@
 #include "twpipe/corpus.h"
 #include "twpipe/json.hpp"
 #include "twpipe/ensemble.h"
+#include "twpipe/sharding.h"
 #include "parser/parse_model_builder.h"
 #include "parser/ensemble_generator.h"
 #include <boost/algorithm/string.hpp>
@@ -27,6 +29,8 @@ void init_commnad_line(int argc, char* argv[], po::variables_map & conf) {
 
   po::options_description embed_opts = twpipe::WordEmbedding::get_options();
   po::options_description ensemble_opts = twpipe::EnsembleParseDataGenerator::get_options();
+  po::options_description output_opts = twpipe::EnsembleWriter::get_options();
+  po::options_description shard_opts = twpipe::ShardRunner::get_options();
 
   po::positional_options_description input_opts;
   input_opts.add("input-file", -1);
@@ -35,6 +39,8 @@ void init_commnad_line(int argc, char* argv[], po::variables_map & conf) {
   cmd.add(generic_opts)
     .add(embed_opts)
     .add(ensemble_opts)
+    .add(output_opts)
+    .add(shard_opts)
     ;
 
   po::store(po::command_line_parser(argc, argv).options(cmd).positional(input_opts).run(),
@@ -54,6 +60,76 @@ void init_commnad_line(int argc, char* argv[], po::variables_map & conf) {
   }
 }
 
+/// Generate the ensemble data for the sentences in the shard. Without a
+/// runner, all the sentences are generated and written without record framing.
+unsigned generate(twpipe::EnsembleParseDataGenerator & generator,
+                  const twpipe::EnsembleWriter & writer,
+                  const std::string & input_file,
+                  const twpipe::ShardRunner * runner,
+                  unsigned shard,
+                  std::ostream & os) {
+  twpipe::StringPiece buffer;
+  std::vector<twpipe::StringPiece> data;
+  std::vector<std::string> tokens;
+  std::vector<std::string> postags;
+  std::vector<unsigned> heads;
+  std::vector<std::string> deprels;
+  heads.push_back(twpipe::Corpus::BAD_HED);
+  deprels.push_back(twpipe::Corpus::BAD0);
+  
+  std::vector<unsigned> actions;
+  std::vector<std::vector<float>> prob;
+  twpipe::InputReader reader;
+  if (!reader.open(input_file)) {
+    _ERROR << "[twpipe|parse|generator] failed to open " << input_file;
+    exit(1);
+  }
+
+  unsigned sid = 0;
+  while (reader.next_line(buffer)) {
+    if (buffer.empty()) {
+      if (runner == nullptr || runner->own(sid, shard)) {
+        generator.generate(tokens, postags, heads, deprels, actions, prob);
+
+        if (!actions.empty()) {
+          std::string output = writer.encode(sid, actions, prob);
+          if (runner == nullptr) {
+            os.write(output.data(), output.size());
+          } else {
+            twpipe::ShardRunner::write_record(os, sid, output);
+          }
+        }
+      }
+      tokens.clear();
+      postags.clear();
+      heads.clear();
+      deprels.clear();
+      heads.push_back(twpipe::Corpus::BAD_HED);
+      deprels.emplace_back(twpipe::Corpus::BAD0);
+      sid++;
+    } else if (buffer[0] == '#') {
+      continue;
+    } else {
+      twpipe::InputReader::split_fields(buffer, data);
+      tokens.push_back(data[1].str());
+      postags.push_back(data[3].str());
+      if (data[6] == "_") {
+        heads.push_back(twpipe::Corpus::BAD_HED);
+        deprels.emplace_back(twpipe::Corpus::BAD0);
+      } else {
+        unsigned head;
+        if (!data[6].to_unsigned(head)) {
+          _ERROR << "[twpipe|parse|generator] malformed head \"" << data[6] << "\" in sentence " << sid;
+          exit(1);
+        }
+        heads.push_back(head);
+        deprels.push_back(data[7].str());
+      }
+    }
+  }
+  return sid;
+}
+
 int main(int argc, char* argv[]) {
   dynet::initialize(argc, argv);
 
@@ -90,54 +166,34 @@ int main(int argc, char* argv[]) {
   }
 
   twpipe::EnsembleParseDataGenerator generator(engines, conf);
-  std::string buffer;
-  std::vector<std::string> tokens;
-  std::vector<std::string> postags;
-  std::vector<unsigned> heads;
-  std::vector<std::string> deprels;
-  heads.push_back(twpipe::Corpus::BAD_HED);
-  deprels.push_back(twpipe::Corpus::BAD0);
-  
-  std::vector<unsigned> actions;
-  std::vector<std::vector<float>> prob;
-  std::ifstream ifs(conf["input-file"].as<std::string>());
-                             
-  unsigned sid = 0;
-  while (std::getline(ifs, buffer)) {
-    boost::algorithm::trim(buffer);
-    if (buffer.empty()) {
-      generator.generate(tokens, postags, heads, deprels, actions, prob);
-
-      if (!actions.empty()) {
-        nlohmann::json output;
-        output = {{twpipe::EnsembleInstance::id_name,       sid},
-                  {twpipe::EnsembleInstance::category_name, actions},
-                  {twpipe::EnsembleInstance::prob_name,     prob}};
-        std::cout << output << std::endl;
-      }
-      tokens.clear();
-      postags.clear();
-      heads.clear();
-      deprels.clear();
-      heads.push_back(twpipe::Corpus::BAD_HED);
-      deprels.emplace_back(twpipe::Corpus::BAD0);
-      sid++;
-    } else if (buffer[0] == '#') {
-      continue;
-    } else {
-      std::vector<std::string> data;
-      boost::algorithm::split(data, buffer, boost::is_any_of("\t "));
-      tokens.push_back(data[1]);
-      postags.push_back(data[3]);
-      if (data[6] == "_") {
-        heads.push_back(twpipe::Corpus::BAD_HED);
-        deprels.emplace_back(twpipe::Corpus::BAD0);
-      } else {
-        heads.push_back(boost::lexical_cast<unsigned>(data[6]));
-        deprels.push_back(data[7]);
-      }
-    }
+  twpipe::EnsembleWriter writer(conf, engines[0]->sys.num_actions());
+  std::string input_file = conf["input-file"].as<std::string>();
+  std::vector<std::string> inputs(model_names);
+  inputs.push_back(input_file);
+  twpipe::ShardRunner runner(conf, inputs, writer.name());
+  if (runner.enabled() && input_file == "-") {
+    _ERROR << "[twpipe|parse|generator] the shards can't share the standard input.";
+    exit(1);
+  }
+  if (!runner.enabled()) {
+    writer.write_header(std::cout);
+    unsigned sid = generate(generator, writer, input_file, nullptr, 0, std::cout);
+    _INFO << "[twpipe|parse|generator] generate " << sid + 1 << " instances.";
+    return 0;
+  }
+
+  // each worker draws its own random stream for the roll-in policy.
+  unsigned seed = (*dynet::rndeng)();
+  bool ok = runner.run([&](unsigned shard, std::ostream & os) {
+    dynet::rndeng->seed(seed + shard);
+    unsigned sid = generate(generator, writer, input_file, &runner, shard, os);
+    _INFO << "[twpipe|parse|generator] shard " << shard << " scans " << sid << " instances.";
+  });
+  if (!ok) {
+    _ERROR << "[twpipe|parse|generator] some shards failed, rerun to resume.";
+    return 1;
   }
-  _INFO << "[twpipe|parse|generator] generate " << sid + 1 << " instances.";
+  writer.write_header(std::cout);
+  runner.merge(std::cout);
   return 0;
 }
\ No newline at end of file
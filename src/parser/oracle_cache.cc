@@ -0,0 +1,145 @@
+#include "oracle_cache.h"
+#include "tree.h"
+#include "twpipe/corpus_cache.h"
+#include "twpipe/mapped_file.h"
+#include "twpipe/logging.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
+
+namespace twpipe {
+
+const char* OracleCache::magic = "TWPO";
+const unsigned OracleCache::version = 1;
+
+void OracleCache::load_or_build(const Corpus & corpus, TransitionSystem & sys) {
+  const std::vector<Instance> & data = corpus.training_data;
+  if (corpus.cache_dir.empty() || corpus.training_key == 0) {
+    build(data, sys, corpus.n_threads);
+    return;
+  }
+
+  uint64_t cache_key = key(corpus.training_key, sys);
+  std::string cache_path = path(corpus.cache_dir, corpus.training_key, sys);
+  if (load(cache_path, cache_key) && actions.size() == data.size()) {
+    _INFO << "[parse|oracle] loaded from cache " << cache_path;
+    return;
+  }
+  build(data, sys, corpus.n_threads);
+  if (save(cache_path, cache_key)) {
+    _INFO << "[parse|oracle] cached to " << cache_path;
+  } else {
+    _WARN << "[parse|oracle] failed to write cache " << cache_path;
+  }
+}
+
+void OracleCache::build(const std::vector<Instance> & data,
+                        TransitionSystem & sys,
+                        unsigned n_threads) {
+  unsigned n = data.size();
+  // std::vector<bool> packs bits, so the threads write the flags to bytes.
+  std::vector<char> tree_flags(n, 0), projective_flags(n, 0);
+  actions.assign(n, std::vector<unsigned>());
+
+  // the oracles only read the system, so the sentences are strided over the
+  // threads.
+  auto work = [&](unsigned start, unsigned step) {
+    std::vector<unsigned> heads, deprels;
+    for (unsigned i = start; i < n; i += step) {
+      Corpus::parse_units_to_vector(data[i].parse_units, heads, deprels);
+      tree_flags[i] = DependencyUtils::is_tree(heads);
+      if (!tree_flags[i]) { continue; }
+      projective_flags[i] = DependencyUtils::is_projective(heads);
+      if (!projective_flags[i] && !sys.allow_nonprojective()) { continue; }
+      sys.get_oracle_actions(heads, deprels, actions[i]);
+    }
+  };
+
+  n_threads = std::max(1u, std::min(n_threads, n));
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < n_threads; ++t) {
+    threads.push_back(std::thread(work, t, n_threads));
+  }
+  work(0, n_threads);
+  for (std::thread & thread : threads) { thread.join(); }
+
+  is_tree.assign(tree_flags.begin(), tree_flags.end());
+  is_projective.assign(projective_flags.begin(), projective_flags.end());
+  _INFO << "[parse|oracle] computed oracle of " << n << " sentences with "
+    << n_threads << " threads.";
+}
+
+bool OracleCache::load(const std::string & path, uint64_t key) {
+  MappedFile file;
+  if (!file.open(path)) { return false; }
+
+  CacheReader reader(file.data, file.data + file.size);
+  if (file.size < 4 || std::memcmp(file.data, magic, 4) != 0) { return false; }
+  reader.p += 4;
+  if (reader.get<uint32_t>() != version || reader.get<uint64_t>() != key) { return false; }
+
+  uint32_t n = reader.get<uint32_t>();
+  if (n > file.size) { return false; }
+  is_tree.assign(n, false);
+  is_projective.assign(n, false);
+  actions.assign(n, std::vector<unsigned>());
+  for (unsigned i = 0; i < n && reader.ok; ++i) {
+    uint8_t flags = reader.get<uint8_t>();
+    is_tree[i] = (flags & 1) != 0;
+    is_projective[i] = (flags & 2) != 0;
+    uint32_t n_actions = reader.get<uint32_t>();
+    if (n_actions > file.size) { reader.ok = false; break; }
+    actions[i].resize(n_actions);
+    for (unsigned & action : actions[i]) { action = reader.get<uint32_t>(); }
+  }
+  if (!reader.ok) {
+    _WARN << "[parse|oracle] " << path << " is truncated, ignored.";
+    return false;
+  }
+  return true;
+}
+
+bool OracleCache::save(const std::string & path, uint64_t key) const {
+  if (!CorpusCache::create_parent_dir(path)) { return false; }
+
+  std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream ofs(tmp_path, std::ios::binary);
+    if (!ofs.good()) { return false; }
+    CacheWriter writer(ofs);
+    ofs.write(magic, 4);
+    writer.put<uint32_t>(version);
+    writer.put<uint64_t>(key);
+    writer.put<uint32_t>(actions.size());
+    for (unsigned i = 0; i < actions.size(); ++i) {
+      writer.put<uint8_t>((is_tree[i] ? 1 : 0) | (is_projective[i] ? 2 : 0));
+      writer.put<uint32_t>(actions[i].size());
+      for (unsigned action : actions[i]) { writer.put<uint32_t>(action); }
+    }
+    ofs.flush();
+    if (!ofs.good()) { return false; }
+  }
+  return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+uint64_t OracleCache::key(uint64_t corpus_key, const TransitionSystem & sys) {
+  std::string name = sys.name();
+  uint32_t n_actions = sys.num_actions();
+  uint64_t h = CorpusCache::hash(name.c_str(), name.size() + 1, corpus_key);
+  h = CorpusCache::hash(reinterpret_cast<const char *>(&n_actions), sizeof(n_actions), h);
+  return CorpusCache::hash(reinterpret_cast<const char *>(&version), sizeof(version), h);
+}
+
+std::string OracleCache::path(const std::string & cache_dir,
+                              uint64_t corpus_key,
+                              const TransitionSystem & sys) {
+  std::ostringstream S;
+  S << cache_dir << "/" << std::hex << std::setw(16) << std::setfill('0') << corpus_key
+    << "." << sys.name() << ".oracle";
+  return S.str();
+}
+
+}
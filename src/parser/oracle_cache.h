@@ -0,0 +1,47 @@
+#ifndef __TWPIPE_PARSER_ORACLE_CACHE_H__
+#define __TWPIPE_PARSER_ORACLE_CACHE_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "system.h"
+#include "twpipe/corpus.h"
+
+namespace twpipe {
+
+/// The static oracle of the training data: whether each sentence is a
+/// (projective) tree and its gold action sequence under a transition system.
+/// It's computed once before training, and stored next to the corpus cache
+/// when the corpus is cached.
+struct OracleCache {
+  static const char* magic;
+  static const unsigned version;
+
+  std::vector<bool> is_tree;
+  std::vector<bool> is_projective;
+  /// The gold actions, empty for the sentences that can't be parsed by the
+  /// system (non-tree, or non-projective for the projective systems).
+  std::vector<std::vector<unsigned>> actions;
+
+  /// Load the oracle from the cache, or compute it with n_threads threads.
+  void load_or_build(const Corpus & corpus, TransitionSystem & sys);
+
+  void build(const std::vector<Instance> & data,
+             TransitionSystem & sys,
+             unsigned n_threads);
+
+  bool load(const std::string & path, uint64_t key);
+
+  bool save(const std::string & path, uint64_t key) const;
+
+  /// The key combines the key of the training data with the transition system.
+  static uint64_t key(uint64_t corpus_key, const TransitionSystem & sys);
+
+  static std::string path(const std::string & cache_dir,
+                          uint64_t corpus_key,
+                          const TransitionSystem & sys);
+};
+
+}
+
+#endif  //  end for __TWPIPE_PARSER_ORACLE_CACHE_H__
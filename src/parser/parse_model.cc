@@ -5,6 +5,7 @@
 #include "twpipe/alphabet_collection.h"
 #include <vector>
 #include <random>
+#include <algorithm>
 
 namespace twpipe {
 
@@ -23,6 +24,21 @@ std::pair<unsigned, float> ParseModel::get_best_action(const std::vector<float>&
   return std::make_pair(best_a, best_score);
 }
 
+std::pair<unsigned, float> ParseModel::get_best_action(const std::vector<float>& scores,
+                                                       unsigned valid_mask) const {
+  unsigned best_a = UINT_MAX;
+  float best_score = 0.f;
+  for (unsigned a = 0; a < scores.size(); ++a) {
+    if (!TransitionSystem::is_valid_action(valid_mask, sys.get_structure_action(a))) { continue; }
+    if (best_a == UINT_MAX || best_score < scores[a]) {
+      best_a = a;
+      best_score = scores[a];
+    }
+  }
+  BOOST_ASSERT_MSG(best_a != UINT_MAX, "There should be one or more valid action.");
+  return std::make_pair(best_a, best_score);
+}
+
 po::options_description ParseModel::get_options() {
   po::options_description cmd("Parser settings.");
   cmd.add_options()
@@ -37,6 +53,7 @@ po::options_description ParseModel::get_options() {
     ("parse-label-dim", po::value<unsigned>()->default_value(20), "The dimension for label.")
     ("parse-lstm-input-dim", po::value<unsigned>()->default_value(100), "The dimension for lstm input.")
     ("parse-hidden-dim", po::value<unsigned>()->default_value(100), "The dimension for hidden unit.")
+    ("parse-batch-size", po::value<unsigned>()->default_value(32), "The number of sentences parsed together in evaluation and parsing.")
     ;
   return cmd;
 }
@@ -75,6 +92,27 @@ void ParseModel::predict(const std::vector<std::string>& words,
   Corpus::parse_units_to_vector(result, heads, deprels);
 }
 
+void ParseModel::predict_batch(const std::vector<std::vector<std::string>>& words,
+                               const std::vector<std::vector<std::string>>& postags,
+                               std::vector<std::vector<unsigned>>& heads,
+                               std::vector<std::vector<std::string>>& deprels) {
+  unsigned n = words.size();
+  std::vector<InputUnits> inputs(n);
+  for (unsigned i = 0; i < n; ++i) {
+    Corpus::vector_to_input_units(words[i], postags[i], inputs[i]);
+  }
+
+  std::vector<ParseUnits> results;
+  dynet::ComputationGraph cg;
+  predict_batch(cg, inputs, results);
+
+  heads.resize(n);
+  deprels.resize(n);
+  for (unsigned i = 0; i < n; ++i) {
+    Corpus::parse_units_to_vector(results[i], heads[i], deprels[i]);
+  }
+}
+
 void ParseModel::label(const std::vector<std::string> & words,
                        const std::vector<std::string> & postags,
                        const std::vector<unsigned> & heads,
@@ -92,23 +130,66 @@ void ParseModel::predict(dynet::ComputationGraph& cg,
   StateCheckpoint * checkpoint = get_initial_checkpoint();
   initialize(cg, input, state, checkpoint);
 
-  std::vector<unsigned> actions;
+  std::vector<float> scores;
   while (!state.terminated()) {
-    // collect all valid actions.
-    std::vector<unsigned> valid_actions;
-    sys.get_valid_actions(state, valid_actions);
-
-    dynet::Expression score_exprs = get_scores(checkpoint);
-    std::vector<float> scores = dynet::as_vector(cg.get_value(score_exprs));
+    unsigned valid_mask = sys.get_valid_structure_actions(state);
+    get_score_values(checkpoint, scores);
 
-    auto payload = get_best_action(scores, valid_actions);
+    auto payload = get_best_action(scores, valid_mask);
     unsigned best_a = payload.first;
-    actions.push_back(best_a);
     sys.perform_action(state, best_a);
     perform_action(best_a, state, cg, checkpoint);
   }
   destropy_checkpoint(checkpoint);
-  Corpus::vector_to_parse_units(state.heads, state.deprels, parse);
+  state.to_parse_units(parse);
+}
+
+void ParseModel::predict_batch(dynet::ComputationGraph& cg,
+                               const std::vector<InputUnits>& inputs,
+                               std::vector<ParseUnits>& parses) {
+  new_graph(cg);
+
+  unsigned n = inputs.size();
+  std::vector<State> states;
+  std::vector<StateCheckpoint *> checkpoints(n);
+  states.reserve(n);
+  for (unsigned i = 0; i < n; ++i) {
+    states.push_back(State(inputs[i].size()));
+    checkpoints[i] = get_initial_checkpoint();
+    initialize(cg, inputs[i], states[i], checkpoints[i]);
+  }
+
+  std::vector<unsigned> active;
+  std::vector<StateCheckpoint *> active_checkpoints;
+  std::vector<float> scores;
+  while (true) {
+    active.clear();
+    active_checkpoints.clear();
+    for (unsigned i = 0; i < n; ++i) {
+      if (states[i].terminated()) { continue; }
+      active.push_back(i);
+      active_checkpoints.push_back(checkpoints[i]);
+    }
+    if (active.empty()) { break; }
+
+    dynet::Expression score_exprs = get_batch_scores(active_checkpoints);
+    std::vector<float> s = dynet::as_vector(cg.get_value(score_exprs));
+    unsigned n_actions = s.size() / active.size();
+
+    for (unsigned j = 0; j < active.size(); ++j) {
+      unsigned i = active[j];
+      scores.assign(s.begin() + j * n_actions, s.begin() + (j + 1) * n_actions);
+      unsigned best_a = get_best_action(scores, sys.get_valid_structure_actions(states[i])).first;
+      sys.perform_action(states[i], best_a);
+      perform_action(best_a, states[i], cg, checkpoints[i]);
+    }
+  }
+
+  parses.resize(n);
+  for (unsigned i = 0; i < n; ++i) {
+    destropy_checkpoint(checkpoints[i]);
+    states[i].to_parse_units(parses[i]);
+  }
 }
 
 void ParseModel::label(dynet::ComputationGraph & cg,
@@ -127,13 +208,9 @@ void ParseModel::label(dynet::ComputationGraph & cg,
   std::vector<unsigned> ref_actions;
   sys.get_oracle_actions(ref_heads, ref_deprels, ref_actions);
   unsigned step = 0;
+  std::vector<float> scores;
   while (!state.terminated()) {
-    // collect all valid actions.
-    std::vector<unsigned> valid_actions;
-    sys.get_valid_actions(state, valid_actions);
-
-    dynet::Expression score_exprs = get_scores(checkpoint);
-    std::vector<float> scores = dynet::as_vector(cg.get_value(score_exprs));
+    get_score_values(checkpoint, scores);
 
     unsigned best_a = UINT_MAX, ref_structure_action = sys.get_structure_action(ref_actions[step]);
     for (unsigned i = 0; i < scores.size(); ++i) {
@@ -146,7 +223,29 @@ void ParseModel::label(dynet::ComputationGraph & cg,
     step++;
   }
   destropy_checkpoint(checkpoint);
-  Corpus::vector_to_parse_units(state.heads, state.deprels, output);
+  state.to_parse_units(output);
+}
+
+void ParseModel::get_ensemble_probs(dynet::ComputationGraph & cg,
+                                    const std::vector<ParseModel *> & engines,
+                                    const std::vector<StateCheckpoint *> & checkpoints,
+                                    std::vector<float> & probs) {
+  std::vector<dynet::Expression> ensemble_probs(engines.size());
+  for (unsigned i = 0; i < engines.size(); ++i) {
+    ensemble_probs[i] = dynet::softmax(engines[i]->get_scores(checkpoints[i]));
+  }
+  probs = dynet::as_vector(cg.get_value(dynet::average(ensemble_probs)));
+}
+
+dynet::Expression ParseModel::get_batch_scores(const std::vector<StateCheckpoint *> & checkpoints) {
+  std::vector<dynet::Expression> scores(checkpoints.size());
+  for (unsigned i = 0; i < checkpoints.size(); ++i) { scores[i] = get_scores(checkpoints[i]); }
+  return dynet::concatenate_cols(scores);
+}
+
+void ParseModel::get_score_values(StateCheckpoint * checkpoint, std::vector<float> & scores) {
+  dynet::Expression score_exprs = get_scores(checkpoint);
+  scores = dynet::as_vector(score_exprs.pg->get_value(score_exprs));
 }
 
 void ParseModel::beam_search(dynet::ComputationGraph & cg,
@@ -158,64 +257,74 @@ void ParseModel::beam_search(dynet::ComputationGraph & cg,
 
   new_graph(cg);
   unsigned len = input.size();
-  std::vector<State> states;
-  std::vector<float> scores;
-  std::vector<StateCheckpoint*> checkpoints;
-
-  states.push_back(State(len));
+  // only the current beam is kept alive, the hypotheses that fall out of
+  // the beam are released at each step and their blocks are reused.
+  StateArena arena(len);
+  std::vector<State> states, next_states;
+  std::vector<float> scores, next_scores;
+  std::vector<StateCheckpoint*> checkpoints, next_checkpoints;
+
+  states.push_back(State(len, arena));
   scores.push_back(0.);
   StateCheckpoint * initial_checkpoint = get_initial_checkpoint();
   initialize(cg, input, states[0], initial_checkpoint);
   checkpoints.push_back(initial_checkpoint);
 
-  unsigned curr = 0, next = 1;
-  while (!states[curr].terminated()) {
-    std::vector<Transition> transitions;
-    for (unsigned i = curr; i < next; ++i) {
-      const State& state = states[i];
-      float score = scores[i];
-      StateCheckpoint * checkpoint = checkpoints[i];
-
-      std::vector<unsigned> valid_actions;
-      sys.get_valid_actions(state, valid_actions);
-
-      dynet::Expression score_exprs = get_scores(checkpoint);
-      if (!structure_score) { score_exprs = dynet::log_softmax(score_exprs); }
-      std::vector<float> s = dynet::as_vector(cg.get_value(score_exprs));
-      for (unsigned a : valid_actions) {
-        transitions.push_back(std::make_tuple(i, a, score + s[a]));
+  std::vector<Transition> transitions;
+  while (!states[0].terminated()) {
+    // score the whole beam with one forward.
+    dynet::Expression score_exprs = get_batch_scores(checkpoints);
+    if (!structure_score) { score_exprs = dynet::log_softmax(score_exprs); }
+    std::vector<float> s = dynet::as_vector(cg.get_value(score_exprs));
+    unsigned n_actions = s.size() / checkpoints.size();
+
+    transitions.clear();
+    for (unsigned i = 0; i < states.size(); ++i) {
+      unsigned valid_mask = sys.get_valid_structure_actions(states[i]);
+      const float * row = &s[i * n_actions];
+      for (unsigned a = 0; a < n_actions; ++a) {
+        if (!TransitionSystem::is_valid_action(valid_mask, sys.get_structure_action(a))) { continue; }
+        transitions.push_back(std::make_tuple(i, a, scores[i] + row[a]));
       }
     }
 
-    sort(transitions.begin(), transitions.end(),
-         [](const Transition& a, const Transition& b) { return std::get<2>(a) > std::get<2>(b); });
-    curr = next;
+    auto greater = [](const Transition& a, const Transition& b) { return std::get<2>(a) > std::get<2>(b); };
+    unsigned n_kept = std::min<unsigned>(beam_size, transitions.size());
+    if (n_kept < transitions.size()) {
+      std::nth_element(transitions.begin(), transitions.begin() + n_kept, transitions.end(), greater);
+    }
+    // only the survivors are sorted so that parses[0] is the best one.
+    std::sort(transitions.begin(), transitions.begin() + n_kept, greater);
 
-    for (unsigned i = 0; i < transitions.size() && i < beam_size; ++i) {
+    next_states.clear();
+    next_scores.clear();
+    next_checkpoints.clear();
+    for (unsigned i = 0; i < n_kept; ++i) {
       unsigned cursor = std::get<0>(transitions[i]);
       unsigned action = std::get<1>(transitions[i]);
       float new_score = std::get<2>(transitions[i]);
 
-
-      State& state = states[cursor];
-      State new_state(state);
+      next_states.push_back(states[cursor]);
       StateCheckpoint * new_checkpoint = copy_checkpoint(checkpoints[cursor]);
-      sys.perform_action(new_state, action);
-      perform_action(action, new_state, cg, new_checkpoint);
-
-      //      
-      states.push_back(new_state);
-      scores.push_back(new_score);
-      checkpoints.push_back(new_checkpoint);
-      next++;
+      sys.perform_action(next_states.back(), action);
+      perform_action(action, next_states.back(), cg, new_checkpoint);
+
+      next_scores.push_back(new_score);
+      next_checkpoints.push_back(new_checkpoint);
+    }
+    for (StateCheckpoint * checkpoint : checkpoints) {
+      destropy_checkpoint(checkpoint);
     }
+    states.swap(next_states);
+    scores.swap(next_scores);
+    checkpoints.swap(next_checkpoints);
   }
   for (StateCheckpoint * checkpoint : checkpoints) {
     destropy_checkpoint(checkpoint);
   }
-  parses.resize(next - curr);
-  for (unsigned i = curr; i < next; ++i) {
-    Corpus::vector_to_parse_units(states[i].heads, states[i].deprels, parses[i - curr]);
+  parses.resize(states.size());
+  for (unsigned i = 0; i < states.size(); ++i) {
+    states[i].to_parse_units(parses[i]);
   }
 }
 
@@ -37,6 +37,13 @@ struct ParseModel {
              const std::vector<unsigned> & heads,
              std::vector<std::string> & deprels);
 
+  /// Parse a batch of sentences in lockstep: at each step the active sentences
+  /// are scored with one forward.
+  void predict_batch(const std::vector<std::vector<std::string>> & words,
+                     const std::vector<std::vector<std::string>> & postags,
+                     std::vector<std::vector<unsigned>> & heads,
+                     std::vector<std::vector<std::string>> & deprels);
+
   virtual void new_graph(dynet::ComputationGraph& cg) = 0;
 
   void initialize(dynet::ComputationGraph& cg,
@@ -59,6 +66,10 @@ struct ParseModel {
   static std::pair<unsigned, float> get_best_action(const std::vector<float>& scores,
                                                     const std::vector<unsigned>& valid_actions);
 
+  /// Get the best action among the actions whose structure is in the valid mask.
+  std::pair<unsigned, float> get_best_action(const std::vector<float>& scores,
+                                             unsigned valid_mask) const;
+
   virtual StateCheckpoint * get_initial_checkpoint() = 0;
 
   virtual StateCheckpoint * copy_checkpoint(StateCheckpoint * checkpoint) = 0;
@@ -68,12 +79,34 @@ struct ParseModel {
   /// Get the un-softmaxed scores from the LSTM-parser.
   virtual dynet::Expression get_scores(StateCheckpoint * checkpoint) = 0;
 
+  /// Get the un-softmaxed scores for a batch of checkpoints as one expression,
+  /// the i-th column holds the scores of the i-th checkpoint.
+  virtual dynet::Expression get_batch_scores(const std::vector<StateCheckpoint *> & checkpoints);
+
+  /// Get the un-softmaxed scores as values. It's used in decoding, so models that
+  /// can score without building the graph override it.
+  virtual void get_score_values(StateCheckpoint * checkpoint, std::vector<float> & scores);
+
+  /// Get the averaged action distribution of an ensemble. The distributions are
+  /// averaged inside the graph, so a step costs one get_value and one copy to
+  /// the host instead of one per engine. The engines have their own weights,
+  /// so their forwards still run one after another; the generators spread the
+  /// sentences over processes with --shards and --workers instead.
+  static void get_ensemble_probs(dynet::ComputationGraph & cg,
+                                 const std::vector<ParseModel *> & engines,
+                                 const std::vector<StateCheckpoint *> & checkpoints,
+                                 std::vector<float> & probs);
+
   virtual dynet::Expression l2() = 0;
   
   void predict(dynet::ComputationGraph& cg,
                const InputUnits& input,
                ParseUnits& parse);
 
+  void predict_batch(dynet::ComputationGraph& cg,
+                     const std::vector<InputUnits>& inputs,
+                     std::vector<ParseUnits>& parses);
+
   void label(dynet::ComputationGraph& cg,
              const InputUnits& input,
              const ParseUnits& parse,
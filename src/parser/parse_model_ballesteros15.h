@@ -2,6 +2,8 @@
 #define __TWPIPE_PARSER_BALLESTEROS15_H__
 
 #include "parse_model.h"
+#include "expression_stack.h"
+#include "stack_lstm_checkpoint.h"
 #include "state.h"
 #include "system.h"
 #include "twpipe/corpus.h"
@@ -13,16 +15,7 @@
 namespace twpipe {
 
 struct Ballesteros15Model : public ParseModel {
-  struct StateCheckpointImpl : public StateCheckpoint {
-    /// state machine
-    ~StateCheckpointImpl() {}
-
-    dynet::RNNPointer s_pointer;
-    dynet::RNNPointer q_pointer;
-    dynet::RNNPointer a_pointer;
-    std::vector<dynet::Expression> stack;
-    std::vector<dynet::Expression> buffer;
-  };
+  typedef StackLSTMCheckpoint StateCheckpointImpl;
 
   struct TransitionSystemFunction {
     virtual void perform_action(const unsigned& action,
@@ -116,12 +109,9 @@ struct Ballesteros15Model : public ParseModel {
   dynet::Expression word_end_guard;
   dynet::Expression root_word;
 
-  /// state machine
-  dynet::RNNPointer s_pointer;
-  dynet::RNNPointer q_pointer;
-  dynet::RNNPointer a_pointer;
-  std::vector<dynet::Expression> stack;
-  std::vector<dynet::Expression> buffer;
+  /// The stack nodes of the current graph and the recycled checkpoints.
+  ExpressionStackArena arena;
+  StackLSTMCheckpointPool checkpoint_pool;
 
   /// The reference
   TransitionSystemFunction* sys_func;
@@ -165,6 +155,8 @@ struct Ballesteros15Model : public ParseModel {
   /// Get the un-softmaxed scores from the LSTM-parser.
   dynet::Expression get_scores(StateCheckpoint * checkpoint) override;
 
+  dynet::Expression get_batch_scores(const std::vector<StateCheckpoint *> & checkpoints) override;
+
   dynet::Expression l2() override;
 };
 
@@ -87,10 +87,10 @@ void Dyer15Model::ArcStandardFunction::perform_action(const unsigned& action,
     dynet::Expression mod_expr, hed_expr;
     if (ArcStandard::is_left(action)) {
       hed_expr = cp.stack.back();
-      mod_expr = cp.stack[cp.stack.size() - 2];
+      mod_expr = cp.stack.back(1);
     } else {
       mod_expr = cp.stack.back();
-      hed_expr = cp.stack[cp.stack.size() - 2];
+      hed_expr = cp.stack.back(1);
     }
     cp.stack.pop_back(); cp.stack.pop_back();
     cp.s_pointer = s_lstm.get_head(cp.s_pointer);
@@ -134,7 +134,7 @@ void Dyer15Model::ArcHybridFunction::perform_action(const unsigned& action,
     cp.q_pointer = q_lstm.state();
   } else {
     dynet::Expression mod_expr, hed_expr;
-    hed_expr = cp.stack[cp.stack.size() - 2];
+    hed_expr = cp.stack.back(1);
     mod_expr = cp.stack.back();
 
     cp.stack.pop_back();
@@ -167,7 +167,7 @@ void Dyer15Model::SwapFunction::perform_action(const unsigned & action,
     cp.q_pointer = q_lstm.get_head(cp.q_pointer);
   } else if (Swap::is_swap(action)) {
     dynet::Expression j_expr = cp.stack.back();
-    dynet::Expression i_expr = cp.stack[cp.stack.size() - 2];
+    dynet::Expression i_expr = cp.stack.back(1);
 
     cp.stack.pop_back();
     cp.stack.pop_back();
@@ -183,11 +183,13 @@ void Dyer15Model::SwapFunction::perform_action(const unsigned & action,
     dynet::Expression mod_expr, hed_expr;
     if (Swap::is_left(action)) {
       hed_expr = cp.stack.back();
-      mod_expr = cp.stack[cp.stack.size() - 2];
+      mod_expr = cp.stack.back(1);
     } else {
-      hed_expr = cp.stack[cp.stack.size() - 2];
+      hed_expr = cp.stack.back(1);
       mod_expr = cp.stack.back();
     }
+    cp.stack.pop_back();
+    cp.stack.pop_back();
     cp.s_pointer = s_lstm.get_head(cp.s_pointer);
     cp.s_pointer = s_lstm.get_head(cp.s_pointer);
     cp.stack.push_back(dynet::tanh(composer.get_output(hed_expr, mod_expr, rel_expr)));
@@ -259,22 +261,15 @@ void Dyer15Model::perform_action(const unsigned& action,
 }
 
 Dyer15Model::StateCheckpoint * Dyer15Model::get_initial_checkpoint() {
-  return new StateCheckpointImpl();
+  return checkpoint_pool.get();
 }
 
 ParseModel::StateCheckpoint * Dyer15Model::copy_checkpoint(StateCheckpoint * checkpoint) {
-  auto * cp = dynamic_cast<StateCheckpointImpl *>(checkpoint);
-  auto * new_checkpoint = new StateCheckpointImpl();
-  new_checkpoint->s_pointer = cp->s_pointer;
-  new_checkpoint->q_pointer = cp->q_pointer;
-  new_checkpoint->a_pointer = cp->a_pointer;
-  new_checkpoint->stack = cp->stack;
-  new_checkpoint->buffer = cp->buffer;
-  return new_checkpoint;
+  return checkpoint_pool.copy(*dynamic_cast<StateCheckpointImpl *>(checkpoint));
 }
 
 void Dyer15Model::destropy_checkpoint(StateCheckpoint * checkpoint) {
-  delete dynamic_cast<StateCheckpointImpl *>(checkpoint);
+  checkpoint_pool.release(dynamic_cast<StateCheckpointImpl *>(checkpoint));
 }
 
 dynet::Expression Dyer15Model::get_scores(ParseModel::StateCheckpoint * checkpoint) {
@@ -286,6 +281,10 @@ dynet::Expression Dyer15Model::get_scores(ParseModel::StateCheckpoint * checkpoi
   ));
 }
 
+dynet::Expression Dyer15Model::get_batch_scores(const std::vector<ParseModel::StateCheckpoint *> & checkpoints) {
+  return stack_lstm_batch_scores(checkpoints, s_lstm, q_lstm, a_lstm, merge, scorer);
+}
+
 dynet::Expression Dyer15Model::l2() {
   std::vector<dynet::Expression> ret;
   for (auto & layer : s_lstm.param_vars) { for (auto & e : layer) { ret.push_back(dynet::squared_norm(e)); } }
@@ -316,6 +315,11 @@ void Dyer15Model::new_graph(dynet::ComputationGraph& cg) {
   merge.new_graph(cg);
   composer.new_graph(cg);
   scorer.new_graph(cg);
+  arena.clear();
+
+  s_lstm.start_new_sequence();
+  q_lstm.start_new_sequence();
+  a_lstm.start_new_sequence();
 
   action_start = dynet::parameter(cg, p_action_start);
   buffer_guard = dynet::parameter(cg, p_buffer_guard);
@@ -331,39 +335,41 @@ void Dyer15Model::initialize_parser(dynet::ComputationGraph & cg,
   unsigned len = input.size();
   std::vector<std::string> words(len);
   // The first unit is pseduo root.
-  for (unsigned i = 0; i < len; ++i) { words[i] = input[i].word; }
+  for (unsigned i = 0; i < len; ++i) { words[i] = input.word(i); }
   WordEmbedding::get()->render(words, embeddings);
 
-  s_lstm.start_new_sequence();
-  q_lstm.start_new_sequence();
-  a_lstm.start_new_sequence();
-  a_lstm.add_input(action_start);
+  // the sentences in one graph share the LSTMs, so each sentence starts from
+  // an empty pointer rather than a new sequence.
+  a_lstm.add_input(dynet::RNNPointer(), action_start);
+  cp->a_pointer = a_lstm.state();
 
-  cp->stack.clear();
-  cp->buffer.resize(len + 1);
+  std::vector<dynet::Expression> buffer(len + 1);
 
   // Pay attention to this, if the guard word is handled here, there is no need
   // to insert it when loading the data.
-  cp->buffer[0] = buffer_guard;
+  buffer[0] = buffer_guard;
   for (unsigned i = 0; i < len; ++i) {
     unsigned wid = input[i].wid;
     unsigned pid = input[i].pid;
 
-    cp->buffer[len - i] = dynet::rectify(merge_input.get_output(
+    buffer[len - i] = dynet::rectify(merge_input.get_output(
       word_emb.embed(wid), pos_emb.embed(pid), pretrain_emb.get_output(embeddings[i])
     ));
   }
 
   // push word into buffer in reverse order, pay attention to (i == len).
+  cp->stack = ExpressionStack(&arena);
+  cp->buffer = ExpressionStack(&arena);
+  cp->q_pointer = dynet::RNNPointer();
   for (unsigned i = 0; i <= len; ++i) {
-    q_lstm.add_input(cp->buffer[i]);
+    cp->buffer.push_back(buffer[i]);
+    q_lstm.add_input(cp->q_pointer, buffer[i]);
+    cp->q_pointer = q_lstm.state();
   }
 
-  s_lstm.add_input(stack_guard);
+  s_lstm.add_input(dynet::RNNPointer(), stack_guard);
   cp->stack.push_back(stack_guard);
-  cp->a_pointer = a_lstm.state();
   cp->s_pointer = s_lstm.state();
-  cp->q_pointer = q_lstm.state();
 }
 
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #define __TWPIPE_PARSER_DYER15_H__
 
 #include "parse_model.h"
+#include "expression_stack.h"
+#include "stack_lstm_checkpoint.h"
 #include "state.h"
 #include "system.h"
 #include "dynet_layer/layer.h"
@@ -14,16 +16,7 @@ namespace twpipe {
 struct Dyer15Model : public ParseModel {
   typedef dynet::CoupledLSTMBuilder LSTMBuilderType;
 
-  struct StateCheckpointImpl : public StateCheckpoint {
-    /// state machine
-    ~StateCheckpointImpl() {}
-
-    dynet::RNNPointer s_pointer;
-    dynet::RNNPointer q_pointer;
-    dynet::RNNPointer a_pointer;
-    std::vector<dynet::Expression> stack;
-    std::vector<dynet::Expression> buffer;
-  };
+  typedef StackLSTMCheckpoint StateCheckpointImpl;
 
   struct TransitionSystemFunction {
     virtual void perform_action(const unsigned& action,
@@ -108,6 +101,10 @@ struct Dyer15Model : public ParseModel {
   dynet::Expression buffer_guard;
   dynet::Expression stack_guard;
 
+  /// The stack nodes of the current graph and the recycled checkpoints.
+  ExpressionStackArena arena;
+  StackLSTMCheckpointPool checkpoint_pool;
+
   /// The reference
   TransitionSystemFunction* sys_func;
 
@@ -149,6 +146,8 @@ struct Dyer15Model : public ParseModel {
   /// Get the un-softmaxed scores from the LSTM-parser.
   dynet::Expression get_scores(StateCheckpoint * checkpoint) override;
 
+  dynet::Expression get_batch_scores(const std::vector<StateCheckpoint *> & checkpoints) override;
+
   dynet::Expression l2() override;
 };
 
@@ -1,62 +1,59 @@
 #include "parse_model_kiperwasser16.h"
 #include "twpipe/logging.h"
 #include "twpipe/embedding.h"
+#include <cmath>
 
 namespace twpipe {
 
-void Kiperwasser16Model::ArcEagerFunction::extract_feature(std::vector<dynet::Expression>& encoded,
-                                                           dynet::Expression& empty,
+void Kiperwasser16Model::ArcEagerFunction::extract_feature(unsigned empty,
                                                            Kiperwasser16Model::StateCheckpointImpl & cp,
                                                            const State& state) {
   // S1, S0, B0, B1
   // should do after sys.perform_action
   unsigned stack_size = state.stack.size();
-  if (stack_size > 2) { cp.f0 = encoded[state.stack[stack_size - 2]]; } else { cp.f0 = empty; }
-  if (stack_size > 1) { cp.f1 = encoded[state.stack[stack_size - 1]]; } else { cp.f1 = empty; }
+  if (stack_size > 2) { cp.f0 = state.stack[stack_size - 2]; } else { cp.f0 = empty; }
+  if (stack_size > 1) { cp.f1 = state.stack[stack_size - 1]; } else { cp.f1 = empty; }
 
   unsigned buffer_size = state.buffer.size();
-  if (buffer_size > 1) { cp.f2 = encoded[state.buffer[buffer_size - 1]]; } else { cp.f2 = empty; }
-  if (buffer_size > 2) { cp.f3 = encoded[state.buffer[buffer_size - 2]]; } else { cp.f3 = empty; }
+  if (buffer_size > 1) { cp.f2 = state.buffer[buffer_size - 1]; } else { cp.f2 = empty; }
+  if (buffer_size > 2) { cp.f3 = state.buffer[buffer_size - 2]; } else { cp.f3 = empty; }
 }
 
-void Kiperwasser16Model::ArcStandardFunction::extract_feature(std::vector<dynet::Expression> & encoded,
-                                                              dynet::Expression & empty,
+void Kiperwasser16Model::ArcStandardFunction::extract_feature(unsigned empty,
                                                               Kiperwasser16Model::StateCheckpointImpl & cp,
                                                               const State& state) {
   // should considering the guard in state and buffer.
   unsigned stack_size = state.stack.size();
-  if (stack_size > 3) { cp.f0 = encoded[state.stack[stack_size - 3]]; } else { cp.f0 = empty; }
-  if (stack_size > 2) { cp.f1 = encoded[state.stack[stack_size - 2]]; } else { cp.f1 = empty; }
-  if (stack_size > 1) { cp.f2 = encoded[state.stack[stack_size - 1]]; } else { cp.f2 = empty; }
+  if (stack_size > 3) { cp.f0 = state.stack[stack_size - 3]; } else { cp.f0 = empty; }
+  if (stack_size > 2) { cp.f1 = state.stack[stack_size - 2]; } else { cp.f1 = empty; }
+  if (stack_size > 1) { cp.f2 = state.stack[stack_size - 1]; } else { cp.f2 = empty; }
 
   unsigned buffer_size = state.buffer.size();
-  if (buffer_size > 1) { cp.f3 = encoded[state.buffer[buffer_size - 1]]; } else { cp.f3 = empty; }
+  if (buffer_size > 1) { cp.f3 = state.buffer[buffer_size - 1]; } else { cp.f3 = empty; }
 }
 
-void Kiperwasser16Model::ArcHybridFunction::extract_feature(std::vector<dynet::Expression>& encoded,
-                                                            dynet::Expression & empty,
+void Kiperwasser16Model::ArcHybridFunction::extract_feature(unsigned empty,
                                                             Kiperwasser16Model::StateCheckpointImpl & cp,
                                                             const State& state) {
   unsigned stack_size = state.stack.size();
-  if (stack_size > 3) { cp.f0 = encoded[state.stack[stack_size - 3]]; } else { cp.f0 = empty; }
-  if (stack_size > 2) { cp.f1 = encoded[state.stack[stack_size - 2]]; } else { cp.f1 = empty; }
-  if (stack_size > 1) { cp.f2 = encoded[state.stack[stack_size - 1]]; } else { cp.f2 = empty; }
+  if (stack_size > 3) { cp.f0 = state.stack[stack_size - 3]; } else { cp.f0 = empty; }
+  if (stack_size > 2) { cp.f1 = state.stack[stack_size - 2]; } else { cp.f1 = empty; }
+  if (stack_size > 1) { cp.f2 = state.stack[stack_size - 1]; } else { cp.f2 = empty; }
 
   unsigned buffer_size = state.buffer.size();
-  if (buffer_size > 1) { cp.f3 = encoded[state.buffer[buffer_size - 1]]; } else { cp.f3 = empty; }
+  if (buffer_size > 1) { cp.f3 = state.buffer[buffer_size - 1]; } else { cp.f3 = empty; }
 }
 
-void Kiperwasser16Model::SwapFunction::extract_feature(std::vector<dynet::Expression>& encoded,
-                                                       dynet::Expression& empty,
+void Kiperwasser16Model::SwapFunction::extract_feature(unsigned empty,
                                                        Kiperwasser16Model::StateCheckpointImpl & cp,
                                                        const State& state) {
   unsigned stack_size = state.stack.size();
-  if (stack_size > 3) { cp.f0 = encoded[state.stack[stack_size - 3]]; } else { cp.f0 = empty; }
-  if (stack_size > 2) { cp.f1 = encoded[state.stack[stack_size - 2]]; } else { cp.f1 = empty; }
-  if (stack_size > 1) { cp.f2 = encoded[state.stack[stack_size - 1]]; } else { cp.f2 = empty; }
+  if (stack_size > 3) { cp.f0 = state.stack[stack_size - 3]; } else { cp.f0 = empty; }
+  if (stack_size > 2) { cp.f1 = state.stack[stack_size - 2]; } else { cp.f1 = empty; }
+  if (stack_size > 1) { cp.f2 = state.stack[stack_size - 1]; } else { cp.f2 = empty; }
 
   unsigned buffer_size = state.buffer.size();
-  if (buffer_size > 1) { cp.f3 = encoded[state.buffer[buffer_size - 1]]; } else { cp.f3 = empty; }
+  if (buffer_size > 1) { cp.f3 = state.buffer[buffer_size - 1]; } else { cp.f3 = empty; }
 }
 
 Kiperwasser16Model::Kiperwasser16Model(dynet::ParameterCollection & m,
@@ -117,6 +114,10 @@ void Kiperwasser16Model::new_graph(dynet::ComputationGraph & cg) {
   fwd_guard = dynet::parameter(cg, p_fwd_guard);
   bwd_guard = dynet::parameter(cg, p_bwd_guard);
   empty = dynet::parameter(cg, p_empty);
+
+  merge_bias.clear();
+  scorer_weight.clear();
+  scorer_bias.clear();
 }
 
 void Kiperwasser16Model::initialize_parser(dynet::ComputationGraph & cg,
@@ -128,7 +129,7 @@ void Kiperwasser16Model::initialize_parser(dynet::ComputationGraph & cg,
   unsigned len = input.size();
   std::vector<std::string> words(len);
   // The first unit is pseduo root.
-  for (unsigned i = 0; i < len; ++i) { words[i] = input[i].word; }
+  for (unsigned i = 0; i < len; ++i) { words[i] = input.word(i); }
   WordEmbedding::get()->render(words, embeddings);
 
   fwd_lstm.start_new_sequence();
@@ -153,14 +154,17 @@ void Kiperwasser16Model::initialize_parser(dynet::ComputationGraph & cg,
     fwd_lstm_output[i] = fwd_lstm.back();
     bwd_lstm_output[len - 1 - i] = bwd_lstm.back();
   }
-  encoded.resize(len);
+  cp->sentence = std::make_shared<EncodedSentence>();
+  std::vector<dynet::Expression> & encoded = cp->sentence->encoded;
+  encoded.resize(len + 1);
   for (unsigned i = 0; i < len; ++i) {
     encoded[i] = dynet::concatenate({ fwd_lstm_output[i], bwd_lstm_output[i] });
   }
+  encoded[len] = empty;
 
   State state(len);
   initialize_state(input, state);
-  sys_func->extract_feature(encoded, empty, *cp, state);
+  sys_func->extract_feature(len, *cp, state);
 }
 
 void Kiperwasser16Model::perform_action(const unsigned & action,
@@ -168,7 +172,7 @@ void Kiperwasser16Model::perform_action(const unsigned & action,
                                         dynet::ComputationGraph & cg,
                                         ParseModel::StateCheckpoint * checkpoint) {
   auto * cp = dynamic_cast<StateCheckpointImpl *>(checkpoint);
-  sys_func->extract_feature(encoded, empty, *cp, state);
+  sys_func->extract_feature(cp->sentence->encoded.size() - 1, *cp, state);
 }
 
 ParseModel::StateCheckpoint * Kiperwasser16Model::get_initial_checkpoint() {
@@ -178,6 +182,7 @@ ParseModel::StateCheckpoint * Kiperwasser16Model::get_initial_checkpoint() {
 ParseModel::StateCheckpoint * Kiperwasser16Model::copy_checkpoint(StateCheckpoint * checkpoint) {
   auto * cp = dynamic_cast<StateCheckpointImpl *>(checkpoint);
   auto * new_checkpoint = new StateCheckpointImpl();
+  new_checkpoint->sentence = cp->sentence;
   new_checkpoint->f0 = cp->f0;
   new_checkpoint->f1 = cp->f1;
   new_checkpoint->f2 = cp->f2;
@@ -191,7 +196,64 @@ void Kiperwasser16Model::destropy_checkpoint(StateCheckpoint * checkpoint) {
 
 dynet::Expression Kiperwasser16Model::get_scores(ParseModel::StateCheckpoint * checkpoint) {
   auto * cp = dynamic_cast<StateCheckpointImpl *>(checkpoint);
-  return scorer.get_output(dynet::tanh(merge.get_output(cp->f0, cp->f1, cp->f2, cp->f3)));
+  return scorer.get_output(dynet::tanh(merge.get_output(
+    get_feature(cp, cp->f0), get_feature(cp, cp->f1), get_feature(cp, cp->f2), get_feature(cp, cp->f3))));
+}
+
+dynet::Expression Kiperwasser16Model::get_batch_scores(const std::vector<ParseModel::StateCheckpoint *> & checkpoints) {
+  unsigned n = checkpoints.size();
+  std::vector<dynet::Expression> f0(n), f1(n), f2(n), f3(n);
+  for (unsigned i = 0; i < n; ++i) {
+    auto * cp = dynamic_cast<StateCheckpointImpl *>(checkpoints[i]);
+    f0[i] = get_feature(cp, cp->f0);
+    f1[i] = get_feature(cp, cp->f1);
+    f2[i] = get_feature(cp, cp->f2);
+    f3[i] = get_feature(cp, cp->f3);
+  }
+  return scorer.get_output(dynet::tanh(merge.get_output(
+    dynet::concatenate_cols(f0),
+    dynet::concatenate_cols(f1),
+    dynet::concatenate_cols(f2),
+    dynet::concatenate_cols(f3))));
+}
+
+dynet::Expression Kiperwasser16Model::get_feature(StateCheckpointImpl * checkpoint,
+                                                  unsigned position) {
+  return checkpoint->sentence->encoded[position];
+}
+
+void Kiperwasser16Model::get_score_values(ParseModel::StateCheckpoint * checkpoint,
+                                          std::vector<float> & scores) {
+  auto * cp = dynamic_cast<StateCheckpointImpl *>(checkpoint);
+  dynet::ComputationGraph & cg = *empty.pg;
+  if (merge_bias.empty()) {
+    merge_bias = dynet::as_vector(cg.get_value(merge.B));
+    scorer_weight = dynet::as_vector(cg.get_value(scorer.W));
+    scorer_bias = dynet::as_vector(cg.get_value(scorer.B));
+  }
+  std::vector<float> & projected = cp->sentence->projected;
+  if (projected.empty()) {
+    // [W1; W2; W3; W4] * [encoded_0, ..., encoded_n, empty] in one product.
+    dynet::Expression weights = dynet::concatenate({ merge.W1, merge.W2, merge.W3, merge.W4 });
+    projected = dynet::as_vector(cg.get_value(weights * dynet::concatenate_cols(cp->sentence->encoded)));
+  }
+
+  unsigned n_rows = 4 * dim_hidden;
+  const unsigned features[4] = { cp->f0, cp->f1, cp->f2, cp->f3 };
+  hidden.assign(merge_bias.begin(), merge_bias.end());
+  for (unsigned k = 0; k < 4; ++k) {
+    const float * column = &projected[features[k] * n_rows + k * dim_hidden];
+    for (unsigned i = 0; i < dim_hidden; ++i) { hidden[i] += column[i]; }
+  }
+  for (unsigned i = 0; i < dim_hidden; ++i) { hidden[i] = std::tanh(hidden[i]); }
+
+  // the values are column-major, scorer_weight[j * size_a + i] is W(i, j).
+  scores.assign(scorer_bias.begin(), scorer_bias.end());
+  for (unsigned j = 0; j < dim_hidden; ++j) {
+    const float * column = &scorer_weight[j * size_a];
+    float h = hidden[j];
+    for (unsigned i = 0; i < size_a; ++i) { scores[i] += column[i] * h; }
+  }
 }
 
 dynet::Expression Kiperwasser16Model::l2() {
@@ -7,51 +7,61 @@
 #include "dynet_layer/layer.h"
 #include <vector>
 #include <unordered_map>
+#include <memory>
 
 namespace twpipe {
 
 struct Kiperwasser16Model : public ParseModel {
+  /// The per-sentence encoding, shared by all the checkpoints of a sentence so
+  /// that several sentences can live in one graph.
+  struct EncodedSentence {
+    std::vector<dynet::Expression> encoded;  // the BiLSTM outputs followed by empty
+
+    /// The merge projections of all the encoded positions (4 * dim_hidden rows,
+    /// one column per position). Filled on the first call of get_score_values,
+    /// so the training graphs are not affected.
+    std::vector<float> projected;
+  };
+
   struct StateCheckpointImpl : public StateCheckpoint {
     /// state machine
     ~StateCheckpointImpl() {}
 
-    dynet::Expression f0;
-    dynet::Expression f1;
-    dynet::Expression f2;
-    dynet::Expression f3;
+    std::shared_ptr<EncodedSentence> sentence;
+
+    /// the positions in encoded, the last one is the empty feature.
+    unsigned f0;
+    unsigned f1;
+    unsigned f2;
+    unsigned f3;
   };
 
   struct TransitionSystemFunction {
-    virtual void extract_feature(std::vector<dynet::Expression>& encoded,
-                                 dynet::Expression & empty,
+    virtual void extract_feature(unsigned empty,
                                  StateCheckpointImpl & checkpoint,
                                  const State & state) = 0;
   };
 
   struct ArcEagerFunction : public TransitionSystemFunction {
-    void extract_feature(std::vector<dynet::Expression>& encoded,
-                         dynet::Expression& empty,
+    void extract_feature(unsigned empty,
                          StateCheckpointImpl & checkpoint,
                          const State& state) override;
   };
 
   struct ArcStandardFunction : public TransitionSystemFunction {
-    void extract_feature(std::vector<dynet::Expression>& encoded,
-                         dynet::Expression & empty,
+    void extract_feature(unsigned empty,
                          StateCheckpointImpl & checkpoint,
                          const State & state) override;
   };
 
   struct ArcHybridFunction : public TransitionSystemFunction {
-    void extract_feature(std::vector<dynet::Expression>& encoded,
-                         dynet::Expression& empty,
+    void extract_feature(unsigned empty,
                          StateCheckpointImpl & checkpoint,
                          const State & state) override;
   };
 
   struct SwapFunction : public TransitionSystemFunction {
-    void extract_feature(std::vector<dynet::Expression>& encoded,
-                         dynet::Expression& empty,
+    void extract_feature(unsigned empty,
                          StateCheckpointImpl & checkpoint,
                          const State& state) override;
   };
@@ -65,7 +75,13 @@ struct Kiperwasser16Model : public ParseModel {
   Merge3Layer merge_input;
   Merge4Layer merge;        // merge (s2, s1, s0, n0)
   DenseLayer scorer;
-  std::vector<dynet::Expression> encoded;
+
+  /// Parameter values for scoring without building the graph, filled on the
+  /// first call of get_score_values in a graph.
+  std::vector<float> merge_bias;
+  std::vector<float> scorer_weight;
+  std::vector<float> scorer_bias;
+  std::vector<float> hidden;
 
   dynet::Parameter p_empty;
   dynet::Parameter p_fwd_guard;   // start of fwd
@@ -111,6 +127,12 @@ struct Kiperwasser16Model : public ParseModel {
   /// Get the un-softmaxed scores from the LSTM-parser.
   dynet::Expression get_scores(StateCheckpoint * checkpoint) override;
 
+  dynet::Expression get_batch_scores(const std::vector<StateCheckpoint *> & checkpoints) override;
+
+  void get_score_values(StateCheckpoint * checkpoint, std::vector<float> & scores) override;
+
+  dynet::Expression get_feature(StateCheckpointImpl * checkpoint, unsigned position);
+
   dynet::Expression l2() override;
 };
 
@@ -1,11 +1,16 @@
 #include "parser_trainer.h"
 #include "tree.h"
 #include "twpipe/logging.h"
+#include "twpipe/checkpoint.h"
+#include "twpipe/hogwild.h"
+#include "twpipe/allreduce.h"
+#include "twpipe/telemetry.h"
 #include "twpipe/alphabet_collection.h"
 #include "twpipe/model.h"
 #include "twpipe/json.hpp"
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 
 namespace twpipe {
 
@@ -26,34 +31,49 @@ ParserTrainer::ParserTrainer(ParseModel & engine,
   opt_builder(opt_builder) {
   noisify_method_name = conf["parse-noisify-method"].as<std::string>();
   singleton_dropout_prob = conf["parse-noisify-singleton-dropout-prob"].as<float>();
+  eval_batch_size = conf["parse-batch-size"].as<unsigned>();
+  if (eval_batch_size == 0) { eval_batch_size = 1; }
 }
 
 float ParserTrainer::evaluate(Corpus & corpus) {
-  float n_recall = 0.f, n_total = 0.f;
-  for (unsigned sid = 0; sid < corpus.n_devel; ++sid) {
-    const Instance & inst = corpus.devel_data.at(sid);
-
-    unsigned len = inst.input_units.size();
-    std::vector<std::string> words(len - 1), postags(len - 1);
-    std::vector<unsigned> pred_heads, gold_heads(len - 1);
-    std::vector<std::string> pred_deprels, gold_deprels(len - 1);
-    for (unsigned i = 1; i < inst.input_units.size(); ++i) {
-      words[i - 1] = inst.input_units[i].word;
-      postags[i - 1] = inst.input_units[i].postag;
-      gold_heads[i - 1] = inst.parse_units[i].head;
-      gold_deprels[i - 1] = AlphabetCollection::get()->deprel_map.get(
-        inst.parse_units[i].deprel);
-    }
-    engine.predict(words, postags, pred_heads, pred_deprels);
-    for (unsigned i = 0; i < pred_heads.size(); ++i) {
-      if (gold_heads[i] == pred_heads[i] &&
-          gold_deprels[i] == pred_deprels[i]) {
-        n_recall += 1.;
+  std::vector<float> totals(2);
+  parallel_evaluate(corpus.n_devel, totals,
+                    [&](unsigned begin, unsigned end, std::vector<float> & counts) {
+    std::vector<std::vector<std::string>> words, postags, gold_deprels;
+    std::vector<std::vector<unsigned>> gold_heads;
+    std::vector<std::vector<std::string>> pred_deprels;
+    std::vector<std::vector<unsigned>> pred_heads;
+    for (unsigned start = begin; start < end; start += eval_batch_size) {
+      unsigned n = std::min(start + eval_batch_size, end) - start;
+      words.resize(n); postags.resize(n);
+      gold_heads.resize(n); gold_deprels.resize(n);
+      for (unsigned k = 0; k < n; ++k) {
+        const Instance & inst = corpus.devel_data.at(start + k);
+
+        unsigned len = inst.input_units.size();
+        words[k].resize(len - 1); postags[k].resize(len - 1);
+        gold_heads[k].resize(len - 1); gold_deprels[k].resize(len - 1);
+        for (unsigned i = 1; i < inst.input_units.size(); ++i) {
+          words[k][i - 1] = inst.input_units.word(i);
+          postags[k][i - 1] = inst.input_units.postag(i);
+          gold_heads[k][i - 1] = inst.parse_units[i].head;
+          gold_deprels[k][i - 1] = AlphabetCollection::get()->deprel_map.get(
+            inst.parse_units[i].deprel);
+        }
+      }
+      engine.predict_batch(words, postags, pred_heads, pred_deprels);
+      for (unsigned k = 0; k < n; ++k) {
+        for (unsigned i = 0; i < pred_heads[k].size(); ++i) {
+          if (gold_heads[k][i] == pred_heads[k][i] &&
+              gold_deprels[k][i] == pred_deprels[k][i]) {
+            counts[0] += 1.;
+          }
+          counts[1] += 1.;
+        }
       }
-      n_total += 1.;
     }
-  }
-  float las = n_recall / n_total;
+  });
+  float las = totals[0] / totals[1];
   return las;
 }
 
@@ -120,61 +140,85 @@ void SupervisedTrainer::train(Corpus& corpus) {
   float best_las = -1.f;
   unsigned n_processed = 0;
 
+  // the oracle actions are computed once, static-oracle epochs only read them.
+  OracleCache oracle;
+  oracle.load_or_build(corpus, engine.sys);
+
   std::vector<unsigned> order;
-  get_orders(corpus, order, allow_nonprojective);
+  get_orders(oracle, order, allow_nonprojective);
+
+  std::vector<unsigned> lengths(corpus.training_data.size());
+  for (unsigned i = 0; i < corpus.training_data.size(); ++i) {
+    lengths[i] = corpus.training_data[i].input_units.size();
+  }
+  std::vector<std::vector<unsigned>> batches;
 
   // bool use_beam_search = (beam_size > 1);
   _INFO << "[parse|train] will stop after " << max_iter << " iterations.";
+  _INFO << "[parse|train] batch size = " << batch_size;
+
+  HogwildRunner hogwild(n_workers, engine.model);
+  AllReduceRunner allreduce(n_sync_workers, engine.model);
+  unsigned iter = 0;
+  auto step = [&](const std::vector<unsigned> & batch) -> float {
+    // the units stay noisified until the backward pass of the batch is done.
+    for (unsigned sid : batch) { noisifier.noisify(corpus.training_data[sid].input_units); }
+    float l = train_batch(corpus, oracle, batch, iter);
+    for (unsigned sid : batch) { noisifier.denoisify(corpus.training_data[sid].input_units); }
+    return l;
+  };
   
-  for (unsigned iter = 1; iter <= max_iter; ++iter) {
+  for (iter = 1; iter <= max_iter; ++iter) {
     llh = 0;
     _INFO << "[parse|train] start training iteration #" << iter << ", shuffled.";
     std::shuffle(order.begin(), order.end(), (*dynet::rndeng));
+    get_batches(order, lengths, batches);
 
-    for (unsigned sid : order) {
-      InputUnits& input_units = corpus.training_data[sid].input_units;
-      const ParseUnits& parse_units = corpus.training_data[sid].parse_units;
-
-      noisifier.noisify(input_units);
-      float lp;
-      if (objective_type == kStructure) {
-        lp = train_structure_full_tree(input_units, parse_units, trainer, beam_size);
-      } else {
-        lp = train_full_tree(input_units, parse_units, trainer, iter);
-      }
-      llh += lp;
-      noisifier.denoisify(input_units);
-      
-      n_processed++;
-      if (need_evaluate(iter, n_processed)) {
-        float las = evaluate(corpus);
-        float prop = static_cast<float>(n_processed) / order.size();
-        if (las > best_las) {
-          _INFO << "[parse|train] " << prop << "% trained, LAS on heldout = " << las
-            << ", new best achieved, saved.";
-          best_las = las;
-          Model::get()->to_json(Model::kParserName, engine.model);
-        } else {
-          _INFO << "[parse|train] " << prop << "% trained, LAS on heldout = " << las;
+    if (hogwild.enabled() || allreduce.enabled()) {
+      // the workers run the whole epoch, it's evaluated at the end.
+      llh = (hogwild.enabled() ? hogwild.run(batches, step, *trainer) : allreduce.run(batches, step, *trainer));
+      n_processed += order.size();
+      TrainingTelemetry::get()->count(iter, order.size());
+    } else {
+      for (const std::vector<unsigned> & batch : batches) {
+        llh += step(batch);
+        {
+          TelemetryTimer timer(TrainingTelemetry::kUpdate);
+          trainer->update();
+        }
+        n_processed += batch.size();
+        TrainingTelemetry::get()->count(iter, batch.size());
+        if (need_evaluate(iter, n_processed, batch.size())) {
+          float las = evaluate(corpus);
+          float prop = static_cast<float>(n_processed) / order.size();
+          if (check_best(las, best_las)) {
+            _INFO << "[parse|train] " << prop << "% trained, LAS on heldout = " << las
+              << ", new best achieved, saved.";
+            best_las = las;
+            Checkpointer::get()->save(Model::kParserName, engine.model);
+          } else {
+            _INFO << "[parse|train] " << prop << "% trained, LAS on heldout = " << las;
+          }
         }
       }
     }
-    
+    TrainingTelemetry::get()->end_iter(iter);
     _INFO << "[parse|train] end of iter #" << iter << " loss " << llh;
     if (need_evaluate(iter)) {
       float las = evaluate(corpus);
-      if (las > best_las) {
+      if (check_best(las, best_las)) {
         best_las = las;
         _INFO << "[parse|train] end of iter #" << iter << ", LAS on heldout = " << las
           << ", new best achieved, saved.";
-        Model::get()->to_json(Model::kParserName, engine.model);
+        Checkpointer::get()->save(Model::kParserName, engine.model);
       } else {
         _INFO << "[parse|train] end of iter #" << iter << ", LAS on heldout = " << las;
       }
     }
-    opt_builder.update(trainer, iter);
+    if (finish_iter(iter, opt_builder, trainer)) { break; }
   }
 
+  Checkpointer::get()->wait();
   delete trainer;
 }
 
@@ -205,20 +249,59 @@ void SupervisedTrainer::add_loss_one_step(dynet::Expression & score_expr,
   }
 }
 
-float SupervisedTrainer::train_full_tree(const InputUnits& input_units,
-                                         const ParseUnits& parse_units,
-                                         dynet::Trainer* trainer,
-                                         unsigned iter) {
+float SupervisedTrainer::train_batch(Corpus & corpus,
+                                     const OracleCache & oracle,
+                                     const std::vector<unsigned> & batch,
+                                     unsigned iter) {
+  TelemetryTimer build_timer(TrainingTelemetry::kBuild);
+  dynet::ComputationGraph cg;
+  engine.new_graph(cg);
+
+  std::vector<dynet::Expression> loss;
+  unsigned n_units = 0;
+  for (unsigned sid : batch) {
+    const Instance & inst = corpus.training_data[sid];
+    if (objective_type == kStructure) {
+      loss.push_back(get_structure_full_tree_loss(cg, inst.input_units, oracle.actions[sid], beam_size));
+    } else {
+      get_full_tree_loss(cg, inst.input_units, inst.parse_units, oracle.actions[sid], iter, loss);
+    }
+    n_units += inst.input_units.size();
+  }
+
+  float ret = 0.f;
+  if (!loss.empty()) {
+    dynet::Expression l = dynet::sum(loss);
+    if (objective_type != kStructure) {
+      l = l + (0.5f * lambda_ * loss.size()) * engine.l2();
+    }
+    // with the scores needed, the losses are forwarded while being built.
+    build_timer.stop();
+    TrainingTelemetry::get()->add_graph(n_units, cg.nodes.size());
+
+    TelemetryTimer forward_timer(TrainingTelemetry::kForward);
+    ret = dynet::as_scalar(cg.forward(l));
+    forward_timer.stop();
+    TelemetryTimer backward_timer(TrainingTelemetry::kBackward);
+    cg.backward(l);
+  }
+  return ret;
+}
+
+void SupervisedTrainer::get_full_tree_loss(dynet::ComputationGraph & cg,
+                                           const InputUnits& input_units,
+                                           const ParseUnits& parse_units,
+                                           const std::vector<unsigned>& gold_actions,
+                                           unsigned iter,
+                                           std::vector<dynet::Expression> & loss) {
   TransitionSystem & sys = engine.sys;
 
   std::vector<unsigned> ref_heads, ref_deprels;
   Corpus::parse_units_to_vector(parse_units, ref_heads, ref_deprels);
 
-  dynet::ComputationGraph cg;
-  engine.new_graph(cg);
-  std::vector<dynet::Expression> loss;
-  std::vector<unsigned> gold_actions;
-  sys.get_oracle_actions(ref_heads, ref_deprels, gold_actions);
+  // the static cross entropy doesn't look at the scores, so the graph is not
+  // forwarded step by step and can be autobatched.
+  bool need_scores = (oracle_type == kDynamic || objective_type != kCrossEntropy);
 
   unsigned len = input_units.size();
   State state(len);
@@ -226,13 +309,15 @@ float SupervisedTrainer::train_full_tree(const InputUnits& input_units,
   engine.initialize(cg, input_units, state, checkpoint);
   unsigned illegal_action = sys.num_actions();
   unsigned n_actions = 0;
+  std::vector<unsigned> valid_actions;
+  std::vector<float> costs;
   while (!state.terminated()) {
     // collect all valid actions.
-    std::vector<unsigned> valid_actions;
     sys.get_valid_actions(state, valid_actions);
 
     dynet::Expression score_exprs = engine.get_scores(checkpoint);
-    std::vector<float> scores = dynet::as_vector(cg.get_value(score_exprs));
+    std::vector<float> scores;
+    if (need_scores) { scores = dynet::as_vector(cg.get_value(score_exprs)); }
     unsigned action = 0;
 
     unsigned best_gold_action = illegal_action;
@@ -242,7 +327,7 @@ float SupervisedTrainer::train_full_tree(const InputUnits& input_units,
     if (oracle_type == kDynamic) {
       auto payload = ParseModel::get_best_action(scores, valid_actions);
       action = payload.first;
-      std::vector<float> costs; // the larger, the better
+      // the larger, the better
       sys.get_transition_costs(state, valid_actions, ref_heads, ref_deprels, costs);
       float gold_action_cost = (*std::max_element(costs.begin(), costs.end()));
       float action_cost = 0.f;
@@ -288,50 +373,40 @@ float SupervisedTrainer::train_full_tree(const InputUnits& input_units,
     n_actions++;
   }
   engine.destropy_checkpoint(checkpoint);
-  float ret = 0.f;
-  if (!loss.empty()) {
-    dynet::Expression l = dynet::sum(loss) + (0.5f * lambda_ * loss.size()) * engine.l2();
-    ret = dynet::as_scalar(cg.forward(l));
-    cg.backward(l);
-    trainer->update();
-  }
-  return ret;
 }
 
-float SupervisedTrainer::train_structure_full_tree(const InputUnits & input_units,
-                                                   const ParseUnits & parse_units,
-                                                   dynet::Trainer * trainer,
-                                                   unsigned beam_size) {
+dynet::Expression SupervisedTrainer::get_structure_full_tree_loss(dynet::ComputationGraph & cg,
+                                                                  const InputUnits & input_units,
+                                                                  const std::vector<unsigned> & gold_actions,
+                                                                  unsigned beam_size) {
   typedef std::tuple<unsigned, unsigned, float, dynet::Expression> Transition;
   TransitionSystem & sys = engine.sys;
 
-  dynet::ComputationGraph cg;
-  engine.new_graph(cg);
-
-  std::vector<unsigned> gold_heads, gold_deprels, gold_actions;
-  Corpus::parse_units_to_vector(parse_units, gold_heads, gold_deprels);
-  sys.get_oracle_actions(gold_heads, gold_deprels, gold_actions);
-
   unsigned len = input_units.size();
-  std::vector<State> states;
-  std::vector<float> scores;
-  std::vector<dynet::Expression> scores_exprs;
-  std::vector<ParseModel::StateCheckpoint *> checkpoints;
-
-  states.push_back(State(len));
+  // only the current beam is kept alive, the hypotheses that fall out of
+  // the beam are released at each step and their blocks are reused.
+  StateArena arena(len);
+  std::vector<State> states, next_states;
+  std::vector<float> scores, next_scores;
+  std::vector<dynet::Expression> scores_exprs, next_scores_exprs;
+  std::vector<ParseModel::StateCheckpoint *> checkpoints, next_checkpoints;
+
+  states.push_back(State(len, arena));
   scores.push_back(0.);
   scores_exprs.push_back(dynet::zeroes(cg, { 1 }));
   checkpoints.push_back(engine.get_initial_checkpoint());
   engine.initialize(cg, input_units, states[0], checkpoints[0]);
 
-  unsigned curr = 0, next = 1, corr = 0;
+  unsigned corr = 0;
   unsigned n_step = 0;
+  std::vector<Transition> transitions;
+  std::vector<unsigned> valid_actions;
   while (!states[corr].terminated()) {
     unsigned gold_action = gold_actions[n_step];
     n_step++;
 
-    std::vector<Transition> transitions;
-    for (unsigned i = curr; i < next; ++i) {
+    transitions.clear();
+    for (unsigned i = 0; i < states.size(); ++i) {
       const State& prev_state = states[i];
       float prev_score = scores[i];
       dynet::Expression prev_score_expr = scores_exprs[i];
@@ -342,7 +417,6 @@ float SupervisedTrainer::train_structure_full_tree(const InputUnits & input_unit
         ));
       } else {
         ParseModel::StateCheckpoint * checkpoint = checkpoints[i];
-        std::vector<unsigned> valid_actions;
         sys.get_valid_actions(prev_state, valid_actions);
 
         dynet::Expression transit_scores_expr = engine.get_scores(checkpoint);
@@ -356,74 +430,81 @@ float SupervisedTrainer::train_structure_full_tree(const InputUnits & input_unit
       }
     }
 
-    sort(transitions.begin(), transitions.end(),
-         [](const Transition& a, const Transition& b) { return std::get<2>(a) > std::get<2>(b); });
+    auto greater = [](const Transition& a, const Transition& b) { return std::get<2>(a) > std::get<2>(b); };
+    unsigned n_kept = std::min<unsigned>(beam_size, transitions.size());
+    if (n_kept < transitions.size()) {
+      std::nth_element(transitions.begin(), transitions.begin() + n_kept, transitions.end(), greater);
+    }
+    std::sort(transitions.begin(), transitions.begin() + n_kept, greater);
 
-    unsigned new_corr = UINT_MAX, new_curr = next, new_next = next;
-    for (unsigned i = 0; i < transitions.size() && i < beam_size; ++i) {
+    unsigned new_corr = UINT_MAX;
+    for (unsigned i = 0; i < n_kept; ++i) {
       unsigned cursor = std::get<0>(transitions[i]);
       unsigned action = std::get<1>(transitions[i]);
-      float new_score = std::get<2>(transitions[i]);
-      dynet::Expression new_score_expr = std::get<3>(transitions[i]);
-      State& state = states[cursor];
+      if (cursor == corr && action == gold_action) { new_corr = i; break; }
+    }
+    if (new_corr == UINT_MAX) {
+      // early stopping, the update is performed on the current beam.
+      break;
+    }
 
-      State new_state(state);
+    next_states.clear();
+    next_scores.clear();
+    next_scores_exprs.clear();
+    next_checkpoints.clear();
+    for (unsigned i = 0; i < n_kept; ++i) {
+      unsigned cursor = std::get<0>(transitions[i]);
+      unsigned action = std::get<1>(transitions[i]);
+
+      next_states.push_back(states[cursor]);
       ParseModel::StateCheckpoint * new_checkpoint = engine.copy_checkpoint(checkpoints[cursor]);
       if (action != sys.num_actions()) {
-        sys.perform_action(new_state, action);
-        engine.perform_action(action, new_state, cg, new_checkpoint);
+        sys.perform_action(next_states.back(), action);
+        engine.perform_action(action, next_states.back(), cg, new_checkpoint);
       }
-
-      //      
-      states.push_back(new_state);
-      scores.push_back(new_score);
-      scores_exprs.push_back(new_score_expr);
-      checkpoints.push_back(new_checkpoint);
-
-      if (cursor == corr && action == gold_action) { new_corr = new_next; }
-      new_next++;
+      next_scores.push_back(std::get<2>(transitions[i]));
+      next_scores_exprs.push_back(std::get<3>(transitions[i]));
+      next_checkpoints.push_back(new_checkpoint);
     }
-    if (new_corr == UINT_MAX) {
-      // early stopping
-      break;
-    } else {
-      corr = new_corr;
-      curr = new_curr;
-      next = new_next;
+    for (ParseModel::StateCheckpoint * checkpoint : checkpoints) {
+      engine.destropy_checkpoint(checkpoint);
     }
+    states.swap(next_states);
+    scores.swap(next_scores);
+    scores_exprs.swap(next_scores_exprs);
+    checkpoints.swap(next_checkpoints);
+    corr = new_corr;
   }
 
   for (ParseModel::StateCheckpoint * checkpoint : checkpoints) {
     engine.destropy_checkpoint(checkpoint);
   }
 
-  std::vector<dynet::Expression> loss;
-  for (unsigned i = curr; i < next; ++i) {
-    loss.push_back(scores_exprs[i]);
-  }
-  dynet::Expression l = dynet::pickneglogsoftmax(dynet::concatenate(loss), corr - curr);
-  float ret = dynet::as_scalar(cg.forward(l));
-  cg.backward(l);
-  trainer->update();
-  return ret;
+  return dynet::pickneglogsoftmax(dynet::concatenate(scores_exprs), corr);
 }
 
-void SupervisedTrainer::get_orders(Corpus& corpus,
+void SupervisedTrainer::get_orders(const OracleCache& oracle,
                                    std::vector<unsigned>& order,
                                    bool non_projective) {
   order.clear();
-  for (unsigned i = 0; i < corpus.training_data.size(); ++i) {
-    const ParseUnits& parse_units = corpus.training_data[i].parse_units;
-    if (!DependencyUtils::is_tree(parse_units)) {
-      _INFO << "[parse|train|get_orders] #" << i << " not a tree, skipped.";
+  unsigned n_not_tree = 0, n_not_projective = 0;
+  for (unsigned i = 0; i < oracle.actions.size(); ++i) {
+    if (!oracle.is_tree[i]) {
+      _TRACE << "[parse|train|get_orders] #" << i << " not a tree, skipped.";
+      n_not_tree++;
       continue;
     }
-    if (!non_projective && !DependencyUtils::is_projective(parse_units)) {
-      _INFO << "[parse|train|get_orders] #" << i << " not projective, skipped.";
+    if (!non_projective && !oracle.is_projective[i]) {
+      _TRACE << "[parse|train|get_orders] #" << i << " not projective, skipped.";
+      n_not_projective++;
       continue;
     }
     order.push_back(i);
   }
+  if (n_not_tree > 0 || n_not_projective > 0) {
+    _INFO << "[parse|train|get_orders] skipped " << n_not_tree << " non-tree and "
+      << n_not_projective << " non-projective sentences.";
+  }
 }
 
 SupervisedEnsembleTrainer::SupervisedEnsembleTrainer(ParseModel & engine,
@@ -441,7 +522,7 @@ po::options_description SupervisedEnsembleTrainer::get_options() {
 }
 
 void SupervisedEnsembleTrainer::train(Corpus & corpus,
-                                      EnsembleInstances & ensemble_instances) {
+                                      const EnsembleDataset & ensemble_data) {
   _INFO << "[parse|ensemble|train] start lstm-parser supervised training.";
   Noisifier noisifier(corpus, noisify_method_name, singleton_dropout_prob);
 
@@ -449,72 +530,102 @@ void SupervisedEnsembleTrainer::train(Corpus & corpus,
   dynet::Trainer * trainer = opt_builder.build(model);
 
   std::vector<unsigned> order;
+  std::vector<unsigned> lengths(ensemble_data.size(), 0);
   // bool allow_nonprojective = engine.sys.allow_nonprojective();
-  for (unsigned i = 0; i < ensemble_instances.size(); ++i) {
-    unsigned id = ensemble_instances[i].id;
-    if (corpus.training_data.count(id) == 0) { continue; }
+  for (unsigned i = 0; i < ensemble_data.size(); ++i) {
+    unsigned id = ensemble_data.id(i);
+    if (id >= corpus.training_data.size()) { continue; }
     order.push_back(i);
+    lengths[i] = corpus.training_data[id].input_units.size();
   }
 
+  EnsembleInstance inst;
   float llh = 0.f;
   float best_las = -1.f;
   unsigned n_processed = 0;
+  std::vector<std::vector<unsigned>> batches;
+  std::vector<unsigned> sids;
 
   _INFO << "[parse|ensemble|train] will stop after " << max_iter << " iterations.";
   for (unsigned iter = 1; iter <= max_iter; ++iter) {
     llh = 0.f;
     std::shuffle(order.begin(), order.end(), (*dynet::rndeng));
-
-    for (unsigned id : order) {
-      const EnsembleInstance & inst = ensemble_instances.at(id);
-      unsigned sid = inst.id;
-      InputUnits & units = corpus.training_data.at(sid).input_units;
-
-      noisifier.noisify(units);
-      float lp = train_full_tree(units, inst, trainer);
-      llh += lp;
-      noisifier.denoisify(units);
+    get_batches(order, lengths, batches);
+
+    for (const std::vector<unsigned> & batch : batches) {
+      {
+        TelemetryTimer build_timer(TrainingTelemetry::kBuild);
+        dynet::ComputationGraph cg;
+        engine.new_graph(cg);
+
+        std::vector<dynet::Expression> loss;
+        unsigned n_units = 0;
+        sids.clear();
+        for (unsigned id : batch) {
+          ensemble_data.get(id, inst);
+          sids.push_back(inst.id);
+          InputUnits & units = corpus.training_data.at(inst.id).input_units;
+          noisifier.noisify(units);
+          get_full_tree_loss(cg, units, inst, loss);
+          n_units += units.size();
+        }
+        if (!loss.empty()) {
+          dynet::Expression l = -dynet::sum(loss) + (0.5f * lambda_ * loss.size()) * engine.l2();
+          build_timer.stop();
+          TrainingTelemetry::get()->add_graph(n_units, cg.nodes.size());
+
+          TelemetryTimer forward_timer(TrainingTelemetry::kForward);
+          llh += dynet::as_scalar(cg.forward(l));
+          forward_timer.stop();
+          TelemetryTimer backward_timer(TrainingTelemetry::kBackward);
+          cg.backward(l);
+          backward_timer.stop();
+          TelemetryTimer update_timer(TrainingTelemetry::kUpdate);
+          trainer->update();
+        }
+        for (unsigned sid : sids) { noisifier.denoisify(corpus.training_data.at(sid).input_units); }
+      }
     
-      n_processed++;
-      if (need_evaluate(iter, n_processed)) {
+      n_processed += batch.size();
+      TrainingTelemetry::get()->count(iter, batch.size());
+      if (need_evaluate(iter, n_processed, batch.size())) {
         float las = evaluate(corpus);
         float prop = static_cast<float>(n_processed) / order.size();
-        if (las > best_las) {
+        if (check_best(las, best_las)) {
           _INFO << "[parse|train] " << prop << "% trained, LAS on heldout = " << las
             << ", new best achieved, saved.";
           best_las = las;
-          Model::get()->to_json(Model::kParserName, engine.model);
+          Checkpointer::get()->save(Model::kParserName, engine.model);
         } else {
           _INFO << "[parse|train] " << prop << "% trained, LAS on heldout = " << las;
         }
       }
     }
 
+    TrainingTelemetry::get()->end_iter(iter);
     _INFO << "[parse|ensemble|train] end of iter #" << iter << ", loss = " << llh;
     if (need_evaluate(iter)) {
       float las = evaluate(corpus);
-      if (las > best_las) {
+      if (check_best(las, best_las)) {
         best_las = las;
         _INFO << "[parse|train] end of iter #" << iter << ", LAS on heldout = " << las
           << ", new best achieved, saved.";
-        Model::get()->to_json(Model::kParserName, engine.model);
+        Checkpointer::get()->save(Model::kParserName, engine.model);
       } else {
         _INFO << "[parse|train] end of iter #" << iter << ", LAS on heldout = " << las;
       }
     }
-    opt_builder.update(trainer, iter);
+    if (finish_iter(iter, opt_builder, trainer)) { break; }
   }
+  Checkpointer::get()->wait();
 }
 
-float SupervisedEnsembleTrainer::train_full_tree(const InputUnits & input_units,
-                                                 const EnsembleInstance & ensemble_instance,
-                                                 dynet::Trainer * trainer) {
+void SupervisedEnsembleTrainer::get_full_tree_loss(dynet::ComputationGraph & cg,
+                                                   const InputUnits & input_units,
+                                                   const EnsembleInstance & ensemble_instance,
+                                                   std::vector<dynet::Expression> & loss) {
   TransitionSystem & sys = engine.sys;
 
-  dynet::ComputationGraph cg;
-  engine.new_graph(cg);
-
-  std::vector<dynet::Expression> loss;
   unsigned len = input_units.size();
   State state(len);
 
@@ -526,9 +637,6 @@ float SupervisedEnsembleTrainer::train_full_tree(const InputUnits & input_units,
 
   unsigned n_actions = 0;
   while (!state.terminated()) {
-    std::vector<unsigned> valid_actions;
-    sys.get_valid_actions(state, valid_actions);
-
     dynet::Expression score_expr = engine.get_scores(checkpoint);
     unsigned action = actions[n_actions];
     const std::vector<float> & prob = probs[n_actions];
@@ -545,14 +653,6 @@ float SupervisedEnsembleTrainer::train_full_tree(const InputUnits & input_units,
   }
 
   engine.destropy_checkpoint(checkpoint);
-  float ret = 0.f;
-  if (!loss.empty()) {
-    dynet::Expression l = -dynet::sum(loss) + (0.5f * lambda_ * loss.size()) * engine.l2();
-    ret = dynet::as_scalar(cg.forward(l));
-    cg.backward(l);
-    trainer->update();
-  }
-  return ret;
 }
 
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "dynet/training.h"
 #include "parse_model.h"
 #include "noisify.h"
+#include "oracle_cache.h"
 #include "twpipe/trainer.h"
 #include "twpipe/optimizer_builder.h"
 #include "twpipe/ensemble.h"
@@ -20,6 +21,7 @@ struct ParserTrainer : public Trainer {
   OptimizerBuilder & opt_builder;
   std::string noisify_method_name;
   float singleton_dropout_prob;
+  unsigned eval_batch_size;
 
   ParserTrainer(ParseModel & engine,
                 OptimizerBuilder & opt_builder,
@@ -49,15 +51,24 @@ struct SupervisedTrainer : public ParserTrainer {
   /* Code for supervised pretraining. */
   void train(Corpus& corpus);
 
-  float train_full_tree(const InputUnits& input_units,
-                        const ParseUnits& parse_units,
-                        dynet::Trainer* trainer,
-                        unsigned iter);
-
-  float train_structure_full_tree(const InputUnits & input_units,
-                                  const ParseUnits & parse_units,
-                                  dynet::Trainer * trainer,
-                                  unsigned beam_size);
+  /// Build the losses of the sentences in one graph and backpropagate, return
+  /// the loss. The caller updates the parameters.
+  float train_batch(Corpus & corpus,
+                    const OracleCache & oracle,
+                    const std::vector<unsigned> & batch,
+                    unsigned iter);
+
+  void get_full_tree_loss(dynet::ComputationGraph & cg,
+                          const InputUnits& input_units,
+                          const ParseUnits& parse_units,
+                          const std::vector<unsigned>& gold_actions,
+                          unsigned iter,
+                          std::vector<dynet::Expression> & loss);
+
+  dynet::Expression get_structure_full_tree_loss(dynet::ComputationGraph & cg,
+                                                 const InputUnits & input_units,
+                                                 const std::vector<unsigned> & gold_actions,
+                                                 unsigned beam_size);
 
   void add_loss_one_step(dynet::Expression & score_expr,
                          const unsigned & best_gold_action,
@@ -65,7 +76,7 @@ struct SupervisedTrainer : public ParserTrainer {
                          const unsigned & best_non_gold_action,
                          std::vector<dynet::Expression> & loss);
 
-  void get_orders(Corpus& corpus,
+  void get_orders(const OracleCache& oracle,
                   std::vector<unsigned>& order,
                   bool non_projective);
 };
@@ -77,11 +88,12 @@ struct SupervisedEnsembleTrainer : public ParserTrainer {
 
   static po::options_description get_options();
  
-  void train(Corpus & corpus, EnsembleInstances & ensemble_instances);
+  void train(Corpus & corpus, const EnsembleDataset & ensemble_data);
 
-  float train_full_tree(const InputUnits & input_units,
-                        const EnsembleInstance & ensemble_instance,
-                        dynet::Trainer * trainer);
+  void get_full_tree_loss(dynet::ComputationGraph & cg,
+                          const InputUnits & input_units,
+                          const EnsembleInstance & ensemble_instance,
+                          std::vector<dynet::Expression> & loss);
 };
 
 
@@ -2,6 +2,7 @@
 #include <fstream>
 #include "dynet/dynet.h"
 #include "twpipe/logging.h"
+#include "twpipe/input_reader.h"
 #include "twpipe/embedding.h"
 #include "twpipe/model.h"
 #include "twpipe/alphabet_collection.h"
@@ -102,7 +103,8 @@ int main(int argc, char* argv[]) {
     exit(1);
   }
 
-  std::string buffer;
+  twpipe::StringPiece buffer;
+  std::vector<twpipe::StringPiece> data;
   std::vector<std::string> tokens;
   std::vector<std::string> postags;
   std::vector<unsigned> heads;
@@ -112,11 +114,14 @@ int main(int argc, char* argv[]) {
   deprels.push_back(twpipe::Corpus::BAD0);
   std::vector<unsigned> actions;
 
-  std::ifstream ifs(conf["input-file"].as<std::string>());
+  twpipe::InputReader reader;
+  if (!reader.open(conf["input-file"].as<std::string>())) {
+    _ERROR << "[twpipe|parse|sampler] failed to open " << conf["input-file"].as<std::string>();
+    exit(1);
+  }
 
   unsigned sid = 0;
-  while (std::getline(ifs, buffer)) {
-    boost::algorithm::trim(buffer);
+  while (reader.next_line(buffer)) {
     if (buffer.empty()) {
       sampler->sample(tokens, postags, heads, deprels, actions);
 
@@ -137,17 +142,21 @@ int main(int argc, char* argv[]) {
     } else if (buffer[0] == '#') {
       continue;
     } else {
-      buffers.push_back(buffer);
-      std::vector<std::string> data;
-      boost::algorithm::split(data, buffer, boost::is_any_of("\t "));
-      tokens.push_back(data[1]);
-      postags.push_back(data[3]);
+      buffers.push_back(buffer.str());
+      twpipe::InputReader::split_fields(buffer, data);
+      tokens.push_back(data[1].str());
+      postags.push_back(data[3].str());
       if (data[6] == "_") {
         heads.push_back(twpipe::Corpus::BAD_HED);
         deprels.emplace_back(twpipe::Corpus::BAD0);
       } else {
-        heads.push_back(boost::lexical_cast<unsigned>(data[6]));
-        deprels.push_back(data[7]);
+        unsigned head;
+        if (!data[6].to_unsigned(head)) {
+          _ERROR << "[twpipe|parse|sampler] malformed head \"" << data[6] << "\" in sentence " << sid;
+          exit(1);
+        }
+        heads.push_back(head);
+        deprels.push_back(data[7].str());
       }
     }
   }
@@ -0,0 +1,49 @@
+#include "stack_lstm_checkpoint.h"
+
+namespace twpipe {
+
+StackLSTMCheckpoint * StackLSTMCheckpointPool::get() {
+  if (free_checkpoints.empty()) { return new StackLSTMCheckpoint(); }
+  StackLSTMCheckpoint * checkpoint = free_checkpoints.back().release();
+  free_checkpoints.pop_back();
+  return checkpoint;
+}
+
+StackLSTMCheckpoint * StackLSTMCheckpointPool::copy(const StackLSTMCheckpoint & checkpoint) {
+  StackLSTMCheckpoint * new_checkpoint = get();
+  new_checkpoint->s_pointer = checkpoint.s_pointer;
+  new_checkpoint->q_pointer = checkpoint.q_pointer;
+  new_checkpoint->a_pointer = checkpoint.a_pointer;
+  new_checkpoint->stack = checkpoint.stack;
+  new_checkpoint->buffer = checkpoint.buffer;
+  return new_checkpoint;
+}
+
+void StackLSTMCheckpointPool::release(StackLSTMCheckpoint * checkpoint) {
+  checkpoint->stack.clear();
+  checkpoint->buffer.clear();
+  free_checkpoints.emplace_back(checkpoint);
+}
+
+dynet::Expression stack_lstm_batch_scores(const std::vector<ParseModel::StateCheckpoint *> & checkpoints,
+                                          ParseModel::LSTMBuilderType & s_lstm,
+                                          ParseModel::LSTMBuilderType & q_lstm,
+                                          ParseModel::LSTMBuilderType & a_lstm,
+                                          Merge3Layer & merge,
+                                          DenseLayer & scorer) {
+  unsigned n = checkpoints.size();
+  std::vector<dynet::Expression> s_h(n), q_h(n), a_h(n);
+  for (unsigned i = 0; i < n; ++i) {
+    auto * cp = dynamic_cast<StackLSTMCheckpoint *>(checkpoints[i]);
+    s_h[i] = s_lstm.get_h(cp->s_pointer).back();
+    q_h[i] = q_lstm.get_h(cp->q_pointer).back();
+    a_h[i] = a_lstm.get_h(cp->a_pointer).back();
+  }
+  return scorer.get_output(dynet::rectify(merge.get_output(
+    dynet::concatenate_cols(s_h),
+    dynet::concatenate_cols(q_h),
+    dynet::concatenate_cols(a_h))
+  ));
+}
+
+}
@@ -0,0 +1,46 @@
+#ifndef __TWPIPE_PARSER_STACK_LSTM_CHECKPOINT_H__
+#define __TWPIPE_PARSER_STACK_LSTM_CHECKPOINT_H__
+
+#include "parse_model.h"
+#include "expression_stack.h"
+#include "dynet_layer/layer.h"
+#include <vector>
+#include <memory>
+
+namespace twpipe {
+
+/// The state of the stack-LSTM parsers (dyer15 and ballesteros15): the
+/// pointers into the stack, buffer and action LSTMs and the composed stacks.
+struct StackLSTMCheckpoint : public ParseModel::StateCheckpoint {
+  ~StackLSTMCheckpoint() {}
+
+  dynet::RNNPointer s_pointer;
+  dynet::RNNPointer q_pointer;
+  dynet::RNNPointer a_pointer;
+  ExpressionStack stack;
+  ExpressionStack buffer;
+};
+
+/// The destroyed checkpoints are kept for reuse and freed with the pool.
+struct StackLSTMCheckpointPool {
+  std::vector<std::unique_ptr<StackLSTMCheckpoint>> free_checkpoints;
+
+  StackLSTMCheckpoint * get();
+
+  StackLSTMCheckpoint * copy(const StackLSTMCheckpoint & checkpoint);
+
+  void release(StackLSTMCheckpoint * checkpoint);
+};
+
+/// The un-softmaxed scores of the checkpoints in one expression, one column
+/// per checkpoint, the bias in the layers is broadcasted over columns.
+dynet::Expression stack_lstm_batch_scores(const std::vector<ParseModel::StateCheckpoint *> & checkpoints,
+                                          ParseModel::LSTMBuilderType & s_lstm,
+                                          ParseModel::LSTMBuilderType & q_lstm,
+                                          ParseModel::LSTMBuilderType & a_lstm,
+                                          Merge3Layer & merge,
+                                          DenseLayer & scorer);
+
+}
+
+#endif  //  end for __TWPIPE_PARSER_STACK_LSTM_CHECKPOINT_H__
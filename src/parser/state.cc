@@ -1,10 +1,111 @@
 #include "state.h"
-#include "twpipe/corpus.h"
+#include <cstring>
+#include <algorithm>
 #include <boost/assert.hpp>
 
 namespace twpipe {
 
-State::State(unsigned n) : heads(n, Corpus::BAD_HED), deprels(n, Corpus::BAD_DEL) {
+void FixedVector::push_back(unsigned x) {
+  BOOST_ASSERT_MSG(n < capacity, "the state is full");
+  items[n++] = x;
+}
+
+void FixedVector::resize(unsigned m) {
+  BOOST_ASSERT_MSG(m <= capacity, "the state is full");
+  if (m > n) { std::fill(items + n, items + m, 0); }
+  n = m;
+}
+
+StateArena::StateArena(unsigned n) : block_size(4 * n + 2) {
+}
+
+unsigned * StateArena::acquire() {
+  if (free_blocks.empty()) {
+    blocks.emplace_back(new unsigned[block_size]);
+    return blocks.back().get();
+  }
+  unsigned * block = free_blocks.back();
+  free_blocks.pop_back();
+  return block;
+}
+
+void StateArena::release(unsigned * block) {
+  free_blocks.push_back(block);
+}
+
+void State::allocate(unsigned n) {
+  memory = (arena != nullptr ? arena->acquire() : new unsigned[4 * n + 2]);
+  // one guard plus all the words for the stack and the buffer.
+  stack.items = memory;
+  stack.capacity = n + 1;
+  buffer.items = stack.items + stack.capacity;
+  buffer.capacity = n + 1;
+  heads.items = buffer.items + buffer.capacity;
+  heads.capacity = n;
+  deprels.items = heads.items + heads.capacity;
+  deprels.capacity = n;
+}
+
+void State::copy_from(const State & other) {
+  std::memcpy(stack.items, other.stack.items, other.stack.n * sizeof(unsigned));
+  std::memcpy(buffer.items, other.buffer.items, other.buffer.n * sizeof(unsigned));
+  std::memcpy(heads.items, other.heads.items, other.heads.n * sizeof(unsigned));
+  std::memcpy(deprels.items, other.deprels.items, other.deprels.n * sizeof(unsigned));
+  stack.n = other.stack.n;
+  buffer.n = other.buffer.n;
+  heads.n = other.heads.n;
+  deprels.n = other.deprels.n;
+}
+
+State::State(unsigned n) : arena(nullptr) {
+  allocate(n);
+  heads.n = deprels.n = n;
+  std::fill(heads.items, heads.items + n, Corpus::BAD_HED);
+  std::fill(deprels.items, deprels.items + n, Corpus::BAD_DEL);
+}
+
+State::State(unsigned n, StateArena & arena) : arena(&arena) {
+  allocate(n);
+  heads.n = deprels.n = n;
+  std::fill(heads.items, heads.items + n, Corpus::BAD_HED);
+  std::fill(deprels.items, deprels.items + n, Corpus::BAD_DEL);
+}
+
+State::State(const State& other) : arena(other.arena) {
+  allocate(other.heads.capacity);
+  copy_from(other);
+}
+
+State::State(State&& other) : stack(other.stack), buffer(other.buffer), heads(other.heads),
+  deprels(other.deprels), arena(other.arena), memory(other.memory) {
+  other.memory = nullptr;
+  other.stack = other.buffer = other.heads = other.deprels = FixedVector();
+}
+
+void State::release() {
+  if (memory == nullptr) { return; }
+  if (arena != nullptr) {
+    arena->release(memory);
+  } else {
+    delete[] memory;
+  }
+  memory = nullptr;
+}
+
+State::~State() {
+  release();
+}
+
+State& State::operator = (const State& other) {
+  if (this != &other) {
+    if (memory == nullptr || arena != other.arena || heads.capacity != other.heads.capacity) {
+      release();
+      arena = other.arena;
+      allocate(other.heads.capacity);
+    }
+    copy_from(other);
+  }
+  return (*this);
 }
 
 float State::loss(const std::vector<unsigned>& gold_heads,
@@ -26,4 +127,12 @@ bool State::terminated() const {
   return !(stack.size() > 2 || buffer.size() > 1);
 }
 
-}
\ No newline at end of file
+void State::to_parse_units(ParseUnits & parse) const {
+  parse.resize(heads.size());
+  for (unsigned i = 0; i < heads.size(); ++i) {
+    parse[i].head = heads[i];
+    parse[i].deprel = deprels[i];
+  }
+}
+
+}
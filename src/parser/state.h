@@ -2,27 +2,101 @@
 #define __TWPIPE_PARSER_STATE_H__
 
 #include <vector>
+#include <memory>
+#include "twpipe/corpus.h"
 
 namespace twpipe {
 
+/// A sequence of at most capacity ids on memory owned by the State.
+struct FixedVector {
+  unsigned * items;
+  unsigned n;
+  unsigned capacity;
+
+  FixedVector() : items(nullptr), n(0), capacity(0) {}
+
+  unsigned size() const { return n; }
+  bool empty() const { return n == 0; }
+
+  unsigned & operator[](unsigned i) { return items[i]; }
+  const unsigned & operator[](unsigned i) const { return items[i]; }
+  unsigned & back() { return items[n - 1]; }
+  const unsigned & back() const { return items[n - 1]; }
+
+  unsigned * data() { return items; }
+  const unsigned * data() const { return items; }
+  const unsigned * begin() const { return items; }
+  const unsigned * end() const { return items + n; }
+
+  void push_back(unsigned x);
+  void pop_back() { --n; }
+  void resize(unsigned m);
+};
+
+/// The blocks of the states of one sentence, the blocks of the destroyed
+/// states are reused, so the copies in a beam stop allocating once the beam
+/// is full. It should outlive the states.
+struct StateArena {
+  unsigned block_size;
+
+  explicit StateArena(unsigned n);
+
+  unsigned * acquire();
+
+  void release(unsigned * block);
+
+private:
+  StateArena(const StateArena &);
+  StateArena & operator = (const StateArena &);
+
+  std::vector<std::unique_ptr<unsigned[]>> blocks;
+  std::vector<unsigned *> free_blocks;
+};
+
 struct State {
   static const unsigned MAX_N_WORDS = 1024;
 
-  std::vector<unsigned> stack;
-  std::vector<unsigned> buffer;
-  std::vector<unsigned> heads;
-  std::vector<unsigned> deprels;
-  // std::vector<unsigned> aux;
+  /// The stack, buffer, heads and deprels are fixed-capacity arrays in one
+  /// block, sized for the whole sentence when the state is created, so
+  /// performing actions never allocates.
+  FixedVector stack;
+  FixedVector buffer;
+  FixedVector heads;
+  FixedVector deprels;
 
   State(unsigned n);
 
+  /// The block comes from the arena and is returned to it.
+  State(unsigned n, StateArena & arena);
+
+  State(const State& other);
+
+  State(State&& other);
+
+  ~State();
+
+  State& operator = (const State& other);
+
   //! Computing the loss on the current state and reference.
   float loss(const std::vector<unsigned>& gold_heads,
              const std::vector<unsigned>& gold_deprels);
 
   bool terminated() const;
+
+  /// The arcs of the words, the pseudo root first.
+  void to_parse_units(ParseUnits & parse) const;
+
+private:
+  void allocate(unsigned n);
+
+  void copy_from(const State & other);
+
+  void release();
+
+  StateArena * arena;
+  unsigned * memory;
 };
 
 }
 
-#endif  //  end for STATE_H
\ No newline at end of file
+#endif  //  end for STATE_H
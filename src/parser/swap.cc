@@ -15,9 +15,9 @@ Swap::Swap() : TransitionSystem() {
     action_names.push_back("LEFT-" + map.get(i));
     action_names.push_back("RIGHT-" + map.get(i));
   }
-  _INFO << "TransitionSystem:: show action names:";
+  _TRACE << "TransitionSystem:: show action names:";
   for (const auto& action_name : action_names) {
-    _INFO << "- " << action_name;
+    _TRACE << "- " << action_name;
   }
 }
 
@@ -44,8 +44,26 @@ void Swap::get_transition_costs(const State & state,
   BOOST_ASSERT_MSG(false, "Inefficient to define dynamic oracle for SWAP system");
 }
 
-unsigned Swap::get_structure_action(const unsigned & action) {
-  return (action < 3 ? action : (action % 2 == 1 ? 3 : 4));
+unsigned Swap::get_structure_action(const unsigned & action) const {
+  // SHIFT, SWAP, LEFT, RIGHT
+  return (action < 2 ? action : (action % 2 == 0 ? 2 : 3));
+}
+
+unsigned Swap::num_structure_actions() const { return 4; }
+
+unsigned Swap::get_valid_structure_actions(const State& state) const {
+  unsigned mask = 0;
+  unsigned stack_size = state.stack.size();
+  if (state.buffer.size() > 1) {
+    mask |= (1u << 0);
+    // SWAP: only swap the words that are in the original order.
+    if (stack_size > 2 && state.stack[stack_size - 2] < state.stack.back()) { mask |= (1u << 1); }
+  }
+  if (stack_size > 2) {
+    if (state.stack[stack_size - 2] != 0) { mask |= (1u << 2); }
+    mask |= (1u << 3);
+  }
+  return mask;
 }
 
 void Swap::perform_action(State & state, const unsigned & action) {
@@ -321,32 +339,4 @@ unsigned Swap::parse_label(const unsigned & action) const {
   return (action % 2 == 0 ? (action - 2) / 2 : (action - 3) / 2);
 }
 
-void Swap::get_valid_actions(const State & state,
-                             std::vector<unsigned>& valid_actions) {
-  valid_actions.clear();
-  for (unsigned a = 0; a < n_actions; ++a) {
-    //if (!is_valid_action(state, action_names[a])) { continue; }
-    if (!is_valid_action(state, a)) { continue; }
-    valid_actions.push_back(a);
-  }
-  BOOST_ASSERT_MSG(valid_actions.size() > 0, "There should be one or more valid action.");
-}
-
-bool Swap::is_valid_action(const State& state, const unsigned& act) const {
-  bool is_shift = (act == 0);
-  bool is_swap = (act == 1);
-  bool is_reduce = (!is_shift && !is_swap);
-
-  if (is_shift && state.buffer.size() == 1) { return false; }
-  if (is_swap && (state.stack.size() < 3 || state.buffer.size() == 1)) { return false; }
-  if (is_swap && state.stack[state.stack.size() - 2] > state.stack.back()) { return false; }
-  if (is_reduce) {
-    if (state.stack.size() < 3) { return false; }
-    if (is_left(act) && state.stack[state.stack.size() - 2] == 0) { return false; }
-  }
-  // if (is_reduce && state.stack.size() < 3) { return false; }
-  // if (state.buffer.size() == 1 && !is_right(act)) { return false; }
-  return true;
-}
-
 }
\ No newline at end of file
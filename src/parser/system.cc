@@ -1,5 +1,6 @@
 #include "system.h"
 #include "twpipe/alphabet_collection.h"
+#include <boost/assert.hpp>
 
 namespace twpipe {
 
@@ -7,4 +8,22 @@ unsigned TransitionSystem::num_deprels() {
   return AlphabetCollection::get()->deprel_map.size();
 }
 
+bool TransitionSystem::is_valid_action(unsigned valid_mask, unsigned structure_action) {
+  return ((valid_mask >> structure_action) & 1u) != 0;
+}
+
+bool TransitionSystem::is_valid_action(const State& state, const unsigned& act) const {
+  return is_valid_action(get_valid_structure_actions(state), get_structure_action(act));
+}
+
+void TransitionSystem::get_valid_actions(const State& state,
+                                         std::vector<unsigned>& valid_actions) const {
+  valid_actions.clear();
+  unsigned valid_mask = get_valid_structure_actions(state);
+  for (unsigned a = 0; a < num_actions(); ++a) {
+    if (is_valid_action(valid_mask, get_structure_action(a))) { valid_actions.push_back(a); }
+  }
+  BOOST_ASSERT_MSG(valid_actions.size() > 0, "There should be one or more valid action.");
+}
+
 }
@@ -30,15 +30,25 @@ struct TransitionSystem {
 
   virtual void perform_action(State& state, const unsigned& action) = 0;
 
-  virtual bool is_valid_action(const State& state, const unsigned& act) const = 0;
+  /// Get the valid structure actions as a bitmask: the k-th bit is set when the
+  /// structure action k (see get_structure_action) is valid. The labels are
+  /// only expanded when the actions are scored.
+  virtual unsigned get_valid_structure_actions(const State& state) const = 0;
 
-  virtual void get_valid_actions(const State& state, std::vector<unsigned>& valid_actions) = 0;
+  bool is_valid_action(const State& state, const unsigned& act) const;
+
+  static bool is_valid_action(unsigned valid_mask, unsigned structure_action);
+
+  void get_valid_actions(const State& state, std::vector<unsigned>& valid_actions) const;
 
   virtual void get_oracle_actions(const std::vector<unsigned>& heads,
                                   const std::vector<unsigned>& deprels,
                                   std::vector<unsigned>& actions) = 0;
 
-  virtual unsigned get_structure_action(const unsigned & action) = 0;
+  virtual unsigned get_structure_action(const unsigned & action) const = 0;
+
+  /// Get the number of structure actions, i.e. actions without labels.
+  virtual unsigned num_structure_actions() const = 0;
 };
 
 }
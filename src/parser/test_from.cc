@@ -2,6 +2,7 @@
 #include <fstream>
 #include "dynet/dynet.h"
 #include "twpipe/logging.h"
+#include "twpipe/input_reader.h"
 #include "twpipe/embedding.h"
 #include "twpipe/model.h"
 #include "twpipe/alphabet_collection.h"
@@ -102,7 +103,8 @@ int main(int argc, char* argv[]) {
     exit(1);
   }
 
-  std::string buffer;
+  twpipe::StringPiece buffer;
+  std::vector<twpipe::StringPiece> data;
   std::vector<std::string> tokens;
   std::vector<std::string> postags;
   std::vector<unsigned> heads;
@@ -112,11 +114,14 @@ int main(int argc, char* argv[]) {
   std::vector<unsigned> actions;
 
   std::vector<std::vector<float>> prob;
-  std::ifstream ifs(conf["input-file"].as<std::string>());
+  twpipe::InputReader reader;
+  if (!reader.open(conf["input-file"].as<std::string>())) {
+    _ERROR << "[twpipe|parse|test] failed to open " << conf["input-file"].as<std::string>();
+    exit(1);
+  }
 
   unsigned sid = 0;
-  while (std::getline(ifs, buffer)) {
-    boost::algorithm::trim(buffer);
+  while (reader.next_line(buffer)) {
     if (buffer.empty()) {
       tester->test(tokens, postags, heads, deprels, actions, prob);
 
@@ -135,21 +140,30 @@ int main(int argc, char* argv[]) {
       heads.push_back(twpipe::Corpus::BAD_HED);
       deprels.emplace_back(twpipe::Corpus::BAD0);
       sid++;
-    } else if (boost::algorithm::starts_with(buffer, "#ACTION ")) {
-      actions.push_back(boost::lexical_cast<unsigned>(buffer.substr(8)));
+    } else if (buffer.starts_with("#ACTION ")) {
+      unsigned action;
+      if (!buffer.substr(8).to_unsigned(action)) {
+        _ERROR << "[twpipe|parse|test] malformed action line \"" << buffer << "\" in sentence " << sid;
+        exit(1);
+      }
+      actions.push_back(action);
     } else if (buffer[0] == '#') {
       continue;
     } else {
-      std::vector<std::string> data;
-      boost::algorithm::split(data, buffer, boost::is_any_of("\t "));
-      tokens.push_back(data[1]);
-      postags.push_back(data[3]);
+      twpipe::InputReader::split_fields(buffer, data);
+      tokens.push_back(data[1].str());
+      postags.push_back(data[3].str());
       if (data[6] == "_") {
         heads.push_back(twpipe::Corpus::BAD_HED);
         deprels.emplace_back(twpipe::Corpus::BAD0);
       } else {
-        heads.push_back(boost::lexical_cast<unsigned>(data[6]));
-        deprels.push_back(data[7]);
+        unsigned head;
+        if (!data[6].to_unsigned(head)) {
+          _ERROR << "[twpipe|parse|test] malformed head \"" << data[6] << "\" in sentence " << sid;
+          exit(1);
+        }
+        heads.push_back(head);
+        deprels.push_back(data[7].str());
       }
     }
   }
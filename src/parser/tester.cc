@@ -35,8 +35,8 @@ void OracleTester::test(const std::vector<std::string> &words,
     numeric_deprels[i] = AlphabetCollection::get()->deprel_map.get(deprels[i]);
   }
 
+  std::vector<unsigned> valid_actions;
   while (!state.terminated()) {
-    std::vector<unsigned> valid_actions;
     system.get_valid_actions(state, valid_actions);
 
     std::vector<float> costs;
@@ -135,16 +135,8 @@ void EnsembleTester::test(const std::vector<std::string> &words,
 
   unsigned n_actions = 0;
   while (!state.terminated()) {
-    std::vector<float> ensemble_probs(system.num_actions(), 0.f);
-    for (unsigned i = 0; i < n_engines; ++i) {
-      dynet::Expression score_exprs = engines[i]->get_scores(checkpoints[i]);
-      std::vector<float> ensemble_score = dynet::as_vector(cg.get_value(score_exprs));
-      Math::softmax_inplace(ensemble_score);
-      for (unsigned c = 0; c < ensemble_score.size(); ++c) {
-        ensemble_probs[c] += ensemble_score[c];
-      }
-    }
-    for (auto & p : ensemble_probs) { p /= n_engines; }
+    std::vector<float> ensemble_probs;
+    ParseModel::get_ensemble_probs(cg, engines, checkpoints, ensemble_probs);
 
     unsigned action = actions[n_actions];
 
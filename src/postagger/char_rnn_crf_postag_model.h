@@ -60,15 +60,15 @@ struct CharacterRNNCRFPostagModel : public PostagModel {
     word_hidden_dim(word_hidden_dim),
     word_n_layers(word_n_layers),
     pos_dim(pos_dim) {
-    _INFO << "[postag|model] name = " << name;
-    _INFO << "[postag|model] number of character types = " << char_size;
-    _INFO << "[postag|model] character dimension = " << char_dim;
-    _INFO << "[postag|model] character rnn hidden dimension = " << char_hidden_dim;
-    _INFO << "[postag|model] character rnn number layers = " << char_n_layers;
-    _INFO << "[postag|model] pre-trained word embedding dimension = " << embed_dim;
-    _INFO << "[postag|model] word rnn hidden dimension = " << word_hidden_dim;
-    _INFO << "[postag|model] word rnn number layers = " << word_n_layers;
-    _INFO << "[postag|model] postag hidden dimension = " << pos_dim;
+    _DBG << "[postag|model] name = " << name;
+    _DBG << "[postag|model] number of character types = " << char_size;
+    _DBG << "[postag|model] character dimension = " << char_dim;
+    _DBG << "[postag|model] character rnn hidden dimension = " << char_hidden_dim;
+    _DBG << "[postag|model] character rnn number layers = " << char_n_layers;
+    _DBG << "[postag|model] pre-trained word embedding dimension = " << embed_dim;
+    _DBG << "[postag|model] word rnn hidden dimension = " << word_hidden_dim;
+    _DBG << "[postag|model] word rnn number layers = " << word_n_layers;
+    _DBG << "[postag|model] postag hidden dimension = " << pos_dim;
 
     root_pos_id = AlphabetCollection::get()->pos_map.get(Corpus::ROOT);
   }
@@ -191,7 +191,7 @@ struct CharacterRNNCRFPostagModel : public PostagModel {
     std::vector<std::string> words(n_words);
     std::vector<unsigned> labels(n_words);
     for (unsigned i = 1; i < inst.input_units.size(); ++i) {
-      words[i - 1] = inst.input_units[i].word;
+      words[i - 1] = inst.input_units.word(i);
       labels[i - 1] = inst.input_units[i].pid;
     }
     initialize(words);
@@ -72,18 +72,18 @@ struct CharacterRNNWithClusterPostagModel : public PostagModel {
     cluster_hidden_dim(cluster_hidden_dim),
     cluster_n_layers(cluster_n_layers),
     pos_dim(pos_dim) {
-    _INFO << "[postag|model] name = " << name;
-    _INFO << "[postag|model] number of character types = " << char_size;
-    _INFO << "[postag|model] character dimension = " << char_dim;
-    _INFO << "[postag|model] character rnn hidden dimension = " << char_hidden_dim;
-    _INFO << "[postag|model] character rnn number layers = " << char_n_layers;
-    _INFO << "[postag|model] pre-trained word embedding dimension = " << embed_dim;
-    _INFO << "[postag|model] cluster bit dimension = " << cluster_dim;
-    _INFO << "[postag|model] cluster rnn hidden dimension = " << cluster_hidden_dim;
-    _INFO << "[postag|model] cluster rnn number layers = " << cluster_n_layers;
-    _INFO << "[postag|model] word rnn hidden dimension = " << word_hidden_dim;
-    _INFO << "[postag|model] word rnn number layers = " << word_n_layers;
-    _INFO << "[postag|model] postag hidden dimension = " << pos_dim;
+    _DBG << "[postag|model] name = " << name;
+    _DBG << "[postag|model] number of character types = " << char_size;
+    _DBG << "[postag|model] character dimension = " << char_dim;
+    _DBG << "[postag|model] character rnn hidden dimension = " << char_hidden_dim;
+    _DBG << "[postag|model] character rnn number layers = " << char_n_layers;
+    _DBG << "[postag|model] pre-trained word embedding dimension = " << embed_dim;
+    _DBG << "[postag|model] cluster bit dimension = " << cluster_dim;
+    _DBG << "[postag|model] cluster rnn hidden dimension = " << cluster_hidden_dim;
+    _DBG << "[postag|model] cluster rnn number layers = " << cluster_n_layers;
+    _DBG << "[postag|model] word rnn hidden dimension = " << word_hidden_dim;
+    _DBG << "[postag|model] word rnn number layers = " << word_n_layers;
+    _DBG << "[postag|model] postag hidden dimension = " << pos_dim;
 
     root_pos_id = AlphabetCollection::get()->pos_map.get(Corpus::ROOT);
   }
@@ -175,7 +175,7 @@ struct CharacterRNNWithClusterPostagModel : public PostagModel {
     // embeddings counting w/o pseudo root.
     std::vector<std::string> words;
     for (unsigned i = 1; i < inst.input_units.size(); ++i) {
-      words.push_back(inst.input_units[i].word);
+      words.push_back(inst.input_units.word(i));
     }
    
     const InputUnits & input_units = inst.input_units;
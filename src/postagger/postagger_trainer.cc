@@ -1,6 +1,10 @@
 #include "postagger_trainer.h"
 #include "twpipe/model.h"
 #include "twpipe/logging.h"
+#include "twpipe/checkpoint.h"
+#include "twpipe/hogwild.h"
+#include "twpipe/allreduce.h"
+#include "twpipe/telemetry.h"
 #include "twpipe/alphabet_collection.h"
 #include "twpipe/embedding.h"
 
@@ -20,91 +24,130 @@ void PostaggerTrainer::train(const Corpus & corpus) {
   _INFO << "[postag|train] size of dataset = " << corpus.n_train;
 
   std::vector<unsigned> order(corpus.n_train);
-  for (unsigned i = 0; i < corpus.n_train; ++i) { order[i] = i; }
+  std::vector<unsigned> lengths(corpus.n_train);
+  for (unsigned i = 0; i < corpus.n_train; ++i) {
+    order[i] = i;
+    lengths[i] = corpus.training_data.at(i).input_units.size();
+  }
 
   _INFO << "[postag|train] going to train " << max_iter << " iterations";
+  _INFO << "[postag|train] batch size = " << batch_size;
 
   dynet::Trainer * trainer = opt_builder.build(engine.model);
   float best_acc = 0.f;
   unsigned n_processed = 0;
+  std::vector<std::vector<unsigned>> batches;
+
+  HogwildRunner hogwild(n_workers, engine.model);
+  AllReduceRunner allreduce(n_sync_workers, engine.model);
+  auto step = [&](const std::vector<unsigned> & batch) -> float {
+    TelemetryTimer build_timer(TrainingTelemetry::kBuild);
+    dynet::ComputationGraph cg;
+    engine.new_graph(cg);
+    std::vector<dynet::Expression> losses;
+    unsigned n_units = 0;
+    for (unsigned sid : batch) {
+      const Instance & inst = corpus.training_data.at(sid);
+      losses.push_back(engine.objective(inst));
+      n_units += inst.input_units.size();
+    }
+    dynet::Expression loss_expr = dynet::sum(losses);
+    if (lambda_ > 0) {
+      loss_expr = loss_expr + (0.5f * lambda_ * n_units) * engine.l2();
+    }
+    build_timer.stop();
+    TrainingTelemetry::get()->add_graph(n_units, cg.nodes.size());
+
+    TelemetryTimer forward_timer(TrainingTelemetry::kForward);
+    float l = dynet::as_scalar(cg.forward(loss_expr));
+    forward_timer.stop();
+    TelemetryTimer backward_timer(TrainingTelemetry::kBackward);
+    cg.backward(loss_expr);
+    return l;
+  };
 
   for (unsigned iter = 1; iter <= max_iter; ++iter) {
     std::shuffle(order.begin(), order.end(), *dynet::rndeng);
+    get_batches(order, lengths, batches);
     _INFO << "[postag|train] start training at " << iter << "-th iteration.";
 
     float loss = 0.f;
-    for (unsigned sid : order) {
-      const Instance & inst = corpus.training_data.at(sid);
-
-      {
-        dynet::ComputationGraph cg;
-        engine.new_graph(cg);
-        dynet::Expression loss_expr = engine.objective(inst);
-        if (lambda_ > 0) {
-          loss_expr = loss_expr + (0.5f * lambda_ * inst.input_units.size()) * engine.l2();
+    if (hogwild.enabled() || allreduce.enabled()) {
+      // the workers run the whole epoch, it's evaluated at the end.
+      loss = (hogwild.enabled() ? hogwild.run(batches, step, *trainer) : allreduce.run(batches, step, *trainer));
+      n_processed += order.size();
+      TrainingTelemetry::get()->count(iter, order.size());
+    } else {
+      for (const std::vector<unsigned> & batch : batches) {
+        loss += step(batch);
+        {
+          TelemetryTimer timer(TrainingTelemetry::kUpdate);
+          trainer->update();
         }
-        float l = dynet::as_scalar(cg.forward(loss_expr));
-        cg.backward(loss_expr);
-        loss += l;
-        trainer->update();
-        n_processed++;
-      }
-      if (need_evaluate(iter, n_processed)) {
-        float acc = evaluate(corpus);
-        float prop = static_cast<float>(n_processed) / order.size();
-        if (acc > best_acc) {
-          _INFO << "[postag|train] " << prop << "% trained, ACC on heldout = " << acc
-              << ", new best achieved, saved.";
-          best_acc = acc;
-          Model::get()->to_json(Model::kPostaggerName, engine.model);
-        } else {
-          _INFO << "[postag|train] " << prop << "% trained, ACC on heldout = " << acc;
+        n_processed += batch.size();
+        TrainingTelemetry::get()->count(iter, batch.size());
+        if (need_evaluate(iter, n_processed, batch.size())) {
+          float acc = evaluate(corpus);
+          float prop = static_cast<float>(n_processed) / order.size();
+          if (check_best(acc, best_acc)) {
+            _INFO << "[postag|train] " << prop << "% trained, ACC on heldout = " << acc
+                << ", new best achieved, saved.";
+            best_acc = acc;
+            Checkpointer::get()->save(Model::kPostaggerName, engine.model);
+          } else {
+            _INFO << "[postag|train] " << prop << "% trained, ACC on heldout = " << acc;
+          }
         }
       }
     }
+    TrainingTelemetry::get()->end_iter(iter);
     _INFO << "[postag|train] end of iter #" << iter << ", loss = " << loss;
     if (need_evaluate(iter)) {
       float acc = evaluate(corpus);
-      if (acc > best_acc) {
+      if (check_best(acc, best_acc)) {
         best_acc = acc;
         _INFO << "[postag|train] end of iter #" << iter << ", ACC on heldout = " << acc
           << ", new best achieved, saved.";
-        Model::get()->to_json(Model::kPostaggerName, engine.model);
+        Checkpointer::get()->save(Model::kPostaggerName, engine.model);
       } else {
         _INFO << "[postag|train] end of iter #" << iter << ", ACC on heldout = " << acc;
       }
     }
-    opt_builder.update(trainer, iter);
+    if (finish_iter(iter, opt_builder, trainer)) { break; }
   }
 
   _INFO << "[postag|train] training is done, best accuracy is: " << best_acc;
+  Checkpointer::get()->wait();
   delete trainer;
 }
 
 float PostaggerTrainer::evaluate(const Corpus & corpus) {
-  float n_recall = 0, n_total = 0;
-  for (unsigned sid = 0; sid < corpus.n_devel; ++sid) {
-    const Instance & inst = corpus.devel_data.at(sid);
+  std::vector<float> totals(2);
+  parallel_evaluate(corpus.n_devel, totals,
+                    [&](unsigned begin, unsigned end, std::vector<float> & counts) {
+    for (unsigned sid = begin; sid < end; ++sid) {
+      const Instance & inst = corpus.devel_data.at(sid);
 
-    dynet::ComputationGraph cg;
-    engine.new_graph(cg);
+      dynet::ComputationGraph cg;
+      engine.new_graph(cg);
 
-    unsigned len = inst.input_units.size();
-    std::vector<std::string> words(len - 1);
-    std::vector<std::string> gold_postags(len - 1), pred_postags;
-    std::vector<std::vector<float>> values;
-    for (unsigned i = 1; i < inst.input_units.size(); ++i) {
-      words[i - 1] = inst.input_units[i].word;
-      gold_postags[i - 1] = inst.input_units[i].postag;
-    }
-    engine.decode(words, pred_postags);
-    auto payload = engine.evaluate(gold_postags, pred_postags);
+      unsigned len = inst.input_units.size();
+      std::vector<std::string> words(len - 1);
+      std::vector<std::string> gold_postags(len - 1), pred_postags;
+      std::vector<std::vector<float>> values;
+      for (unsigned i = 1; i < inst.input_units.size(); ++i) {
+        words[i - 1] = inst.input_units.word(i);
+        gold_postags[i - 1] = inst.input_units.postag(i);
+      }
+      engine.decode(words, pred_postags);
+      auto payload = engine.evaluate(gold_postags, pred_postags);
 
-    n_recall += payload.first;
-    n_total += payload.second;
-  }
+      counts[0] += payload.first;
+      counts[1] += payload.second;
+    }
+  });
 
-  return n_recall / n_total;
+  return totals[0] / totals[1];
 }
 
 PostaggerEnsembleTrainer::PostaggerEnsembleTrainer(PostagModel & engine, 
@@ -122,101 +165,122 @@ po::options_description PostaggerEnsembleTrainer::get_options() {
 }
 
 void PostaggerEnsembleTrainer::train(Corpus & corpus,
-                                     EnsembleInstances & ensemble_instances) {
+                                     const EnsembleDataset & ensemble_data) {
   _INFO << "[postag|ensemble|train] start postagger supervised training.";
 
   dynet::ParameterCollection & model = engine.model;
   dynet::Trainer * trainer = opt_builder.build(model);
 
   std::vector<unsigned> order;
-  for (unsigned i = 0; i < ensemble_instances.size(); ++i) {
-    unsigned id = ensemble_instances[i].id;
-    if (corpus.training_data.count(id) == 0) { continue; }
+  std::vector<unsigned> lengths(ensemble_data.size(), 0);
+  for (unsigned i = 0; i < ensemble_data.size(); ++i) {
+    unsigned id = ensemble_data.id(i);
+    if (id >= corpus.training_data.size()) { continue; }
     order.push_back(i);
+    lengths[i] = corpus.training_data[id].input_units.size();
   }
 
+  EnsembleInstance inst;
   float llh = 0.f;
   float best_acc = -1.f;
   unsigned n_processed = 0;
+  std::vector<std::vector<unsigned>> batches;
 
   _INFO << "[postag|ensemble|train] will stop after " << max_iter << " iterations.";
   for (unsigned iter = 1; iter <= max_iter; ++iter) {
     llh = 0.f;
     std::shuffle(order.begin(), order.end(), (*dynet::rndeng));
+    get_batches(order, lengths, batches);
 
-    for (unsigned id : order) {
-      const EnsembleInstance & inst = ensemble_instances.at(id);
-      unsigned sid = inst.id;
-      InputUnits & units = corpus.training_data.at(sid).input_units;
-
+    for (const std::vector<unsigned> & batch : batches) {
       {
+        TelemetryTimer build_timer(TrainingTelemetry::kBuild);
         dynet::ComputationGraph cg;
         engine.new_graph(cg);
 
-        unsigned n_words = units.size() - 1;
-        std::vector<std::string> words(n_words);
-        for (unsigned i = 1; i < units.size(); ++i) {
-          words[i - 1] = units[i].word;
-        }
-        engine.initialize(words);
-        unsigned prev_label = AlphabetCollection::get()->pos_map.get(Corpus::ROOT);
-
         std::vector<dynet::Expression> loss;
-        const std::vector<unsigned> & actions = inst.categories;
-        const std::vector<std::vector<float>> & probs = inst.probs;
-
-        unsigned n_pos = probs.at(0).size();
-        for (unsigned i = 0; i < n_words; ++i) {
-          dynet::Expression feature = engine.get_feature(i, prev_label);
-          dynet::Expression logits = engine.get_emit_score(feature);
-          const std::vector<float> & prob = probs.at(i);
-
-          loss.push_back(dynet::dot_product(
-            dynet::input(cg, { n_pos }, prob),
-            dynet::log_softmax(logits)
-          ));
-          prev_label = actions.at(i);
+        unsigned n_units = 0;
+        for (unsigned id : batch) {
+          ensemble_data.get(id, inst);
+          unsigned sid = inst.id;
+          InputUnits & units = corpus.training_data.at(sid).input_units;
+
+          unsigned n_words = units.size() - 1;
+          std::vector<std::string> words(n_words);
+          for (unsigned i = 1; i < units.size(); ++i) {
+            words[i - 1] = units.word(i);
+          }
+          engine.initialize(words);
+          unsigned prev_label = AlphabetCollection::get()->pos_map.get(Corpus::ROOT);
+
+          const std::vector<unsigned> & actions = inst.categories;
+          const std::vector<std::vector<float>> & probs = inst.probs;
+
+          unsigned n_pos = probs.at(0).size();
+          for (unsigned i = 0; i < n_words; ++i) {
+            dynet::Expression feature = engine.get_feature(i, prev_label);
+            dynet::Expression logits = engine.get_emit_score(feature);
+            const std::vector<float> & prob = probs.at(i);
+
+            loss.push_back(dynet::dot_product(
+              dynet::input(cg, { n_pos }, prob),
+              dynet::log_softmax(logits)
+            ));
+            prev_label = actions.at(i);
+          }
+          n_units += units.size();
         }
         if (!loss.empty()) {
           dynet::Expression loss_expr = -dynet::sum(loss);
           if (lambda_ > 0) {
-            loss_expr = loss_expr + (0.5f * lambda_ * units.size()) * engine.l2();
+            loss_expr = loss_expr + (0.5f * lambda_ * n_units) * engine.l2();
           }
+          build_timer.stop();
+          TrainingTelemetry::get()->add_graph(n_units, cg.nodes.size());
+
+          TelemetryTimer forward_timer(TrainingTelemetry::kForward);
           float l = dynet::as_scalar(cg.forward(loss_expr));
+          forward_timer.stop();
+          TelemetryTimer backward_timer(TrainingTelemetry::kBackward);
           cg.backward(loss_expr);
+          backward_timer.stop();
+          TelemetryTimer update_timer(TrainingTelemetry::kUpdate);
           trainer->update();
           llh += l;
-          n_processed++;
         }
+        n_processed += batch.size();
+        TrainingTelemetry::get()->count(iter, batch.size());
       }
 
-      if (need_evaluate(iter, n_processed)) {
+      if (need_evaluate(iter, n_processed, batch.size())) {
         float acc = evaluate(corpus);
         float prop = static_cast<float>(n_processed) / order.size();
-        if (acc > best_acc) {
+        if (check_best(acc, best_acc)) {
           _INFO << "[postag|ensemble|train] " << prop << "% trained, ACC on heldout = " << acc
             << ", new best achieved, saved.";
           best_acc = acc;
-          Model::get()->to_json(Model::kPostaggerName, engine.model);
+          Checkpointer::get()->save(Model::kPostaggerName, engine.model);
         } else {
           _INFO << "[postag|ensemble|train] " << prop << "% trained, ACC on heldout = " << acc;
         }
       }
     }
+    TrainingTelemetry::get()->end_iter(iter);
     _INFO << "[postag|ensemble|train] end of iter #" << iter << " loss " << llh;
     if (need_evaluate(iter)) {
       float acc = evaluate(corpus);
-      if (acc > best_acc) {
+      if (check_best(acc, best_acc)) {
         best_acc = acc;
         _INFO << "[postag|train] end of iter #" << iter << ", ACC on heldout = " << acc <<
           ", new best achieved, saved.";
-        Model::get()->to_json(Model::kPostaggerName, engine.model);
+        Checkpointer::get()->save(Model::kPostaggerName, engine.model);
       } else {
         _INFO << "[postag|train] end of iter #" << iter << ", ACC on heldout = " << acc;
       }
     }
-    opt_builder.update(trainer, iter);
+    if (finish_iter(iter, opt_builder, trainer)) { break; }
   }
+  Checkpointer::get()->wait();
 }
 
 }
@@ -34,7 +34,7 @@ struct PostaggerEnsembleTrainer : public PostaggerTrainer {
 
   static po::options_description get_options();
 
-  void train(Corpus & corpus, EnsembleInstances & ensemble_instances);
+  void train(Corpus & corpus, const EnsembleDataset & ensemble_data);
 };
 
 }
@@ -21,7 +21,7 @@ void twpipe::LinearTokenizeModel::get_gold_labels(const twpipe::Instance &inst,
     labels.push_back(lid);
     if (ch != " ") {
       ++k;
-      if (k == input_units[j].cids.size()) { k = 0; ++j; }
+      if (k == input_units.cids(j).size()) { k = 0; ++j; }
     }
   }
 }
@@ -75,7 +75,7 @@ void twpipe::LinearSentenceSegmentAndTokenizeModel::get_gold_labels(const twpipe
     labels.push_back(lid);
     if (ch != " ") {
       ++k;
-      if (k == input_units[j].cids.size()) { k = 0; ++j; }
+      if (k == input_units.cids(j).size()) { k = 0; ++j; }
     }
   }
 }
@@ -7,6 +7,7 @@
 #include "dynet_layer/layer.h"
 #include "twpipe/logging.h"
 #include "twpipe/alphabet_collection.h"
+#include "twpipe/profiler.h"
 #include "tokenize_model.h"
 
 namespace twpipe {
@@ -67,11 +68,11 @@ struct LinearRNNTokenizeModel : public LinearTokenizeModel {
     n_layers(n_layers) {
 
     // Logging stat.
-    _INFO << "[tokenize|model] name = " << name;
-    _INFO << "[tokenize|model] number of character types = " << char_size;
-    _INFO << "[tokenize|model] character dimension = " << char_dim;
-    _INFO << "[tokenize|model] hidden dimension = " << hidden_dim;
-    _INFO << "[tokenize|model] number of rnn layers = " << n_layers;
+    _DBG << "[tokenize|model] name = " << name;
+    _DBG << "[tokenize|model] number of character types = " << char_size;
+    _DBG << "[tokenize|model] character dimension = " << char_dim;
+    _DBG << "[tokenize|model] hidden dimension = " << hidden_dim;
+    _DBG << "[tokenize|model] number of rnn layers = " << n_layers;
   }
 
   void new_graph(dynet::ComputationGraph & cg) override {
@@ -101,12 +102,14 @@ struct LinearRNNTokenizeModel : public LinearTokenizeModel {
   void decode(const std::string & input, std::vector<std::string> & output) override {
     Alphabet & char_map = AlphabetCollection::get()->char_map;
 
-    std::string clean_input = std::regex_replace(input, one_more_space_regex, " ");
     std::vector<unsigned> cids;
     std::vector<unsigned> ctids;
     std::vector<std::string> chars;
-
-    get_chars_and_char_categories(clean_input, cids, ctids, char_map, &chars);
+    {
+      ScopedTimer timer(Profiler::kPreprocess);
+      std::string clean_input = std::regex_replace(input, one_more_space_regex, " ");
+      get_chars_and_char_categories(clean_input, cids, ctids, char_map, &chars);
+    }
     unsigned n_chars = cids.size();
     std::vector<unsigned> labels;
 
@@ -214,11 +217,11 @@ struct LinearRNNSentenceSegmentAndTokenizeModel : public LinearSentenceSegmentAn
     n_layers(n_layers) {
 
     // Logging stat.
-    _INFO << "[tokenize|model] name = " << name;
-    _INFO << "[tokenize|model] number of character types = " << char_size;
-    _INFO << "[tokenize|model] character dimension = " << char_dim;
-    _INFO << "[tokenize|model] hidden dimension = " << hidden_dim;
-    _INFO << "[tokenize|model] number of rnn layers = " << n_layers;
+    _DBG << "[tokenize|model] name = " << name;
+    _DBG << "[tokenize|model] number of character types = " << char_size;
+    _DBG << "[tokenize|model] character dimension = " << char_dim;
+    _DBG << "[tokenize|model] hidden dimension = " << hidden_dim;
+    _DBG << "[tokenize|model] number of rnn layers = " << n_layers;
   }
 
   void new_graph(dynet::ComputationGraph & cg) override {
@@ -248,12 +251,14 @@ struct LinearRNNSentenceSegmentAndTokenizeModel : public LinearSentenceSegmentAn
   void decode(const std::string & input, std::vector<std::vector<std::string>> & output) override {
     Alphabet & char_map = AlphabetCollection::get()->char_map;
 
-    std::string clean_input = std::regex_replace(input, one_more_space_regex, " ");
     std::vector<unsigned> cids;
     std::vector<unsigned> ctids;
     std::vector<std::string> chars;
-
-    get_chars_and_char_categories(clean_input, cids, ctids, char_map, &chars);
+    {
+      ScopedTimer timer(Profiler::kPreprocess);
+      std::string clean_input = std::regex_replace(input, one_more_space_regex, " ");
+      get_chars_and_char_categories(clean_input, cids, ctids, char_map, &chars);
+    }
     unsigned n_chars = cids.size();
     std::vector<unsigned> labels;
 
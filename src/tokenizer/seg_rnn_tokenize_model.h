@@ -4,6 +4,7 @@
 #include <regex>
 #include "tokenize_model.h"
 #include "twpipe/alphabet_collection.h"
+#include "twpipe/profiler.h"
 
 namespace twpipe {
 
@@ -68,18 +69,20 @@ struct SegmentalRNNTokenizeModel : public TokenizeModel {
   void decode(const std::string & input, std::vector<std::string> & output) {
     Alphabet & char_map = AlphabetCollection::get()->char_map;
     dynet::ComputationGraph * cg = merge.B.pg;
-    std::string clean_input = std::regex_replace(input, one_more_space_regex, " ");
-
     std::vector<unsigned> cids;
     std::vector<std::string> chars;
-
-    unsigned len = 0;
-    for (unsigned i = 0; i < clean_input.size(); i += len) {
-      len = utf8_len(clean_input[i]);
-      std::string ch = clean_input.substr(i, len);
-      chars.push_back(ch);
-      unsigned cid = (char_map.contains(ch) ? char_map.get(ch) : char_map.get(Corpus::UNK));
-      cids.push_back(cid);
+    {
+      ScopedTimer timer(Profiler::kPreprocess);
+      std::string clean_input = std::regex_replace(input, one_more_space_regex, " ");
+
+      unsigned len = 0;
+      for (unsigned i = 0; i < clean_input.size(); i += len) {
+        len = utf8_len(clean_input[i]);
+        std::string ch = clean_input.substr(i, len);
+        chars.push_back(ch);
+        unsigned cid = (char_map.contains(ch) ? char_map.get(ch) : char_map.get(Corpus::UNK));
+        cids.push_back(cid);
+      }
     }
 
     unsigned n_chars = cids.size();
@@ -161,8 +164,8 @@ struct SegmentalRNNTokenizeModel : public TokenizeModel {
       cids.push_back(cid);
       if (cid != space_cid) {
         ++k;
-        if (k == input_units[j].cids.size()) {
-          segmentation.push_back(input_units[j].cids.size());
+        if (k == input_units.cids(j).size()) {
+          segmentation.push_back(input_units.cids(j).size());
           k = 0;
           ++j;
         }
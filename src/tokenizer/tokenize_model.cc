@@ -76,7 +76,7 @@ std::tuple<float, float, float> twpipe::TokenizeModel::evaluate(const Instance &
 
   std::vector<std::string> gold;
   for (unsigned i = 1; i < inst.input_units.size(); ++i) {
-    gold.push_back(inst.input_units[i].word);
+    gold.push_back(inst.input_units.word(i));
   }
 
   return fscore(gold, result);
@@ -125,7 +125,7 @@ std::tuple<float, float, float> twpipe::SentenceSegmentAndTokenizeModel::evaluat
   }
   std::vector<std::string> gold;
   for (unsigned i = 1; i < inst.input_units.size(); ++i) {
-    gold.push_back(inst.input_units[i].word);
+    gold.push_back(inst.input_units.word(i));
   }
 
   return fscore(gold, predict);
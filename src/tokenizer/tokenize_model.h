@@ -27,8 +27,9 @@ struct AbstractTokenizeModel {
 
   virtual std::tuple<float, float, float> evaluate(const Instance & inst) = 0;
 
-  std::tuple<float, float, float> fscore(const std::vector<std::string> & gold,
-                                         const std::vector<std::string> & prediction);
+  /// The number of correct, predicted and gold words, matched by their spans.
+  static std::tuple<float, float, float> fscore(const std::vector<std::string> & gold,
+                                                const std::vector<std::string> & prediction);
 };
 
 struct TokenizeModel : public AbstractTokenizeModel {
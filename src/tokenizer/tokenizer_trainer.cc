@@ -1,6 +1,10 @@
 #include <fstream>
 #include "tokenizer_trainer.h"
 #include "twpipe/logging.h"
+#include "twpipe/checkpoint.h"
+#include "twpipe/hogwild.h"
+#include "twpipe/allreduce.h"
+#include "twpipe/telemetry.h"
 
 namespace twpipe {
 
@@ -18,15 +22,19 @@ TokenizerTrainer::TokenizerTrainer(AbstractTokenizeModel & engine,
 }
 
 float twpipe::TokenizerTrainer::evaluate(const Corpus & corpus) {
-  float n_recall = 0, n_pred = 0, n_gold = 0;
-  for (unsigned sid = 0; sid < corpus.n_devel; ++sid) {
-    const Instance & inst = corpus.devel_data.at(sid);
+  std::vector<float> totals(3);
+  parallel_evaluate(corpus.n_devel, totals,
+                    [&](unsigned begin, unsigned end, std::vector<float> & counts) {
+    for (unsigned sid = begin; sid < end; ++sid) {
+      const Instance & inst = corpus.devel_data.at(sid);
 
-    auto payload = engine.evaluate(inst);
-    n_recall += std::get<0>(payload);
-    n_pred += std::get<1>(payload);
-    n_gold += std::get<2>(payload);
-  }
+      auto payload = engine.evaluate(inst);
+      counts[0] += std::get<0>(payload);
+      counts[1] += std::get<1>(payload);
+      counts[2] += std::get<2>(payload);
+    }
+  });
+  float n_recall = totals[0], n_pred = totals[1], n_gold = totals[2];
   float p = n_recall / n_gold;
   float r = n_recall / n_pred;
   float f = 2 * p * r / (p + r);
@@ -38,64 +46,100 @@ void twpipe::TokenizerTrainer::train(const Corpus & corpus) {
   _INFO << "[tokenize|train] size of dataset = " << corpus.n_train;
 
   std::vector<unsigned> order(corpus.n_train);
-  for (unsigned i = 0; i < corpus.n_train; ++i) { order[i] = i; }
+  std::vector<unsigned> lengths(corpus.n_train);
+  for (unsigned i = 0; i < corpus.n_train; ++i) {
+    order[i] = i;
+    lengths[i] = corpus.training_data.at(i).raw_sentence.size();
+  }
 
   _INFO << "[tokenize|train] going to train " << max_iter << " iterations";
+  _INFO << "[tokenize|train] batch size = " << batch_size;
 
   dynet::Trainer * trainer = opt_builder.build(engine.model);
 
   float best_f = 0.f;
   unsigned n_processed = 0;
+  std::vector<std::vector<unsigned>> batches;
+
+  HogwildRunner hogwild(n_workers, engine.model);
+  AllReduceRunner allreduce(n_sync_workers, engine.model);
+  auto step = [&](const std::vector<unsigned> & batch) -> float {
+    TelemetryTimer build_timer(TrainingTelemetry::kBuild);
+    dynet::ComputationGraph cg;
+    engine.new_graph(cg);
+    std::vector<dynet::Expression> losses;
+    unsigned n_units = 0;
+    for (unsigned sid : batch) {
+      const Instance & inst = corpus.training_data.at(sid);
+      losses.push_back(engine.objective(inst));
+      n_units += inst.input_units.size();
+    }
+    dynet::Expression loss_expr = dynet::sum(losses);
+    if (lambda_ > 0) {
+      loss_expr = loss_expr + (0.5f * lambda_ * n_units) * engine.l2();
+    }
+    build_timer.stop();
+    TrainingTelemetry::get()->add_graph(n_units, cg.nodes.size());
+
+    TelemetryTimer forward_timer(TrainingTelemetry::kForward);
+    float l = dynet::as_scalar(cg.forward(loss_expr));
+    forward_timer.stop();
+    TelemetryTimer backward_timer(TrainingTelemetry::kBackward);
+    cg.backward(loss_expr);
+    return l;
+  };
 
   for (unsigned iter = 1; iter <= max_iter; ++iter) {
     std::shuffle(order.begin(), order.end(), *dynet::rndeng);
+    get_batches(order, lengths, batches);
     _INFO << "[tokenize|train] start training at " << iter << "-th iteration.";
 
     float loss = 0;
-    for (unsigned sid = 0; sid < corpus.n_train; ++sid) {
-      const Instance & inst = corpus.training_data.at(order[sid]);
-      {
-        dynet::ComputationGraph cg;
-        engine.new_graph(cg);
-        dynet::Expression loss_expr = engine.objective(inst);
-        if (lambda_ > 0) {
-          loss_expr = loss_expr + (0.5f * lambda_ * inst.input_units.size()) * engine.l2();
+    if (hogwild.enabled() || allreduce.enabled()) {
+      // the workers run the whole epoch, it's evaluated at the end.
+      loss = (hogwild.enabled() ? hogwild.run(batches, step, *trainer) : allreduce.run(batches, step, *trainer));
+      n_processed += order.size();
+      TrainingTelemetry::get()->count(iter, order.size());
+    } else {
+      for (const std::vector<unsigned> & batch : batches) {
+        loss += step(batch);
+        {
+          TelemetryTimer timer(TrainingTelemetry::kUpdate);
+          trainer->update();
         }
-        float l = dynet::as_scalar(cg.forward(loss_expr));
-        cg.backward(loss_expr);
-        loss += l;
-
-        trainer->update();
-        n_processed++;
-      }
-      if (need_evaluate(iter, n_processed)) {
-        float f = evaluate(corpus);
-        float prop = static_cast<float>(n_processed) / order.size();
-        if (f > best_f) {
-          _INFO << "[tokenize|train] " << prop << "% trained, fscore on heldout = " << f
-                << ", new best achieved, saved.";
-          best_f = f;
-          Model::get()->to_json(phase_name, engine.model);
-        } else {
-          _INFO << "[tokenize|train] " << prop << "% trained, fscore on heldout = " << f;
+        n_processed += batch.size();
+        TrainingTelemetry::get()->count(iter, batch.size());
+        if (need_evaluate(iter, n_processed, batch.size())) {
+          float f = evaluate(corpus);
+          float prop = static_cast<float>(n_processed) / order.size();
+          if (check_best(f, best_f)) {
+            _INFO << "[tokenize|train] " << prop << "% trained, fscore on heldout = " << f
+                  << ", new best achieved, saved.";
+            best_f = f;
+            Checkpointer::get()->save(phase_name, engine.model);
+          } else {
+            _INFO << "[tokenize|train] " << prop << "% trained, fscore on heldout = " << f;
+          }
         }
       }
     }
+    TrainingTelemetry::get()->end_iter(iter);
     _INFO << "[tokenize|train] end of iter #" << iter << ", loss=" << loss;
     if (need_evaluate(iter)) {
       float f = evaluate(corpus);
-      if (f > best_f) {
+      if (check_best(f, best_f)) {
         _INFO << "[tokenize|train] end of iter #" << iter << ", fscore on heldout = " << f
               << ", new best achieved, saved.";
         best_f = f;
-        Model::get()->to_json(phase_name, engine.model);
+        Checkpointer::get()->save(phase_name, engine.model);
       } else {
         _INFO << "[tokenize|train] end of iter #" << iter << ", fscore on heldout = " << f;
       }
     }
-    opt_builder.update(trainer, iter);
+    if (finish_iter(iter, opt_builder, trainer)) { break; }
   }
   _INFO << "[tokenize|train] training is done, best fscore is: " << best_f;
+  Checkpointer::get()->wait();
   delete trainer;
 }
 
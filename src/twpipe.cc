@@ -1,5 +1,6 @@
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include <boost/program_options.hpp>
 #include <boost/algorithm/string.hpp>
 #include "tokenizer/tokenize_model.h"
@@ -12,11 +13,15 @@
 #include "parser/parse_model_builder.h"
 #include "parser/parser_trainer.h"
 #include "twpipe/logging.h"
+#include "twpipe/input_reader.h"
 #include "twpipe/alphabet_collection.h"
 #include "twpipe/corpus.h"
 #include "twpipe/optimizer_builder.h"
 #include "twpipe/trainer.h"
 #include "twpipe/model.h"
+#include "twpipe/checkpoint.h"
+#include "twpipe/profiler.h"
+#include "twpipe/telemetry.h"
 #include "twpipe/embedding.h"
 #include "twpipe/cluster.h"
 
@@ -29,6 +34,7 @@ void init_command_line(int argc, char* argv[], po::variables_map& conf) {
     ("help,h", "show help information.")
     ("train", "use to specify training.")
     ("input-file", po::value<std::string>(), "the path to the input file.")
+    ("log-json", po::value<std::string>(), "also write the log as json lines to the file.")
     ;
 
   po::options_description running_opts("Running options");
@@ -44,6 +50,10 @@ void init_command_line(int argc, char* argv[], po::variables_map& conf) {
   po::options_description embed_opts = twpipe::WordEmbedding::get_options();
   po::options_description cluster_opts = twpipe::WordCluster::get_options();
   po::options_description training_opts = twpipe::Trainer::get_options();
+  po::options_description checkpoint_opts = twpipe::Checkpointer::get_options();
+  po::options_description profile_opts = twpipe::Profiler::get_options();
+  po::options_description telemetry_opts = twpipe::TrainingTelemetry::get_options();
+  po::options_description corpus_opts = twpipe::Corpus::get_options();
   po::options_description tokenizer_opts = twpipe::AbstractTokenizeModel::get_options();
   po::options_description postagger_opts = twpipe::PostagModel::get_options();
   po::options_description postagger_ensemble_train_opts = twpipe::PostaggerEnsembleTrainer::get_options();
@@ -64,6 +74,10 @@ void init_command_line(int argc, char* argv[], po::variables_map& conf) {
     .add(embed_opts)
     .add(cluster_opts)
     .add(training_opts)
+    .add(checkpoint_opts)
+    .add(profile_opts)
+    .add(telemetry_opts)
+    .add(corpus_opts)
     .add(tokenizer_opts)
     .add(postagger_opts)
     .add(postagger_ensemble_train_opts)
@@ -82,7 +96,8 @@ void init_command_line(int argc, char* argv[], po::variables_map& conf) {
     std::cerr << cmd << std::endl;
     exit(1);
   }
-  twpipe::init_boost_log(conf.count("verbose") > 0);
+  twpipe::init_boost_log(conf.count("verbose") > 0,
+                         conf.count("log-json") ? conf["log-json"].as<std::string>() : "");
   
   if (!conf.count("input-file")) {
     std::cerr << "Please specify input file." << std::endl;
@@ -110,13 +125,16 @@ int main(int argc, char* argv[]) {
   }
 
   if (conf.count("train")) {
-    twpipe::Corpus corpus;
+    twpipe::Corpus corpus(conf);
     corpus.load_training_data(conf["input-file"].as<std::string>());
 
     if (conf.count("heldout")) {
       corpus.load_devel_data(conf["heldout"].as<std::string>());
     }
     twpipe::AlphabetCollection::get()->to_json();
+    twpipe::Checkpointer::get()->configure(conf["model"].as<std::string>(),
+                                           conf["checkpoint-keep"].as<unsigned>());
+    twpipe::TrainingTelemetry::get()->configure(conf);
 
     twpipe::OptimizerBuilder opt_builder(conf);
 
@@ -128,6 +146,7 @@ int main(int argc, char* argv[]) {
       builder.to_json();
 
       twpipe::TokenizeModel * engine = builder.build(model);
+      twpipe::TrainingTelemetry::get()->begin(twpipe::Model::kTokenizerName, builder.model_name, "crossentropy");
       twpipe::TokenizerTrainer trainer(*engine, opt_builder, conf);
       trainer.train(corpus);
     } else if (conf["train-segmentor-and-tokenizer"].as<bool>()) {
@@ -138,6 +157,8 @@ int main(int argc, char* argv[]) {
       builder.to_json();
 
       twpipe::SentenceSegmentAndTokenizeModel * engine = builder.build(model);
+      twpipe::TrainingTelemetry::get()->begin(twpipe::Model::kSentenceSegmentAndTokenizeName,
+                                              builder.model_name, "crossentropy");
       twpipe::TokenizerTrainer trainer(*engine, opt_builder, conf);
       trainer.train(corpus);
     }
@@ -151,14 +172,14 @@ int main(int argc, char* argv[]) {
       builder.to_json();
 
       twpipe::PostagModel * engine = builder.build(model);
+      twpipe::TrainingTelemetry::get()->begin(twpipe::Model::kPostaggerName, builder.model_name,
+                                              conf["train-distill-postagger"].as<bool>() ? "distill" : "crossentropy");
       if (!conf["train-distill-postagger"].as<bool>()) {
         twpipe::PostaggerTrainer trainer(*engine, opt_builder, conf);
         trainer.train(corpus);
       } else {
-        twpipe::EnsembleInstances instances;
-        twpipe::EnsembleUtils::load_ensemble_instances(
-          conf["pos-ensemble-data"].as<std::string>(),
-          instances);
+        twpipe::EnsembleDataset instances;
+        instances.load(conf["pos-ensemble-data"].as<std::string>());
         twpipe::PostaggerEnsembleTrainer trainer((*engine), opt_builder, conf);
         trainer.train(corpus, instances);
       }
@@ -171,25 +192,29 @@ int main(int argc, char* argv[]) {
       builder.to_json();
         
       twpipe::ParseModel * engine = builder.build(model);
+      twpipe::TrainingTelemetry::get()->begin(twpipe::Model::kParserName,
+                                              builder.arch_name + "/" + builder.system_name,
+                                              conf["train-distill-parser"].as<bool>() ? "distill" :
+                                              conf["parse-supervised-objective"].as<std::string>());
       if (!conf["train-distill-parser"].as<bool>()) {
         twpipe::SupervisedTrainer trainer((*engine), opt_builder, conf);
         trainer.train(corpus);
       } else {
-        twpipe::EnsembleInstances instances;
-        twpipe::EnsembleUtils::load_ensemble_instances(
-          conf["parse-ensemble-data"].as<std::string>(),
-          instances);
+        twpipe::EnsembleDataset instances;
+        instances.load(conf["parse-ensemble-data"].as<std::string>());
         twpipe::SupervisedEnsembleTrainer trainer((*engine), opt_builder, conf);
         trainer.train(corpus, instances);
       }
     }
 
     std::string model_name = conf["model"].as<std::string>();
+    twpipe::Checkpointer::get()->wait();
     twpipe::Model::get()->save(model_name);
   } else {
     std::string model_name = conf["model"].as<std::string>();
     twpipe::Model::get()->load(model_name);
     twpipe::AlphabetCollection::get()->from_json();
+    twpipe::Profiler::get()->configure(conf);
 
     if (conf["format"].as<std::string>() == "plain") {
       twpipe::TokenizeModel * tok_engine = nullptr;
@@ -241,50 +266,100 @@ int main(int argc, char* argv[]) {
         par_engine = par_builder.from_json(par_model);
       }
 
-      std::string buffer;
-      std::ifstream ifs(conf["input-file"].as<std::string>());
-      while (std::getline(ifs, buffer)) {
-        boost::algorithm::trim(buffer);
-        if (seg_tok_engine != nullptr) {
-          std::vector<std::vector<std::string>> sentences;
-          seg_tok_engine->sentsegment_and_tokenize(buffer, sentences);
-
-          std::vector<std::string> postags;
-          std::vector<unsigned> heads;
-          std::vector<std::string> deprels;
-
-          for (unsigned s = 0; s < sentences.size(); ++s) {
-            const std::vector<std::string> & tokens = sentences[s];
+      twpipe::InputReader reader;
+      if (!reader.open(conf["input-file"].as<std::string>())) {
+        _ERROR << "[twpipe] failed to open " << conf["input-file"].as<std::string>();
+        exit(1);
+      }
+      // the sentences are parsed in batches and written out in the input order
+      // once their batch is parsed. A batch is also flushed when the next line
+      // isn't read yet, so the stdin is answered line by line. The sentences
+      // of a line join the batch together. The batched parse and output are
+      // recorded per sentence, out of the input latency.
+      unsigned batch_size = (par_engine != nullptr ? std::max(conf["parse-batch-size"].as<unsigned>(), 1u) : 1);
+      std::vector<std::string> batch_texts;
+      std::vector<unsigned> batch_sent_ids;
+      std::vector<std::vector<std::string>> batch_tokens, batch_postags, batch_deprels;
+      std::vector<std::vector<unsigned>> batch_heads;
+      auto flush_batch = [&]() {
+        if (batch_tokens.empty()) { return; }
+        if (par_engine != nullptr) {
+          twpipe::ScopedTimer timer(twpipe::Profiler::kParse, batch_tokens.size());
+          par_engine->predict_batch(batch_tokens, batch_postags, batch_heads, batch_deprels);
+        }
+        twpipe::ScopedTimer timer(twpipe::Profiler::kOutput, batch_tokens.size());
+        for (unsigned b = 0; b < batch_tokens.size(); ++b) {
+          const std::vector<std::string> & tokens = batch_tokens[b];
+          const std::vector<std::string> & postags = batch_postags[b];
+          if (batch_sent_ids[b] == 1) {
+            std::cout << "# text = " << batch_texts[b] << "\n";
+          }
+          std::cout << "# sent_id = " << batch_sent_ids[b] << "\n";
+          for (unsigned i = 0; i < tokens.size(); ++i) {
+            std::cout << i + 1 << "\t" << tokens[i] << "\t_\t"
+                      << (pos_engine != nullptr ? postags[i] : "_") << "\t_\t_\t"
+                      << (par_engine != nullptr ? std::to_string(batch_heads[b][i]) : "_") << "\t"
+                      << (par_engine != nullptr ? batch_deprels[b][i] : "_") << "\t_\t_\n";
+          }
+          std::cout << "\n";
+        }
+        batch_texts.clear();
+        batch_sent_ids.clear();
+        batch_tokens.clear();
+        batch_postags.clear();
+      };
 
-            if (pos_engine != nullptr) {
-              pos_engine->postag(tokens, postags);
+      twpipe::StringPiece line;
+      std::string buffer;
+      while (reader.next_line(line)) {
+        {
+          twpipe::ScopedTimer input_timer(twpipe::Profiler::kInput);
+          twpipe::Profiler::get()->tick();
+          buffer.assign(line.data, line.size);
+          if (seg_tok_engine != nullptr) {
+            std::vector<std::vector<std::string>> sentences;
+            {
+              twpipe::ScopedTimer timer(twpipe::Profiler::kTokenize);
+              seg_tok_engine->sentsegment_and_tokenize(buffer, sentences);
             }
-            if (par_engine != nullptr) {
-              par_engine->predict(tokens, postags, heads, deprels);
+
+            for (unsigned s = 0; s < sentences.size(); ++s) {
+              twpipe::Profiler::get()->count(twpipe::Profiler::kSentences);
+              twpipe::Profiler::get()->count(twpipe::Profiler::kTokens, sentences[s].size());
+
+              batch_postags.emplace_back();
+              if (pos_engine != nullptr) {
+                twpipe::ScopedTimer timer(twpipe::Profiler::kPostag);
+                pos_engine->postag(sentences[s], batch_postags.back());
+              }
+              batch_texts.push_back(s == 0 ? buffer : std::string());
+              batch_sent_ids.push_back(s + 1);
+              batch_tokens.push_back(std::move(sentences[s]));
             }
-            if (s == 0) {
-              std::cout << "# text = " << buffer << "\n";
+          } else if (tok_engine != nullptr) {
+            std::vector<std::string> tokens;
+            {
+              twpipe::ScopedTimer timer(twpipe::Profiler::kTokenize);
+              tok_engine->tokenize(buffer, tokens);
             }
-            std::cout << "# sent_id = " << s + 1 << "\n";
+            twpipe::Profiler::get()->count(twpipe::Profiler::kSentences);
+            twpipe::Profiler::get()->count(twpipe::Profiler::kTokens, tokens.size());
+
+            twpipe::ScopedTimer timer(twpipe::Profiler::kOutput);
+            std::cout << "# text = " << buffer << "\n";
             for (unsigned i = 0; i < tokens.size(); ++i) {
-              std::cout << i + 1 << "\t" << tokens[i] << "\t_\t"
-                        << (pos_engine != nullptr ? postags[i] : "_") << "\t_\t_\t"
-                        << (par_engine != nullptr ? std::to_string(heads[i]) : "_") << "\t"
-                        << (par_engine != nullptr ? deprels[i] : "_") << "\t_\t_\n";
+              std::cout << i + 1 << "\t" << tokens[i] << "\t_\t_\t_\t_\t_\t_\t_\t_\n";
             }
             std::cout << "\n";
           }
-        } else if (tok_engine != nullptr) {
-          std::vector<std::string> tokens;
-          tok_engine->tokenize(buffer, tokens);
-
-          std::cout << "# text = " << buffer << "\n";
-          for (unsigned i = 0; i < tokens.size(); ++i) {
-            std::cout << i + 1 << "\t" << tokens[i] << "\t_\t_\t_\t_\t_\t_\t_\t_\n";
-          }
-          std::cout << "\n";
+        }
+        if (batch_tokens.size() >= batch_size) { flush_batch(); }
+        if (!reader.has_buffered_line()) {
+          flush_batch();
+          std::cout.flush();
         }
       }
+      flush_batch();
     } else {
       // for conll format, tokenization is impossible.
       twpipe::PostagModel * pos_engine = nullptr;
@@ -316,34 +391,44 @@ int main(int argc, char* argv[]) {
   
       std::vector<std::string> tokens;
       std::vector<std::string> postags, gold_postags;
-      std::vector<unsigned> heads, gold_heads;
-      std::vector<std::string> deprels, gold_deprels;
+      std::vector<unsigned> gold_heads;
+      std::vector<std::string> gold_deprels;
       std::string sentence;
       std::string header;
-      std::string buffer;
-      std::ifstream ifs(conf["input-file"].as<std::string>());
+      twpipe::StringPiece buffer;
+      std::vector<twpipe::StringPiece> data;
+      twpipe::InputReader reader;
+      if (!reader.open(conf["input-file"].as<std::string>())) {
+        _ERROR << "[twpipe] failed to open " << conf["input-file"].as<std::string>();
+        exit(1);
+      }
       float n_pos_corr = 0.f;
       float n_uas_corr = 0.f;
       float n_las_corr = 0.f;
       float n_total = 0.f;
-      while (std::getline(ifs, buffer)) {
-        boost::algorithm::trim(buffer);
-        if (buffer.empty()) {
-          if (pos_engine != nullptr) {
-            pos_engine->postag(tokens, postags);
-          } else {
-            postags.resize(gold_postags.size());
-            for (unsigned i = 0; i < gold_postags.size(); ++i) {
-              postags[i] = gold_postags[i];
-            }
-          }
-          if (par_engine != nullptr) {
-            par_engine->predict(tokens, postags, heads, deprels);
-          }
 
-          boost::algorithm::trim(header);
-          if (!header.empty()) {
-            std::cout << header << "\n";
+      // the sentences are parsed in batches, the gold annotations are kept
+      // with them for the output and the evaluation. As for the plain input,
+      // a batch is flushed early when the next line isn't read yet.
+      unsigned batch_size = (par_engine != nullptr ? std::max(conf["parse-batch-size"].as<unsigned>(), 1u) : 1);
+      std::vector<std::string> batch_headers;
+      std::vector<std::vector<std::string>> batch_tokens, batch_postags, batch_gold_postags;
+      std::vector<std::vector<unsigned>> batch_heads, batch_gold_heads;
+      std::vector<std::vector<std::string>> batch_deprels, batch_gold_deprels;
+      auto flush_batch = [&]() {
+        if (batch_tokens.empty()) { return; }
+        if (par_engine != nullptr) {
+          twpipe::ScopedTimer timer(twpipe::Profiler::kParse, batch_tokens.size());
+          par_engine->predict_batch(batch_tokens, batch_postags, batch_heads, batch_deprels);
+        }
+
+        twpipe::ScopedTimer timer(twpipe::Profiler::kOutput, batch_tokens.size());
+        for (unsigned b = 0; b < batch_tokens.size(); ++b) {
+          const std::vector<std::string> & tokens = batch_tokens[b];
+          const std::vector<std::string> & postags = batch_postags[b];
+          const std::vector<std::string> & gold_postags = batch_gold_postags[b];
+          if (!batch_headers[b].empty()) {
+            std::cout << batch_headers[b] << "\n";
           }
           for (unsigned i = 0; i < tokens.size(); ++i) {
             std::cout << i + 1 << "\t" << tokens[i] << "\t_\t";
@@ -355,43 +440,83 @@ int main(int argc, char* argv[]) {
             if (par_engine == nullptr) {
               std::cout << "_\t_\t_\t_\n";
             } else {
-              std::cout << heads[i] << "\t" << deprels[i] << "\t_\t_\n";
+              std::cout << batch_heads[b][i] << "\t" << batch_deprels[b][i] << "\t_\t_\n";
             }
             if (load_postag_model && postags[i] == gold_postags[i]) {
               n_pos_corr += 1.;
             }
-            if (load_parse_model && heads[i] == gold_heads[i]) {
-              n_uas_corr += 1.; 
-              if (deprels[i] == gold_deprels[i]) { n_las_corr += 1.; }
+            if (load_parse_model && batch_heads[b][i] == batch_gold_heads[b][i]) {
+              n_uas_corr += 1.;
+              if (batch_deprels[b][i] == batch_gold_deprels[b][i]) { n_las_corr += 1.; }
             }
             n_total += 1.;
           }
           std::cout << "\n";
+        }
+        batch_headers.clear();
+        batch_tokens.clear();
+        batch_postags.clear();
+        batch_gold_postags.clear();
+        batch_gold_heads.clear();
+        batch_gold_deprels.clear();
+      };
+
+      while (reader.next_line(buffer)) {
+        if (buffer.empty()) {
+          {
+            twpipe::ScopedTimer input_timer(twpipe::Profiler::kInput);
+            twpipe::Profiler::get()->tick();
+            twpipe::Profiler::get()->count(twpipe::Profiler::kSentences);
+            twpipe::Profiler::get()->count(twpipe::Profiler::kTokens, tokens.size());
+            if (pos_engine != nullptr) {
+              twpipe::ScopedTimer timer(twpipe::Profiler::kPostag);
+              pos_engine->postag(tokens, postags);
+            } else {
+              postags.resize(gold_postags.size());
+              for (unsigned i = 0; i < gold_postags.size(); ++i) {
+                postags[i] = gold_postags[i];
+              }
+            }
 
-          tokens.clear();
-          header = "";
-          if (load_postag_model || load_parse_model) {
-            postags.clear(); gold_postags.clear();
+            boost::algorithm::trim(header);
+            batch_headers.push_back(header);
+            batch_tokens.push_back(std::move(tokens));
+            batch_postags.push_back(std::move(postags));
+            batch_gold_postags.push_back(std::move(gold_postags));
+            batch_gold_heads.push_back(std::move(gold_heads));
+            batch_gold_deprels.push_back(std::move(gold_deprels));
           }
-          if (load_parse_model) {
-            heads.clear(); gold_heads.clear();
-            deprels.clear(); gold_deprels.clear();
+          if (batch_tokens.size() >= batch_size) { flush_batch(); }
+          if (!reader.has_buffered_line()) {
+            flush_batch();
+            std::cout.flush();
           }
+
+          tokens.clear();
+          header = "";
+          postags.clear(); gold_postags.clear();
+          gold_heads.clear(); gold_deprels.clear();
         } else if (buffer[0] == '#') {
-          header += "\n" + buffer;
+          header += "\n";
+          header.append(buffer.data, buffer.size);
         } else {
-          std::vector<std::string> data;
-          boost::algorithm::split(data, buffer, boost::is_any_of("\t "));
-          tokens.push_back(data[1]);
+          twpipe::InputReader::split_fields(buffer, data);
+          tokens.push_back(data[1].str());
           if (load_postag_model || load_parse_model) {
-            gold_postags.push_back(data[3]);
+            gold_postags.push_back(data[3].str());
           }
           if (load_parse_model) {
-            gold_heads.push_back(data[6] == "_" ? 0 : boost::lexical_cast<unsigned>(data[6]));
-            gold_deprels.push_back(data[7]);
+            unsigned head = 0;
+            if (data[6] != "_" && !data[6].to_unsigned(head)) {
+              _ERROR << "[twpipe] malformed head \"" << data[6] << "\" in line: " << buffer;
+              exit(1);
+            }
+            gold_heads.push_back(head);
+            gold_deprels.push_back(data[7].str());
           }
         }
       }
+      flush_batch();
       if (load_postag_model) {
         _INFO << "[evaluate] postag accuracy: " << n_pos_corr / n_total;
       }
@@ -400,6 +525,7 @@ int main(int argc, char* argv[]) {
         _INFO << "[evaluate] LAS accuracy: " << n_las_corr / n_total;
       }
     }
+    twpipe::Profiler::get()->report();
   }
   return 0;
 }
@@ -0,0 +1,289 @@
+#include "allreduce.h"
+#include "logging.h"
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#if !_MSC_VER
+#include <pthread.h>
+#include <sys/mman.h>
+#endif
+
+namespace twpipe {
+
+namespace {
+
+size_t align(size_t offset) {
+  return (offset + 63) / 64 * 64;
+}
+
+}
+
+AllReduceRunner::AllReduceRunner(unsigned n_workers, dynet::ParameterCollection & model) :
+  n_workers(n_workers), n_dense(0), n_floats(0), n_rows(0), memory(nullptr), size(0) {
+#if _MSC_VER
+  if (n_workers > 1) {
+    _WARN << "[twpipe|allreduce] not supported on this platform, train in one process.";
+    this->n_workers = 1;
+  }
+#else
+  if (n_workers <= 1) { return; }
+
+  for (auto & p : model.parameters_list()) {
+    dense.push_back(p.get());
+    dense_offsets.push_back(n_floats);
+    n_floats += p->g.d.size();
+  }
+  n_dense = n_floats;
+  for (auto & p : model.lookup_parameters_list()) {
+    lookups.push_back(p.get());
+    lookup_offsets.push_back(n_floats);
+    row_offsets.push_back(n_rows);
+    n_floats += p->all_grads.d.size();
+    n_rows += p->values.size();
+  }
+
+  size_t n_flags = 1 + lookups.size();
+  size_t barrier_offset = 0;
+  size_t stats_offset = align(barrier_offset + sizeof(pthread_barrier_t));
+  size_t slots_offset = align(stats_offset + n_workers * sizeof(WorkerStat));
+  size_t slot_rows_offset = align(slots_offset + n_workers * n_floats * sizeof(float));
+  size_t slot_flags_offset = align(slot_rows_offset + n_workers * n_rows);
+  size_t result_offset = align(slot_flags_offset + n_workers * n_flags);
+  size_t result_rows_offset = align(result_offset + n_floats * sizeof(float));
+  size_t result_flags_offset = align(result_rows_offset + n_rows);
+  size = align(result_flags_offset + n_flags);
+
+  void * ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    _WARN << "[twpipe|allreduce] failed to map " << size << " bytes, train in one process.";
+    this->n_workers = 1;
+    size = 0;
+    return;
+  }
+  memory = static_cast<char *>(ptr);
+  barrier = memory + barrier_offset;
+  stats = reinterpret_cast<WorkerStat *>(memory + stats_offset);
+  slots = reinterpret_cast<float *>(memory + slots_offset);
+  slot_rows = memory + slot_rows_offset;
+  slot_flags = memory + slot_flags_offset;
+  result = reinterpret_cast<float *>(memory + result_offset);
+  result_rows = memory + result_rows_offset;
+  result_flags = memory + result_flags_offset;
+
+  pthread_barrierattr_t attr;
+  pthread_barrierattr_init(&attr);
+  pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  int ret = pthread_barrier_init(static_cast<pthread_barrier_t *>(barrier), &attr, n_workers);
+  pthread_barrierattr_destroy(&attr);
+  if (ret != 0) {
+    _WARN << "[twpipe|allreduce] failed to create the barrier, train in one process.";
+    munmap(memory, size);
+    memory = nullptr;
+    size = 0;
+    this->n_workers = 1;
+    return;
+  }
+  _INFO << "[twpipe|allreduce] training with " << n_workers << " worker processes, "
+    << n_floats << " gradients are averaged in each step.";
+#endif
+}
+
+AllReduceRunner::~AllReduceRunner() {
+#if !_MSC_VER
+  if (memory != nullptr) {
+    pthread_barrier_destroy(static_cast<pthread_barrier_t *>(barrier));
+    munmap(memory, size);
+  }
+#endif
+}
+
+bool AllReduceRunner::enabled() const {
+  return n_workers > 1;
+}
+
+void AllReduceRunner::publish(unsigned k, bool has_batch) {
+  char * flags = slot_flags + k * (1 + lookups.size());
+  flags[0] = has_batch;
+  if (!has_batch) { return; }
+
+  float * slot = slots + k * n_floats;
+  for (unsigned i = 0; i < dense.size(); ++i) {
+    const dynet::Tensor & g = dense[i]->g;
+    std::memcpy(slot + dense_offsets[i], g.v, g.d.size() * sizeof(float));
+  }
+  for (unsigned i = 0; i < lookups.size(); ++i) {
+    dynet::LookupParameterStorage * p = lookups[i];
+    char * rows = slot_rows + k * n_rows + row_offsets[i];
+    float * grads = slot + lookup_offsets[i];
+    size_t n = p->values.size();
+    size_t row_size = p->dim.size();
+    flags[1 + i] = p->all_updated;
+    if (p->all_updated) {
+      std::memcpy(grads, p->all_grads.v, n * row_size * sizeof(float));
+      std::memset(rows, 1, n);
+    } else {
+      // only the rows touched by the batch are copied.
+      std::memset(rows, 0, n);
+      for (unsigned r : p->non_zero_grads) {
+        std::memcpy(grads + r * row_size, p->grads[r].v, row_size * sizeof(float));
+        rows[r] = 1;
+      }
+    }
+  }
+}
+
+void AllReduceRunner::reduce(unsigned k, unsigned n_batches) {
+  size_t n_flags = 1 + lookups.size();
+  float scale = 1.f / n_batches;
+  std::vector<unsigned> workers;
+  for (unsigned w = 0; w < n_workers; ++w) {
+    if (slot_flags[w * n_flags]) { workers.push_back(w); }
+  }
+
+  // the workers are always summed in the same order.
+  size_t begin = n_dense * k / n_workers;
+  size_t end = n_dense * (k + 1) / n_workers;
+  std::fill(result + begin, result + end, 0.f);
+  for (unsigned w : workers) {
+    const float * slot = slots + w * n_floats;
+    for (size_t x = begin; x < end; ++x) { result[x] += slot[x]; }
+  }
+  for (size_t x = begin; x < end; ++x) { result[x] *= scale; }
+
+  for (unsigned i = 0; i < lookups.size(); ++i) {
+    if (i % n_workers == k) {
+      result_flags[1 + i] = 0;
+      for (unsigned w : workers) {
+        if (slot_flags[w * n_flags + 1 + i]) { result_flags[1 + i] = 1; }
+      }
+    }
+    size_t n = lookups[i]->values.size();
+    size_t row_size = lookups[i]->dim.size();
+    size_t first = (k + n_workers - row_offsets[i] % n_workers) % n_workers;
+    for (size_t r = first; r < n; r += n_workers) {
+      float * out = result + lookup_offsets[i] + r * row_size;
+      bool updated = false;
+      for (unsigned w : workers) {
+        if (!slot_rows[w * n_rows + row_offsets[i] + r]) { continue; }
+        const float * in = slots + w * n_floats + lookup_offsets[i] + r * row_size;
+        if (!updated) {
+          std::memcpy(out, in, row_size * sizeof(float));
+        } else {
+          for (size_t x = 0; x < row_size; ++x) { out[x] += in[x]; }
+        }
+        updated = true;
+      }
+      if (updated) {
+        for (size_t x = 0; x < row_size; ++x) { out[x] *= scale; }
+      }
+      result_rows[row_offsets[i] + r] = updated;
+    }
+  }
+}
+
+void AllReduceRunner::collect() {
+  // accumulate_grad() keeps the bookkeeping of dynet, so the trainer updates
+  // the same rows in every worker.
+  for (unsigned i = 0; i < dense.size(); ++i) {
+    dynet::ParameterStorage * p = dense[i];
+    p->clear();
+    p->accumulate_grad(dynet::Tensor(p->g.d, result + dense_offsets[i], p->g.device, dynet::DeviceMempool::NONE));
+  }
+  for (unsigned i = 0; i < lookups.size(); ++i) {
+    dynet::LookupParameterStorage * p = lookups[i];
+    p->clear();
+    float * grads = result + lookup_offsets[i];
+    if (result_flags[1 + i]) {
+      p->accumulate_grad(dynet::Tensor(p->all_grads.d, grads, p->all_grads.device, dynet::DeviceMempool::NONE));
+      continue;
+    }
+    size_t n = p->values.size();
+    size_t row_size = p->dim.size();
+    for (unsigned r = 0; r < n; ++r) {
+      if (!result_rows[row_offsets[i] + r]) { continue; }
+      p->accumulate_grad(r, dynet::Tensor(p->dim, grads + r * row_size, p->all_grads.device, dynet::DeviceMempool::NONE));
+    }
+  }
+}
+
+void AllReduceRunner::export_values() {
+  for (unsigned i = 0; i < dense.size(); ++i) {
+    const dynet::Tensor & v = dense[i]->values;
+    std::memcpy(result + dense_offsets[i], v.v, v.d.size() * sizeof(float));
+  }
+  for (unsigned i = 0; i < lookups.size(); ++i) {
+    const dynet::Tensor & v = lookups[i]->all_values;
+    std::memcpy(result + lookup_offsets[i], v.v, v.d.size() * sizeof(float));
+  }
+}
+
+void AllReduceRunner::import_values() {
+  for (unsigned i = 0; i < dense.size(); ++i) {
+    dynet::Tensor & v = dense[i]->values;
+    std::memcpy(v.v, result + dense_offsets[i], v.d.size() * sizeof(float));
+  }
+  for (unsigned i = 0; i < lookups.size(); ++i) {
+    dynet::Tensor & v = lookups[i]->all_values;
+    std::memcpy(v.v, result + lookup_offsets[i], v.d.size() * sizeof(float));
+  }
+}
+
+float AllReduceRunner::run(const std::vector<std::vector<unsigned>> & batches,
+                           const Step & step,
+                           dynet::Trainer & trainer) {
+  float loss = 0.f;
+#if _MSC_VER
+  for (const std::vector<unsigned> & batch : batches) { loss += step(batch); trainer.update(); }
+#else
+  if (has_optimizer_state(trainer)) {
+    _ERROR << "[twpipe|allreduce] the optimizer state of the workers is lost after each epoch, "
+      << "use --optimizer simple_sgd with --workers.";
+    exit(1);
+  }
+  std::memset(stats, 0, n_workers * sizeof(WorkerStat));
+  unsigned n_steps = (batches.size() + n_workers - 1) / n_workers;
+  pthread_barrier_t * sync = static_cast<pthread_barrier_t *>(barrier);
+
+  auto start = std::chrono::steady_clock::now();
+  bool ok = fork_workers(n_workers, [&](unsigned k) {
+    WorkerStat & stat = stats[k];
+    for (unsigned t = 0; t < n_steps; ++t) {
+      unsigned i = t * n_workers + k;
+      bool has_batch = (i < batches.size());
+      if (has_batch) {
+        stat.loss += step(batches[i]);
+        stat.n_batches++;
+        stat.n_instances += batches[i].size();
+      }
+      publish(k, has_batch);
+      pthread_barrier_wait(sync);
+      reduce(k, std::min<unsigned>(n_workers, batches.size() - t * n_workers));
+      pthread_barrier_wait(sync);
+      collect();
+      // every worker runs the same update, so the replicas stay identical.
+      trainer.update();
+    }
+    if (k == 0) { export_values(); }
+    stat.done = 1;
+  });
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  unsigned n_instances = 0;
+  for (unsigned k = 0; k < n_workers; ++k) {
+    if (!stats[k].done) { ok = false; }
+    loss += stats[k].loss;
+    n_instances += stats[k].n_instances;
+  }
+  if (!ok) {
+    _ERROR << "[twpipe|allreduce] a worker failed.";
+    exit(1);
+  }
+  import_values();
+  _INFO << "[twpipe|allreduce] " << n_instances << " instances in " << n_steps << " steps, "
+    << seconds << "s, " << (seconds > 0 ? n_instances / seconds : 0.) << " instances/s.";
+#endif
+  return loss;
+}
+
+}
@@ -0,0 +1,87 @@
+#ifndef __TWPIPE_ALLREDUCE_H__
+#define __TWPIPE_ALLREDUCE_H__
+
+#include <vector>
+#include <functional>
+#include "dynet/model.h"
+#include "dynet/training.h"
+#include "hogwild.h"
+
+namespace twpipe {
+
+/// Synchronous data-parallel training: the forked workers hold replicas of
+/// the model and each takes one batch per step. Before every update, the
+/// gradients are averaged over the workers through shared memory, so the
+/// replicas stay identical. Worker k reduces the k-th part of the gradients
+/// (reduce-scatter) and every worker reads all the parts back (all-gather),
+/// the workers meet at a process-shared barrier between the phases. The
+/// summation order is fixed, so the result only depends on the seed and the
+/// number of workers. Only the weights are copied back after an epoch, so
+/// the trainers with an optimizer state are rejected.
+struct AllReduceRunner {
+  typedef HogwildRunner::Step Step;
+
+  unsigned n_workers;
+
+  AllReduceRunner(unsigned n_workers, dynet::ParameterCollection & model);
+
+  ~AllReduceRunner();
+
+  bool enabled() const;
+
+  /// Run the step on the batches, step t takes the batches t * n .. t * n + n - 1.
+  /// Return the sum of the losses, the parameters of the first worker are
+  /// copied back to the model at the end.
+  float run(const std::vector<std::vector<unsigned>> & batches,
+            const Step & step,
+            dynet::Trainer & trainer);
+
+private:
+  AllReduceRunner(const AllReduceRunner &);
+  AllReduceRunner & operator = (const AllReduceRunner &);
+
+  /// Copy the gradients of the worker into its slot.
+  void publish(unsigned k, bool has_batch);
+
+  /// Average the k-th part of the slots of the workers that have a batch.
+  void reduce(unsigned k, unsigned n_batches);
+
+  /// Replace the local gradients with the averaged ones.
+  void collect();
+
+  void export_values();
+
+  void import_values();
+
+  std::vector<dynet::ParameterStorage *> dense;
+  std::vector<dynet::LookupParameterStorage *> lookups;
+  /// The offsets of the parameters in a slot, in floats, the lookup
+  /// parameters follow the dense ones.
+  std::vector<size_t> dense_offsets;
+  std::vector<size_t> lookup_offsets;
+  /// The index of the first row of each lookup parameter.
+  std::vector<size_t> row_offsets;
+  size_t n_dense;
+  size_t n_floats;
+  size_t n_rows;
+
+  char * memory;
+  size_t size;
+  void * barrier;
+  WorkerStat * stats;
+  /// The gradients of each worker.
+  float * slots;
+  /// Whether the rows of the lookup parameters are updated, for each worker.
+  char * slot_rows;
+  /// For each worker, whether it has a batch, followed by the all_updated
+  /// flags of the lookup parameters.
+  char * slot_flags;
+  /// The averaged gradients, also used to return the parameters.
+  float * result;
+  char * result_rows;
+  char * result_flags;
+};
+
+}
+
+#endif  //  end for __TWPIPE_ALLREDUCE_H__
@@ -0,0 +1,92 @@
+#include "checkpoint.h"
+#include "logging.h"
+#include <cstdio>
+
+namespace twpipe {
+
+Checkpointer * Checkpointer::instance = nullptr;
+
+Checkpointer::Checkpointer() : n_keep(0), n_saved(0), pending(false), busy(false) {
+}
+
+po::options_description Checkpointer::get_options() {
+  po::options_description checkpoint_opts("Checkpoint options");
+  checkpoint_opts.add_options()
+    ("checkpoint-keep", po::value<unsigned>()->default_value(0), "the number of rotating checkpoints of the best model kept beside the model file.")
+    ;
+  return checkpoint_opts;
+}
+
+Checkpointer * Checkpointer::get() {
+  if (instance == nullptr) {
+    instance = new Checkpointer();
+  }
+  return instance;
+}
+
+void Checkpointer::configure(const std::string & model_name, unsigned n_keep) {
+  wait();
+  this->model_name = model_name;
+  this->n_keep = n_keep;
+}
+
+void Checkpointer::save(const std::string & phase_name, dynet::ParameterCollection & model) {
+  // the training only stalls for the copy.
+  ParameterSnapshot snapshot;
+  snapshot.take(model);
+
+  std::lock_guard<std::mutex> lock(mtx);
+  if (!worker.joinable()) {
+    worker = std::thread(&Checkpointer::run, this);
+  }
+  pending_phase_name = phase_name;
+  std::swap(pending_snapshot, snapshot);
+  pending = true;
+  cv.notify_all();
+}
+
+void Checkpointer::wait() {
+  std::unique_lock<std::mutex> lock(mtx);
+  cv.wait(lock, [this]() { return !pending && !busy; });
+}
+
+void Checkpointer::run() {
+  for (;;) {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this]() { return pending; });
+    std::string phase_name;
+    ParameterSnapshot snapshot;
+    std::swap(phase_name, pending_phase_name);
+    std::swap(snapshot, pending_snapshot);
+    pending = false;
+    busy = true;
+    lock.unlock();
+
+    write(phase_name, snapshot);
+
+    lock.lock();
+    busy = false;
+    cv.notify_all();
+  }
+}
+
+void Checkpointer::write(const std::string & phase_name, const ParameterSnapshot & snapshot) {
+  Model::get()->to_json(phase_name, snapshot);
+  if (n_keep == 0 || model_name.empty()) { return; }
+
+  std::string path = model_name + ".ckpt." + std::to_string(++n_saved);
+  std::string tmp_path = path + ".tmp";
+  Model::get()->save(tmp_path);
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    _WARN << "[twpipe|checkpoint] failed to write " << path;
+    return;
+  }
+  _INFO << "[twpipe|checkpoint] saved to " << path;
+  checkpoints.push_back(path);
+  while (checkpoints.size() > n_keep) {
+    std::remove(checkpoints.front().c_str());
+    checkpoints.pop_front();
+  }
+}
+
+}
@@ -0,0 +1,58 @@
+#ifndef __TWPIPE_CHECKPOINT_H__
+#define __TWPIPE_CHECKPOINT_H__
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <boost/program_options.hpp>
+#include "model.h"
+
+namespace po = boost::program_options;
+
+namespace twpipe {
+
+/// Save the best models off the training thread. save() only copies the
+/// parameters, a background thread puts the copy into the model payload and
+/// writes the rotating checkpoints <model>.ckpt.<n>, keeping the last
+/// checkpoint-keep ones.
+struct Checkpointer {
+protected:
+  static Checkpointer * instance;
+  std::string model_name;
+  unsigned n_keep;
+  unsigned n_saved;
+  std::deque<std::string> checkpoints;
+
+  std::thread worker;
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool pending;
+  bool busy;
+  std::string pending_phase_name;
+  ParameterSnapshot pending_snapshot;
+
+  Checkpointer();
+
+  void run();
+
+  void write(const std::string & phase_name, const ParameterSnapshot & snapshot);
+
+public:
+  static po::options_description get_options();
+
+  static Checkpointer * get();
+
+  void configure(const std::string & model_name, unsigned n_keep);
+
+  /// Snapshot the parameters and save them in the background. A snapshot that
+  /// is not written yet is replaced by the newer one.
+  void save(const std::string & phase_name, dynet::ParameterCollection & model);
+
+  /// Block until the saved snapshots are in the model payload.
+  void wait();
+};
+
+}
+
+#endif  //  end for __TWPIPE_CHECKPOINT_H__
@@ -4,7 +4,16 @@
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <cstring>
+#include <cctype>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include <iterator>
 #include "logging.h"
+#include "mapped_file.h"
+#include "corpus_cache.h"
 #include <boost/assert.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
@@ -18,6 +27,44 @@ const char* Corpus::SPACE = " ";
 const unsigned Corpus::BAD_HED = 10000;
 const unsigned Corpus::BAD_DEL = 10000;
 
+void InputUnits::clear() {
+  units.clear();
+  text.clear();
+  chars.clear();
+}
+
+void InputUnits::push_back(const InputUnit & unit,
+                           const CharRange & word,
+                           const CharRange & lemma,
+                           const CharRange & postag,
+                           const CharRange & feature) {
+  units.push_back(unit);
+  InputUnit & back = units.back();
+  const CharRange * ranges[] = { &word, &lemma, &postag, &feature };
+  for (unsigned k = 0; k < 4; ++k) {
+    back.fields[k] = text.size();
+    text.append(ranges[k]->first, ranges[k]->second);
+  }
+  back.fields[4] = text.size();
+  back.chars_begin = back.chars_end = chars.size();
+}
+
+void InputUnits::push_char(unsigned cid) {
+  chars.push_back(cid);
+  units.back().chars_end = chars.size();
+}
+
+CharIds InputUnits::cids(size_t i) const {
+  const InputUnit & unit = units[i];
+  CharIds ret = { chars.data() + unit.chars_begin, unit.chars_end - unit.chars_begin };
+  return ret;
+}
+
+std::string InputUnits::field(size_t i, unsigned k) const {
+  const InputUnit & unit = units[i];
+  return text.substr(unit.fields[k], unit.fields[k + 1] - unit.fields[k]);
+}
+
 void Corpus::parse_units_to_vector(const ParseUnits& parse,
                                    std::vector<unsigned>& heads,
                                    std::vector<unsigned>& deprels) {
@@ -62,14 +109,11 @@ void Corpus::vector_to_input_units(const std::vector<std::string>& words,
   Alphabet & pos_map = AlphabetCollection::get()->pos_map;
 
   InputUnit unit;
+  CharRange root(Corpus::ROOT, Corpus::ROOT + std::strlen(Corpus::ROOT));
   unit.wid = word_map.get(Corpus::ROOT);
   unit.pid = pos_map.get(Corpus::ROOT);
   unit.aux_wid = unit.wid;
-  unit.word = Corpus::ROOT;
-  unit.postag = Corpus::ROOT;
-  unit.lemma = Corpus::ROOT;
-  unit.feature = Corpus::ROOT;
-  units.push_back(unit);
+  units.push_back(unit, root, root, root, root);
 
   for (unsigned i = 0; i < words.size(); ++i) {
     const std::string & word = words[i];
@@ -78,20 +122,19 @@ void Corpus::vector_to_input_units(const std::vector<std::string>& words,
     unit.wid = (word_map.contains(word) ? word_map.get(word) : word_map.get(Corpus::UNK));
     unit.pid = pos_map.get(postag);
     unit.aux_wid = unit.wid;
-    unit.word = word;
-    unit.postag = postag;
+    units.push_back(unit,
+                    CharRange(word.data(), word.data() + word.size()),
+                    root,
+                    CharRange(postag.data(), postag.data() + postag.size()),
+                    root);
 
     unsigned cur = 0;
-    unit.cids.clear();
     while (cur < word.size()) {
       unsigned len = utf8_len(word[cur]);
       std::string ch_str = word.substr(cur, len);
-      unit.cids.push_back(
-        char_map.contains(ch_str) ? char_map.get(ch_str) : char_map.get(Corpus::UNK)
-      );
+      units.push_char(char_map.contains(ch_str) ? char_map.get(ch_str) : char_map.get(Corpus::UNK));
       cur += len;
     }
-    units.push_back(unit);
   }
 }
 
@@ -115,7 +158,27 @@ void Corpus::parse_units_to_vector(const ParseUnits & units,
 
 Corpus::Corpus() :
   n_train(0),
-  n_devel(0) {
+  n_devel(0),
+  n_threads(std::max(1u, std::thread::hardware_concurrency())),
+  training_key(0) {
+}
+
+Corpus::Corpus(const po::variables_map & conf) : Corpus() {
+  if (conf.count("corpus-threads") && conf["corpus-threads"].as<unsigned>() > 0) {
+    n_threads = conf["corpus-threads"].as<unsigned>();
+  }
+  if (conf.count("corpus-cache-dir")) {
+    cache_dir = conf["corpus-cache-dir"].as<std::string>();
+  }
+}
+
+po::options_description Corpus::get_options() {
+  po::options_description cmd("Corpus options");
+  cmd.add_options()
+    ("corpus-threads", po::value<unsigned>()->default_value(0), "the number of threads to parse the corpus, 0 for all the cores.")
+    ("corpus-cache-dir", po::value<std::string>(), "the directory to cache the parsed corpus, re-parsed when the file changes.")
+    ;
+  return cmd;
 }
 
 void Corpus::load_training_data(const std::string& filename) {
@@ -136,30 +199,8 @@ void Corpus::load_training_data(const std::string& filename) {
 
   pos_map.insert(Corpus::ROOT);
 
-  std::ifstream in(filename);
-  if (!in) {
-    _ERROR << "[corpus] failed to open the training file.";
-    exit(1);
-  }
-
-  n_train = 0;
-  std::string data = "";
-  std::string line;
-  while (std::getline(in, line)) {
-    boost::algorithm::trim(line);
-    if (line.size() == 0) {
-      // end for an instance.
-      parse_data(data, training_data[n_train], true);
-      data = "";
-      ++n_train;
-    } else {
-      data += (line + "\n");
-    }
-  }
-  if (data.size() > 0) {
-    parse_data(data, training_data[n_train], true);
-    ++n_train;
-  }
+  load_data(filename, training_data, true);
+  n_train = training_data.size();
 
   _INFO << "[corpus] loaded " << n_train << " training sentences.";
 }
@@ -172,31 +213,223 @@ void Corpus::load_devel_data(const std::string& filename) {
   BOOST_ASSERT_MSG(word_map.size() > 1,
                    "[corpus] BAD0 and UNK should be inserted before loading devel data.");
 
-  std::ifstream in(filename);
-  if (!in) {
-    _ERROR << "[corpus] failed to open the devel file.";
+  load_data(filename, devel_data, false);
+  n_devel = devel_data.size();
+
+  _INFO << "[corpus] loaded " << n_devel << " development sentences.";
+}
+
+namespace {
+
+/// Trim the spaces at both ends of [begin, end).
+void trim(const char * & begin, const char * & end) {
+  while (begin < end && std::isspace(static_cast<unsigned char>(*begin))) { ++begin; }
+  while (end > begin && std::isspace(static_cast<unsigned char>(*(end - 1)))) { --end; }
+}
+
+/// The chunks are not smaller than this, so small files are parsed in place.
+const size_t kMinChunkSize = 1 << 22;
+
+/// The beginning of the first line after a blank line at or after p.
+const char * next_sentence_boundary(const char * p, const char * end) {
+  // move to the beginning of a line.
+  const char * line_end = static_cast<const char *>(std::memchr(p, '\n', end - p));
+  if (line_end == nullptr) { return end; }
+  p = line_end + 1;
+  while (p < end) {
+    line_end = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    if (line_end == nullptr) { return end; }
+    const char * line_begin = p;
+    const char * line_last = line_end;
+    trim(line_begin, line_last);
+    p = line_end + 1;
+    if (line_begin == line_last) { return p; }
+  }
+  return end;
+}
+
+/// Remap the ids in [base, local.size()) to the ids in the global alphabet.
+/// The new entries are inserted in the order they were seen in the chunk.
+void merge_alphabet(Alphabet & global, const Alphabet & local, unsigned base,
+                    std::vector<unsigned> & mapping) {
+  mapping.resize(local.size() - base);
+  for (unsigned id = base; id < local.size(); ++id) {
+    mapping[id - base] = global.insert(local.get(id));
+  }
+}
+
+void remap(unsigned & id, const std::vector<unsigned> & mapping, unsigned base) {
+  if (id >= base) { id = mapping[id - base]; }
+}
+
+/// The alphabets of a chunk, the copies of the global ones when loading starts.
+struct ChunkAlphabets {
+  Alphabet word_map;
+  Alphabet char_map;
+  Alphabet pos_map;
+  Alphabet deprel_map;
+  unsigned word_base, char_base, pos_base, deprel_base;
+  bool train;
+  CorpusAlphabets alphabets;
+
+  ChunkAlphabets(AlphabetCollection & collection, bool train) :
+    deprel_map(collection.deprel_map),
+    deprel_base(collection.deprel_map.size()),
+    train(train),
+    alphabets({ train ? word_map : collection.word_map,
+                train ? char_map : collection.char_map,
+                train ? pos_map : collection.pos_map,
+                deprel_map }) {
+    if (train) {
+      word_map = collection.word_map;
+      char_map = collection.char_map;
+      pos_map = collection.pos_map;
+    }
+    word_base = collection.word_map.size();
+    char_base = collection.char_map.size();
+    pos_base = collection.pos_map.size();
+  }
+
+  void merge_into(AlphabetCollection & collection, std::vector<Instance> & data) {
+    std::vector<unsigned> word_mapping, char_mapping, pos_mapping, deprel_mapping;
+    merge_alphabet(collection.deprel_map, deprel_map, deprel_base, deprel_mapping);
+    if (train) {
+      merge_alphabet(collection.word_map, word_map, word_base, word_mapping);
+      merge_alphabet(collection.char_map, char_map, char_base, char_mapping);
+      merge_alphabet(collection.pos_map, pos_map, pos_base, pos_mapping);
+    }
+    for (Instance & inst : data) {
+      for (unsigned i = 1; i < inst.input_units.size(); ++i) {
+        InputUnit & unit = inst.input_units[i];
+        if (train) {
+          remap(unit.wid, word_mapping, word_base);
+          remap(unit.aux_wid, word_mapping, word_base);
+          remap(unit.pid, pos_mapping, pos_base);
+        }
+        remap(inst.parse_units[i].deprel, deprel_mapping, deprel_base);
+      }
+      // the pseudo root has no characters.
+      if (train) {
+        for (unsigned & cid : inst.input_units.chars) { remap(cid, char_mapping, char_base); }
+      }
+    }
+  }
+};
+
+}
+
+void Corpus::load_data(const std::string& filename,
+                       std::vector<Instance>& data,
+                       bool train) {
+  MappedFile file;
+  if (!file.open(filename)) {
+    _ERROR << "[corpus] failed to open " << filename;
     exit(1);
   }
 
-  n_devel = 0;
-  std::string data = "";
-  std::string line;
-  while (std::getline(in, line)) {
-    boost::algorithm::trim(line);
-    if (line.size() == 0) {
-      parse_data(data, devel_data[n_devel], false);
-      data = "";
-      ++n_devel;
+  AlphabetCollection * collection = AlphabetCollection::get();
+  CorpusAlphabets global_alphabets = { collection->word_map, collection->char_map,
+    collection->pos_map, collection->deprel_map };
+
+  data.clear();
+  if (!cache_dir.empty()) {
+    uint64_t key = CorpusCache::key(file.data, file.size, *collection);
+    std::string cache_path = CorpusCache::path(cache_dir, key);
+    if (train) { training_key = key; }
+    if (CorpusCache::load(cache_path, key, data, *collection)) {
+      _INFO << "[corpus] loaded from cache " << cache_path;
+      return;
+    }
+    load_data(file, data, train, global_alphabets);
+    if (CorpusCache::save(cache_path, key, data, *collection)) {
+      _INFO << "[corpus] cached to " << cache_path;
     } else {
-      data += (line + "\n");
+      _WARN << "[corpus] failed to write cache " << cache_path;
     }
+    return;
   }
-  if (data.size() > 0) {
-    parse_data(data, devel_data[n_devel], false);
-    ++n_devel;
+  load_data(file, data, train, global_alphabets);
+}
+
+void Corpus::load_data(const MappedFile & file,
+                       std::vector<Instance>& data,
+                       bool train,
+                       CorpusAlphabets & global_alphabets) {
+  AlphabetCollection * collection = AlphabetCollection::get();
+  const char * begin = file.data;
+  const char * end = file.data + file.size;
+  std::vector<const char *> bounds(1, begin);
+  unsigned n_chunks = std::min<size_t>(n_threads, file.size / kMinChunkSize);
+  for (unsigned c = 1; c < n_chunks; ++c) {
+    const char * bound = next_sentence_boundary(begin + file.size / n_chunks * c, end);
+    if (bound > bounds.back() && bound < end) { bounds.push_back(bound); }
   }
+  bounds.push_back(end);
+  n_chunks = bounds.size() - 1;
 
-  _INFO << "[corpus] loaded " << n_devel << " development sentences.";
+  if (n_chunks == 1) {
+    parse_block(begin, end, data, train, global_alphabets);
+    return;
+  }
+
+  // the word, char and postag alphabets are only read in devel, so only the
+  // alphabets that are inserted into are copied for each chunk.
+  std::vector<std::unique_ptr<ChunkAlphabets>> chunk_alphabets(n_chunks);
+  std::vector<std::vector<Instance>> chunk_data(n_chunks);
+  std::vector<std::thread> workers;
+  for (unsigned c = 0; c < n_chunks; ++c) {
+    chunk_alphabets[c].reset(new ChunkAlphabets(*collection, train));
+    workers.push_back(std::thread([this, c, &bounds, &chunk_data, &chunk_alphabets, train]() {
+      parse_block(bounds[c], bounds[c + 1], chunk_data[c], train, chunk_alphabets[c]->alphabets);
+    }));
+  }
+  for (auto & worker : workers) { worker.join(); }
+
+  unsigned n_instances = 0;
+  for (unsigned c = 0; c < n_chunks; ++c) { n_instances += chunk_data[c].size(); }
+  data.reserve(n_instances);
+  for (unsigned c = 0; c < n_chunks; ++c) {
+    chunk_alphabets[c]->merge_into(*collection, chunk_data[c]);
+    chunk_alphabets[c].reset();
+    std::move(chunk_data[c].begin(), chunk_data[c].end(), std::back_inserter(data));
+    std::vector<Instance>().swap(chunk_data[c]);
+  }
+  _INFO << "[corpus] parsed in " << n_chunks << " chunks.";
+}
+
+void Corpus::parse_block(const char * begin,
+                         const char * end,
+                         std::vector<Instance>& data,
+                         bool train,
+                         CorpusAlphabets & alphabets) {
+  const char * p = begin;
+  const char * block_begin = nullptr;
+  const char * block_end = nullptr;
+  while (p < end) {
+    const char * line_end = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    if (line_end == nullptr) { line_end = end; }
+    const char * line_begin = p;
+    const char * line_last = line_end;
+    trim(line_begin, line_last);
+    if (line_begin == line_last) {
+      // end for an instance.
+      data.emplace_back();
+      if (block_begin != nullptr) {
+        parse_data(block_begin, block_end, data.back(), train, alphabets);
+      } else {
+        parse_data(line_begin, line_begin, data.back(), train, alphabets);
+      }
+      block_begin = nullptr;
+    } else {
+      if (block_begin == nullptr) { block_begin = line_begin; }
+      block_end = line_end;
+    }
+    p = line_end + 1;
+  }
+  if (block_begin != nullptr) {
+    data.emplace_back();
+    parse_data(block_begin, block_end, data.back(), train, alphabets);
+  }
 }
 
 unsigned utf8_len(unsigned char x) {
@@ -225,97 +458,115 @@ char32_t utf8_to_unicode_first_(const std::string & s) {
 // id form lemma cpos pos feat head deprel phead pdeprel
 // 0  1    2     3    4   5    6     7     8     9
 void Corpus::parse_data(const std::string& data, Instance & inst, bool train) {
-  std::stringstream S(data);
-  std::string line;
+  AlphabetCollection * collection = AlphabetCollection::get();
+  CorpusAlphabets alphabets = { collection->word_map, collection->char_map,
+    collection->pos_map, collection->deprel_map };
+  parse_data(data.data(), data.data() + data.size(), inst, train, alphabets);
+}
 
+void Corpus::parse_data(const char * begin,
+                        const char * end,
+                        Instance & inst,
+                        bool train,
+                        CorpusAlphabets & alphabets) {
   inst.input_units.clear();
   inst.parse_units.clear();
 
   InputUnit input_unit;
   ParseUnit parse_unit;
 
-  Alphabet & word_map = AlphabetCollection::get()->word_map;
-  Alphabet & char_map = AlphabetCollection::get()->char_map;
-  Alphabet & pos_map = AlphabetCollection::get()->pos_map;
-  Alphabet & deprel_map = AlphabetCollection::get()->deprel_map;
+  Alphabet & word_map = alphabets.word_map;
+  Alphabet & char_map = alphabets.char_map;
+  Alphabet & pos_map = alphabets.pos_map;
+  Alphabet & deprel_map = alphabets.deprel_map;
 
   // dummy root at first.
+  CharRange root(ROOT, ROOT + std::strlen(ROOT));
   input_unit.wid = word_map.get(ROOT);
   input_unit.pid = pos_map.get(ROOT);
   input_unit.aux_wid = input_unit.wid;
-  input_unit.word = ROOT;
-  input_unit.postag = ROOT;
-  input_unit.lemma = ROOT;
-  input_unit.feature = ROOT;
-  inst.input_units.push_back(input_unit);
+  inst.input_units.push_back(input_unit, root, root, root, root);
 
   parse_unit.head = BAD_HED;
   parse_unit.deprel = BAD_DEL;
   inst.parse_units.push_back(parse_unit);
 
+  static const char * text_prefix = "# text = ";
+  static const size_t text_prefix_len = std::strlen(text_prefix);
+
   std::string guessed_raw_sentence = "";
-  while (std::getline(S, line)) {
-    std::vector<std::string> tokens;
-    boost::algorithm::trim(line);
-    if (boost::algorithm::starts_with(line, "# text = ")) {
-      inst.raw_sentence = line.substr(9);
-    } else {
-      boost::algorithm::split(tokens, line, boost::is_any_of("\t"), boost::token_compress_on);
-      BOOST_ASSERT_MSG(tokens.size() > 6, "[corpus] illegal conllu format, number of column less than 6.");      
-      
-      if (train) {
-        const std::string & word = input_unit.word = tokens[1];
-        const std::string & postag = input_unit.postag = tokens[3];
-        input_unit.lemma = tokens[2];
-        input_unit.feature = tokens[5];
-
-        input_unit.wid = word_map.insert(word);
-        input_unit.pid = pos_map.insert(postag);
-        input_unit.aux_wid = input_unit.wid;
-
-        unsigned cur = 0;
-        input_unit.cids.clear();
-        while (cur < word.size()) {
-          unsigned len = utf8_len(word[cur]);
-          input_unit.cids.push_back(char_map.insert(word.substr(cur, len)));
-          cur += len;
-        }
-        inst.input_units.push_back(input_unit);
+  // the fields point into the buffer, only the used ones are copied.
+  std::vector<CharRange> tokens;
+  std::string word, postag, ch_str;
+  const char * p = begin;
+  while (p < end) {
+    const char * line_end = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    if (line_end == nullptr) { line_end = end; }
+    const char * line_begin = p;
+    const char * line_last = line_end;
+    p = line_end + 1;
+    trim(line_begin, line_last);
+    if (line_begin == line_last) { continue; }
+
+    if (static_cast<size_t>(line_last - line_begin) >= text_prefix_len &&
+        std::strncmp(line_begin, text_prefix, text_prefix_len) == 0) {
+      inst.raw_sentence.assign(line_begin + text_prefix_len, line_last);
+      continue;
+    }
+    if (*line_begin == '#') { continue; }
+
+    tokens.clear();
+    const char * field = line_begin;
+    for (const char * q = line_begin; q <= line_last; ++q) {
+      if (q == line_last || *q == '\t') {
+        // consecutive tabs are compressed.
+        if (q > field) { tokens.push_back(std::make_pair(field, q)); }
+        field = q + 1;
+      }
+    }
+    BOOST_ASSERT_MSG(tokens.size() > 7, "[corpus] illegal conllu format, number of column less than 8.");
 
-        parse_unit.head = boost::lexical_cast<unsigned>(tokens[6]);
-        parse_unit.deprel = deprel_map.insert(tokens[7]);
-        inst.parse_units.push_back(parse_unit);
-      } else {
-        const std::string & word = input_unit.word = tokens[1];
-        const std::string & postag = input_unit.postag = tokens[3];
-        input_unit.lemma = tokens[2];
-        input_unit.feature = tokens[5];
-
-        input_unit.wid = (word_map.contains(word) ? word_map.get(word) : word_map.get(UNK));
-        input_unit.pid = pos_map.get(postag);
-        input_unit.aux_wid = input_unit.wid;
-
-        unsigned cur = 0;
-        input_unit.cids.clear();
-        while (cur < word.size()) {
-          unsigned len = utf8_len(word[cur]);
-          std::string ch_str = word.substr(cur, len);
-          input_unit.cids.push_back(
-            char_map.contains(ch_str) ? char_map.get(ch_str) : char_map.get(Corpus::UNK)
-          );
-          cur += len;
-        }
-        inst.input_units.push_back(input_unit);
+    word.assign(tokens[1].first, tokens[1].second);
+    postag.assign(tokens[3].first, tokens[3].second);
 
-        parse_unit.head = boost::lexical_cast<unsigned>(tokens[6]);
-        parse_unit.deprel = deprel_map.insert(tokens[7]);
-        inst.parse_units.push_back(parse_unit);
-      }
-      if (tokens[9] == "SpaceAfter=No" || tokens[9] == "SpaceAfter=\\n") {
-        guessed_raw_sentence += tokens[1];
+    if (train) {
+      input_unit.wid = word_map.insert(word);
+      input_unit.pid = pos_map.insert(postag);
+    } else {
+      input_unit.wid = (word_map.contains(word) ? word_map.get(word) : word_map.get(UNK));
+      input_unit.pid = pos_map.get(postag);
+    }
+    input_unit.aux_wid = input_unit.wid;
+    inst.input_units.push_back(input_unit, tokens[1], tokens[2], tokens[3], tokens[5]);
+
+    unsigned cur = 0;
+    while (cur < word.size()) {
+      unsigned len = utf8_len(word[cur]);
+      ch_str.assign(word, cur, len);
+      if (train) {
+        inst.input_units.push_char(char_map.insert(ch_str));
       } else {
-        guessed_raw_sentence += (tokens[1] + " ");
+        inst.input_units.push_char(char_map.contains(ch_str) ? char_map.get(ch_str) : char_map.get(Corpus::UNK));
       }
+      cur += len;
+    }
+
+    // strtoul would read "_" or a malformed head as 0, the root.
+    char * head_end = nullptr;
+    parse_unit.head = std::strtoul(tokens[6].first, &head_end, 10);
+    if (!std::isdigit(static_cast<unsigned char>(*tokens[6].first)) || head_end != tokens[6].second) {
+      _ERROR << "[corpus] illegal head \"" << std::string(tokens[6].first, tokens[6].second)
+        << "\" in line: " << std::string(line_begin, line_last);
+      exit(1);
+    }
+    parse_unit.deprel = deprel_map.insert(std::string(tokens[7].first, tokens[7].second));
+    inst.parse_units.push_back(parse_unit);
+
+    std::string misc = (tokens.size() > 9 ? std::string(tokens[9].first, tokens[9].second) : "");
+    if (misc == "SpaceAfter=No" || misc == "SpaceAfter=\\n") {
+      guessed_raw_sentence += word;
+    } else {
+      guessed_raw_sentence += (word + " ");
     }
   }
   if (inst.raw_sentence == "") {
@@ -325,7 +576,7 @@ void Corpus::parse_data(const std::string& data, Instance & inst, bool train) {
 
 void Corpus::get_vocabulary_and_word_count() {
   for (auto& payload : training_data) {
-    for (auto& item : payload.second.input_units) {
+    for (auto& item : payload.input_units) {
       training_vocab.insert(item.wid);
       ++counter[item.wid];
     }
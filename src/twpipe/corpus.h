@@ -4,21 +4,80 @@
 #include <unordered_map>
 #include <vector>
 #include <set>
+#include <string>
+#include <utility>
+#include <cstdint>
 #include <boost/program_options.hpp>
+#include "alphabet.h"
+#include "mapped_file.h"
 
 namespace po = boost::program_options;
 
 namespace twpipe {
 
 struct InputUnit {
-  std::vector<unsigned> cids;  // list of character ID
   unsigned wid;     // form ID
   unsigned pid;     // postag ID
   unsigned aux_wid; // copy of form ID
-  std::string word;
-  std::string lemma;
-  std::string postag;
-  std::string feature;
+  /// The word, lemma, postag and feature are text[fields[k], fields[k + 1])
+  /// and the character IDs are chars[chars_begin, chars_end) of InputUnits.
+  uint32_t fields[5];
+  uint32_t chars_begin;
+  uint32_t chars_end;
+};
+
+/// A [begin, end) range of characters, e.g. a field of a CoNLL line.
+typedef std::pair<const char *, const char *> CharRange;
+
+/// A view of the character IDs of a unit.
+struct CharIds {
+  const unsigned * data;
+  unsigned n;
+
+  unsigned size() const { return n; }
+  unsigned operator[](unsigned i) const { return data[i]; }
+  const unsigned * begin() const { return data; }
+  const unsigned * end() const { return data + n; }
+};
+
+/// The units of a sentence, the pseudo root first. The strings of all the
+/// units are kept in one buffer and their character IDs in one array, so a
+/// sentence holds three allocations instead of up to five per token.
+struct InputUnits {
+  std::vector<InputUnit> units;
+  std::string text;
+  std::vector<unsigned> chars;
+
+  size_t size() const { return units.size(); }
+  bool empty() const { return units.empty(); }
+  void clear();
+
+  InputUnit & operator[](size_t i) { return units[i]; }
+  const InputUnit & operator[](size_t i) const { return units[i]; }
+  std::vector<InputUnit>::iterator begin() { return units.begin(); }
+  std::vector<InputUnit>::iterator end() { return units.end(); }
+  std::vector<InputUnit>::const_iterator begin() const { return units.begin(); }
+  std::vector<InputUnit>::const_iterator end() const { return units.end(); }
+
+  /// Append a unit and copy its fields into the text, the character IDs
+  /// are appended to it with push_char.
+  void push_back(const InputUnit & unit,
+                 const CharRange & word,
+                 const CharRange & lemma,
+                 const CharRange & postag,
+                 const CharRange & feature);
+
+  void push_char(unsigned cid);
+
+  std::string word(size_t i) const { return field(i, 0); }
+  std::string lemma(size_t i) const { return field(i, 1); }
+  std::string postag(size_t i) const { return field(i, 2); }
+  std::string feature(size_t i) const { return field(i, 3); }
+
+  CharIds cids(size_t i) const;
+
+private:
+  std::string field(size_t i, unsigned k) const;
 };
 
 struct ParseUnit {
@@ -26,7 +85,6 @@ struct ParseUnit {
   unsigned deprel;
 };
 
-typedef std::vector<InputUnit> InputUnits;
 typedef std::vector<ParseUnit> ParseUnits;
 
 struct Instance {
@@ -35,6 +93,14 @@ struct Instance {
   ParseUnits parse_units;
 };
 
+/// The alphabets that an instance is parsed against.
+struct CorpusAlphabets {
+  Alphabet & word_map;
+  Alphabet & char_map;
+  Alphabet & pos_map;
+  Alphabet & deprel_map;
+};
+
 unsigned utf8_len(unsigned char x);
 char32_t utf8_to_unicode_first_(const std::string & s);
 
@@ -48,15 +114,28 @@ struct Corpus {
 
   unsigned n_train;
   unsigned n_devel;
-
-  std::unordered_map<unsigned, Instance> training_data;
-  std::unordered_map<unsigned, Instance> devel_data;
+  /// The number of threads to parse the data, the file is split into chunks
+  /// on the sentence boundaries.
+  unsigned n_threads;
+  /// The directory of the binary corpus cache, no caching when empty.
+  std::string cache_dir;
+  /// The cache key of the training data, the caches derived from the
+  /// training data (e.g. the oracle actions) are keyed by it. 0 if not cached.
+  uint64_t training_key;
+
+  /// The instances are indexed by their sentence id, 0..n.
+  std::vector<Instance> training_data;
+  std::vector<Instance> devel_data;
 
   std::set<unsigned> training_vocab;
   std::unordered_map<unsigned, unsigned> counter;
 
   Corpus();
 
+  Corpus(const po::variables_map & conf);
+
+  static po::options_description get_options();
+
   static void vector_to_input_units(const std::vector<std::string> & words,
                                     const std::vector<std::string> & postags,
                                     InputUnits & units);
@@ -79,10 +158,37 @@ struct Corpus {
 
   void load_devel_data(const std::string& filename);
 
+  /// Load the conllu file, it's memory mapped and parsed in place. Large
+  /// files are parsed in chunks by several threads, each with its own copy
+  /// of the alphabets, and the new entries are merged in chunk order so the
+  /// ids are the same as those of a sequential load.
+  void load_data(const std::string& filename,
+                 std::vector<Instance>& data,
+                 bool train);
+
+  void load_data(const MappedFile & file,
+                 std::vector<Instance>& data,
+                 bool train,
+                 CorpusAlphabets & global_alphabets);
+
+  /// Parse the sentences in [begin, end), which starts at a sentence boundary.
+  void parse_block(const char * begin,
+                   const char * end,
+                   std::vector<Instance>& data,
+                   bool train,
+                   CorpusAlphabets & alphabets);
+
   void parse_data(const std::string& data,
                   Instance & inst,
                   bool train);
 
+  /// Parse the lines in [begin, end) as one instance.
+  void parse_data(const char * begin,
+                  const char * end,
+                  Instance & inst,
+                  bool train,
+                  CorpusAlphabets & alphabets);
+
   void get_vocabulary_and_word_count();
 };
 
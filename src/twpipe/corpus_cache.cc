@@ -0,0 +1,211 @@
+#include "corpus_cache.h"
+#include "mapped_file.h"
+#include "logging.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <sys/stat.h>
+#if _MSC_VER
+#include <direct.h>
+#endif
+
+namespace twpipe {
+
+const char* CorpusCache::magic = "TWPC";
+const unsigned CorpusCache::version = 2;
+
+namespace {
+
+Alphabet * alphabet_at(AlphabetCollection & alphabets, unsigned i) {
+  Alphabet * ret[] = { &alphabets.word_map, &alphabets.char_map, &alphabets.pos_map, &alphabets.deprel_map };
+  return ret[i];
+}
+
+const Alphabet * alphabet_at(const AlphabetCollection & alphabets, unsigned i) {
+  const Alphabet * ret[] = { &alphabets.word_map, &alphabets.char_map, &alphabets.pos_map, &alphabets.deprel_map };
+  return ret[i];
+}
+
+const unsigned kNumAlphabets = 4;
+
+}
+
+uint64_t CorpusCache::hash(const char * data, size_t size, uint64_t seed) {
+  uint64_t h = seed;
+  for (size_t i = 0; i < size; ++i) {
+    h ^= static_cast<unsigned char>(data[i]);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+uint64_t CorpusCache::hash(const Alphabet & alphabet, uint64_t seed) {
+  uint32_t size = alphabet.size();
+  uint64_t h = hash(reinterpret_cast<const char *>(&size), sizeof(size), seed);
+  for (unsigned id = 0; id < alphabet.size(); ++id) {
+    if (!alphabet.contains(id)) { continue; }
+    std::string str = alphabet.get(id);
+    // the separator keeps ("ab", "c") and ("a", "bc") apart.
+    h = hash(str.c_str(), str.size() + 1, h);
+  }
+  return h;
+}
+
+uint64_t CorpusCache::key(const char * data, size_t size, const AlphabetCollection & alphabets) {
+  uint64_t h = hash(data, size);
+  for (unsigned i = 0; i < kNumAlphabets; ++i) {
+    h = hash(*alphabet_at(alphabets, i), h);
+  }
+  return hash(reinterpret_cast<const char *>(&version), sizeof(version), h);
+}
+
+bool CorpusCache::create_parent_dir(const std::string & path) {
+  std::string dir = path.substr(0, path.find_last_of('/'));
+#if _MSC_VER
+  int ret = _mkdir(dir.c_str());
+#else
+  int ret = mkdir(dir.c_str(), 0755);
+#endif
+  return ret == 0 || errno == EEXIST;
+}
+
+std::string CorpusCache::path(const std::string & cache_dir, uint64_t key) {
+  std::ostringstream S;
+  S << cache_dir << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".corpus";
+  return S.str();
+}
+
+bool CorpusCache::load(const std::string & path,
+                       uint64_t key,
+                       std::vector<Instance> & data,
+                       AlphabetCollection & alphabets) {
+  MappedFile file;
+  if (!file.open(path)) { return false; }
+
+  CacheReader reader(file.data, file.data + file.size);
+  if (file.size < 4 || std::memcmp(file.data, magic, 4) != 0) { return false; }
+  reader.p += 4;
+  if (reader.get<uint32_t>() != version || reader.get<uint64_t>() != key) { return false; }
+
+  // the counts are bounded by the file size, so a corrupted count fails
+  // reading instead of allocating.
+  std::vector<std::vector<std::string>> entries(kNumAlphabets);
+  for (unsigned i = 0; i < kNumAlphabets; ++i) {
+    uint32_t n_entries = reader.get<uint32_t>();
+    if (n_entries > file.size) { return false; }
+    entries[i].resize(n_entries);
+    for (std::string & str : entries[i]) { reader.get(str); }
+  }
+
+  uint32_t n_instances = reader.get<uint32_t>();
+  if (n_instances > file.size) { return false; }
+  std::vector<Instance> cached(n_instances);
+  for (Instance & inst : cached) {
+    if (!reader.ok) { break; }
+    reader.get(inst.raw_sentence);
+    InputUnits & units = inst.input_units;
+    reader.get(units.text);
+    uint32_t n_chars = reader.get<uint32_t>();
+    if (!reader.ok || n_chars > file.size) { reader.ok = false; break; }
+    units.chars.resize(n_chars);
+    for (unsigned & cid : units.chars) { cid = reader.get<uint32_t>(); }
+    unsigned n_units = reader.get<uint32_t>();
+    if (!reader.ok || n_units > file.size) { reader.ok = false; break; }
+    units.units.resize(n_units);
+    inst.parse_units.resize(n_units);
+    for (unsigned j = 0; j < n_units; ++j) {
+      InputUnit & unit = units[j];
+      unit.wid = reader.get<uint32_t>();
+      unit.pid = reader.get<uint32_t>();
+      unit.aux_wid = reader.get<uint32_t>();
+      // the offsets are checked, a corrupted one fails reading.
+      for (unsigned k = 0; k < 5; ++k) {
+        unit.fields[k] = reader.get<uint32_t>();
+        if (unit.fields[k] > units.text.size() || (k > 0 && unit.fields[k] < unit.fields[k - 1])) {
+          reader.ok = false;
+        }
+      }
+      unit.chars_begin = reader.get<uint32_t>();
+      unit.chars_end = reader.get<uint32_t>();
+      if (unit.chars_begin > unit.chars_end || unit.chars_end > n_chars) { reader.ok = false; }
+      inst.parse_units[j].head = reader.get<uint32_t>();
+      inst.parse_units[j].deprel = reader.get<uint32_t>();
+      if (!reader.ok) { break; }
+    }
+  }
+  if (!reader.ok) {
+    _WARN << "[corpus|cache] " << path << " is truncated, ignored.";
+    return false;
+  }
+
+  // the current alphabets should be a prefix of the cached ones.
+  for (unsigned i = 0; i < kNumAlphabets; ++i) {
+    const Alphabet & alphabet = *alphabet_at(alphabets, i);
+    if (alphabet.size() > entries[i].size()) { return false; }
+    for (unsigned id = 0; id < alphabet.size(); ++id) {
+      if (!alphabet.contains(id) || alphabet.get(id) != entries[i][id]) { return false; }
+    }
+  }
+  for (unsigned i = 0; i < kNumAlphabets; ++i) {
+    Alphabet & alphabet = *alphabet_at(alphabets, i);
+    for (unsigned id = alphabet.size(); id < entries[i].size(); ++id) {
+      alphabet.insert(entries[i][id]);
+    }
+  }
+  data.swap(cached);
+  return true;
+}
+
+bool CorpusCache::save(const std::string & path,
+                       uint64_t key,
+                       const std::vector<Instance> & data,
+                       const AlphabetCollection & alphabets) {
+  if (!create_parent_dir(path)) { return false; }
+
+  std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream ofs(tmp_path, std::ios::binary);
+    if (!ofs.good()) { return false; }
+    CacheWriter writer(ofs);
+    ofs.write(magic, 4);
+    writer.put<uint32_t>(version);
+    writer.put<uint64_t>(key);
+
+    for (unsigned i = 0; i < kNumAlphabets; ++i) {
+      const Alphabet & alphabet = *alphabet_at(alphabets, i);
+      writer.put<uint32_t>(alphabet.size());
+      for (unsigned id = 0; id < alphabet.size(); ++id) {
+        writer.put(alphabet.contains(id) ? alphabet.get(id) : std::string());
+      }
+    }
+
+    writer.put<uint32_t>(data.size());
+    for (const Instance & inst : data) {
+      writer.put(inst.raw_sentence);
+      const InputUnits & units = inst.input_units;
+      writer.put(units.text);
+      writer.put<uint32_t>(units.chars.size());
+      for (unsigned cid : units.chars) { writer.put<uint32_t>(cid); }
+      writer.put<uint32_t>(units.size());
+      for (unsigned j = 0; j < units.size(); ++j) {
+        const InputUnit & unit = units[j];
+        writer.put<uint32_t>(unit.wid);
+        writer.put<uint32_t>(unit.pid);
+        writer.put<uint32_t>(unit.aux_wid);
+        for (unsigned k = 0; k < 5; ++k) { writer.put<uint32_t>(unit.fields[k]); }
+        writer.put<uint32_t>(unit.chars_begin);
+        writer.put<uint32_t>(unit.chars_end);
+        writer.put<uint32_t>(inst.parse_units[j].head);
+        writer.put<uint32_t>(inst.parse_units[j].deprel);
+      }
+    }
+    ofs.flush();
+    if (!ofs.good()) { return false; }
+  }
+  return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+}
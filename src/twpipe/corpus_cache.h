@@ -0,0 +1,88 @@
+#ifndef __TWPIPE_CORPUS_CACHE_H__
+#define __TWPIPE_CORPUS_CACHE_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include "corpus.h"
+#include "alphabet_collection.h"
+
+namespace twpipe {
+
+struct CacheWriter {
+  std::ostream & os;
+
+  CacheWriter(std::ostream & os) : os(os) {}
+
+  template <typename T> void put(T value) {
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  void put(const std::string & str) {
+    put<uint32_t>(str.size());
+    os.write(str.data(), str.size());
+  }
+};
+
+/// Read from a mapped cache, any read past the end turns ok off.
+struct CacheReader {
+  const char * p;
+  const char * end;
+  bool ok;
+
+  CacheReader(const char * p, const char * end) : p(p), end(end), ok(true) {}
+
+  template <typename T> T get() {
+    T value = T();
+    if (!ok || static_cast<size_t>(end - p) < sizeof(T)) { ok = false; return value; }
+    std::memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+  }
+
+  void get(std::string & str) {
+    uint32_t len = get<uint32_t>();
+    if (!ok || static_cast<size_t>(end - p) < len) { ok = false; return; }
+    str.assign(p, len);
+    p += len;
+  }
+};
+
+/// The binary cache of a parsed corpus file. The cache holds the alphabets
+/// after loading and the id-encoded instances. It's keyed by the hash of the
+/// source file and of the alphabets before loading, so the cache of the
+/// devel data is invalidated when the training data changes, and a changed
+/// file is re-parsed.
+struct CorpusCache {
+  static const char* magic;
+  static const unsigned version;
+
+  /// FNV-1a of the bytes.
+  static uint64_t hash(const char * data, size_t size, uint64_t seed = 14695981039346656037ULL);
+
+  static uint64_t hash(const Alphabet & alphabet, uint64_t seed);
+
+  static uint64_t key(const char * data, size_t size, const AlphabetCollection & alphabets);
+
+  static std::string path(const std::string & cache_dir, uint64_t key);
+
+  /// Create the directory of path if it doesn't exist.
+  static bool create_parent_dir(const std::string & path);
+
+  /// Load the cache into data and the alphabets, return false if it's missing or stale.
+  static bool load(const std::string & path,
+                   uint64_t key,
+                   std::vector<Instance> & data,
+                   AlphabetCollection & alphabets);
+
+  static bool save(const std::string & path,
+                   uint64_t key,
+                   const std::vector<Instance> & data,
+                   const AlphabetCollection & alphabets);
+};
+
+}
+
+#endif  //  end for __TWPIPE_CORPUS_CACHE_H__
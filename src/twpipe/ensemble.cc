@@ -1,7 +1,13 @@
 #include "ensemble.h"
 #include "json.hpp"
+#include "logging.h"
+#include "math.h"
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
 
 namespace twpipe {
 
@@ -9,6 +15,9 @@ const char* EnsembleInstance::id_name = "id";
 const char* EnsembleInstance::category_name = "category";
 const char* EnsembleInstance::prob_name = "prob";
 
+EnsembleInstance::EnsembleInstance() : id(0) {
+}
+
 EnsembleInstance::EnsembleInstance(unsigned id,
                                    std::vector<unsigned>& categories,
                                    std::vector<std::vector<float>>& probs) :
@@ -32,4 +41,206 @@ void EnsembleUtils::load_ensemble_instances(const std::string & path,
   }
 }
 
+const char* EnsembleBinaryFormat::magic = "TWPE";
+const unsigned EnsembleBinaryFormat::version = 1;
+const unsigned EnsembleBinaryFormat::header_size = 16;
+
+unsigned EnsembleBinaryFormat::step_size(unsigned top_k) {
+  return sizeof(uint32_t) + sizeof(uint16_t) + top_k * 2 * sizeof(uint16_t);
+}
+
+namespace {
+
+template <typename T> void put(std::string & buffer, T value) {
+  buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> T take(const char * & p) {
+  T value;
+  std::memcpy(&value, p, sizeof(T));
+  p += sizeof(T);
+  return value;
+}
+
+}
+
+po::options_description EnsembleWriter::get_options() {
+  po::options_description cmd("Ensemble data output options.");
+  cmd.add_options()
+    ("ensemble-output-format", po::value<std::string>()->default_value("json"), "the output format [json|binary].")
+    ("ensemble-top-k", po::value<unsigned>()->default_value(8), "the number of probabilities kept for each step in binary format.")
+    ;
+  return cmd;
+}
+
+EnsembleWriter::EnsembleWriter(const po::variables_map & conf, unsigned n_categories) :
+  n_categories(n_categories) {
+  std::string format_name = conf["ensemble-output-format"].as<std::string>();
+  if (format_name == "json") {
+    format = kJSON;
+  } else if (format_name == "binary") {
+    format = kBinary;
+  } else {
+    _ERROR << "[twpipe|ensemble] unknown output format: " << format_name;
+    exit(1);
+  }
+  if (format == kBinary && n_categories > 65536) {
+    _ERROR << "[twpipe|ensemble] too many categories for binary format: " << n_categories;
+    exit(1);
+  }
+  top_k = std::min(conf["ensemble-top-k"].as<unsigned>(), n_categories);
+}
+
+void EnsembleWriter::write_header(std::ostream & os) const {
+  if (format != kBinary) { return; }
+  std::string buffer(EnsembleBinaryFormat::magic, 4);
+  put<uint32_t>(buffer, EnsembleBinaryFormat::version);
+  put<uint32_t>(buffer, top_k);
+  put<uint32_t>(buffer, n_categories);
+  os.write(buffer.data(), buffer.size());
+}
+
+std::string EnsembleWriter::name() const {
+  if (format == kJSON) { return "json"; }
+  return "binary-top" + std::to_string(top_k);
+}
+
+std::string EnsembleWriter::encode(unsigned id,
+                                   const std::vector<unsigned> & categories,
+                                   const std::vector<std::vector<float>> & probs) const {
+  if (format == kJSON) {
+    nlohmann::json output;
+    output = {{EnsembleInstance::id_name,       id},
+              {EnsembleInstance::category_name, categories},
+              {EnsembleInstance::prob_name,     probs}};
+    return output.dump() + "\n";
+  }
+
+  unsigned n_steps = probs.size();
+  std::string buffer;
+  buffer.reserve(2 * sizeof(uint32_t) + n_steps * EnsembleBinaryFormat::step_size(top_k));
+  put<uint32_t>(buffer, id);
+  put<uint32_t>(buffer, n_steps);
+
+  std::vector<unsigned> indices;
+  for (unsigned t = 0; t < n_steps; ++t) {
+    const std::vector<float> & prob = probs[t];
+    indices.resize(prob.size());
+    for (unsigned i = 0; i < prob.size(); ++i) { indices[i] = i; }
+    unsigned k = std::min<unsigned>(top_k, prob.size());
+    std::partial_sort(indices.begin(), indices.begin() + k, indices.end(),
+                      [&prob](unsigned a, unsigned b) { return prob[a] > prob[b]; });
+
+    float mass = 0.f;
+    for (unsigned i = 0; i < k; ++i) { mass += prob[indices[i]]; }
+    put<uint32_t>(buffer, categories[t]);
+    put<uint16_t>(buffer, Math::float_to_half(std::max(1.f - mass, 0.f)));
+    for (unsigned i = 0; i < top_k; ++i) {
+      // pad with zero probability when there are fewer categories.
+      put<uint16_t>(buffer, static_cast<uint16_t>(i < k ? indices[i] : 0));
+      put<uint16_t>(buffer, Math::float_to_half(i < k ? prob[indices[i]] : 0.f));
+    }
+  }
+  return buffer;
+}
+
+EnsembleDataset::EnsembleDataset() : binary(false), top_k(0), n_categories(0) {
+}
+
+void EnsembleDataset::load(const std::string & path) {
+  offsets.clear();
+  instances.clear();
+  if (!file.open(path)) {
+    _ERROR << "[twpipe|ensemble] failed to open " << path;
+    exit(1);
+  }
+
+  binary = (file.size >= EnsembleBinaryFormat::header_size &&
+            std::memcmp(file.data, EnsembleBinaryFormat::magic, 4) == 0);
+  if (!binary) {
+    file.close();
+    EnsembleUtils::load_ensemble_instances(path, instances);
+    _INFO << "[twpipe|ensemble] loaded " << instances.size() << " json instances.";
+    return;
+  }
+
+  const char * p = file.data + 4;
+  unsigned version = take<uint32_t>(p);
+  if (version != EnsembleBinaryFormat::version) {
+    _ERROR << "[twpipe|ensemble] unsupported binary version: " << version;
+    exit(1);
+  }
+  top_k = take<uint32_t>(p);
+  n_categories = take<uint32_t>(p);
+  if (n_categories == 0 || n_categories > 65536 || top_k > n_categories) {
+    _ERROR << "[twpipe|ensemble] illegal binary header: top-" << top_k << " of "
+      << n_categories << " categories.";
+    exit(1);
+  }
+
+  // only the record headers are touched to build the index.
+  size_t step_size = EnsembleBinaryFormat::step_size(top_k);
+  size_t offset = EnsembleBinaryFormat::header_size;
+  while (offset + 2 * sizeof(uint32_t) <= file.size) {
+    const char * q = file.data + offset + sizeof(uint32_t);
+    size_t n_steps = take<uint32_t>(q);
+    size_t next = offset + 2 * sizeof(uint32_t) + n_steps * step_size;
+    if (next > file.size) {
+      _WARN << "[twpipe|ensemble] truncated record at " << offset << ", ignored.";
+      break;
+    }
+    offsets.push_back(offset);
+    offset = next;
+  }
+  _INFO << "[twpipe|ensemble] mapped " << offsets.size() << " binary instances, top-"
+    << top_k << " of " << n_categories << " categories.";
+}
+
+unsigned EnsembleDataset::size() const {
+  return binary ? offsets.size() : instances.size();
+}
+
+unsigned EnsembleDataset::id(unsigned i) const {
+  if (!binary) { return instances[i].id; }
+  const char * p = file.data + offsets[i];
+  return take<uint32_t>(p);
+}
+
+void EnsembleDataset::get(unsigned i, EnsembleInstance & instance) const {
+  if (!binary) {
+    instance = instances[i];
+    return;
+  }
+
+  const char * p = file.data + offsets[i];
+  instance.id = take<uint32_t>(p);
+  unsigned n_steps = take<uint32_t>(p);
+  instance.categories.resize(n_steps);
+  instance.probs.resize(n_steps);
+
+  unsigned n_rest = n_categories - top_k;
+  for (unsigned t = 0; t < n_steps; ++t) {
+    instance.categories[t] = take<uint32_t>(p);
+    if (instance.categories[t] >= n_categories) {
+      _ERROR << "[twpipe|ensemble] category " << instance.categories[t] << " out of "
+        << n_categories << " in instance " << instance.id << ", the file is corrupted.";
+      exit(1);
+    }
+    float residual = Math::half_to_float(take<uint16_t>(p));
+    // the residual mass is spread evenly over the categories out of top-k.
+    std::vector<float> & prob = instance.probs[t];
+    prob.assign(n_categories, n_rest > 0 ? residual / n_rest : 0.f);
+    for (unsigned k = 0; k < top_k; ++k) {
+      unsigned index = take<uint16_t>(p);
+      float value = Math::half_to_float(take<uint16_t>(p));
+      if (index >= n_categories) {
+        _ERROR << "[twpipe|ensemble] category " << index << " out of " << n_categories
+          << " in instance " << instance.id << ", the file is corrupted.";
+        exit(1);
+      }
+      if (value > 0.f) { prob[index] = value; }
+    }
+  }
+}
+
 }
@@ -4,6 +4,10 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <boost/program_options.hpp>
+#include "mapped_file.h"
+
+namespace po = boost::program_options;
 
 namespace twpipe {
 
@@ -16,6 +20,8 @@ struct EnsembleInstance {
   std::vector<unsigned> categories;
   std::vector<std::vector<float>> probs;
 
+  EnsembleInstance();
+
   EnsembleInstance(unsigned id,
                    std::vector<unsigned> & categories,
                    std::vector<std::vector<float>> & probs);
@@ -28,6 +34,69 @@ struct EnsembleUtils {
                                       EnsembleInstances & instances);
 };
 
+/// The binary ensemble data starts with a header
+///
+///   char[4] magic "TWPE", uint32 version, uint32 top_k, uint32 n_categories
+///
+/// and is followed by one record per instance
+///
+///   uint32 id, uint32 n_steps,
+///   n_steps * (uint32 category, fp16 residual, top_k * (uint16 index, fp16 prob))
+///
+/// where residual is the probability mass outside the top-k categories.
+struct EnsembleBinaryFormat {
+  static const char* magic;
+  static const unsigned version;
+  static const unsigned header_size;
+
+  static unsigned step_size(unsigned top_k);
+};
+
+/// Encode the ensemble instances as json lines or binary records.
+struct EnsembleWriter {
+  enum FORMAT_TYPE { kJSON, kBinary };
+  FORMAT_TYPE format;
+  unsigned top_k;
+  unsigned n_categories;
+
+  static po::options_description get_options();
+
+  EnsembleWriter(const po::variables_map & conf, unsigned n_categories);
+
+  /// Write the header of the output, nothing for json.
+  void write_header(std::ostream & os) const;
+
+  /// The format and the top k, outputs with different ones can't be mixed.
+  std::string name() const;
+
+  std::string encode(unsigned id,
+                     const std::vector<unsigned> & categories,
+                     const std::vector<std::vector<float>> & probs) const;
+};
+
+/// The ensemble data for the trainers. A binary file is memory mapped and an
+/// instance is decoded (and densified) only when it is accessed, json files
+/// are loaded into memory.
+struct EnsembleDataset {
+  MappedFile file;
+  bool binary;
+  unsigned top_k;
+  unsigned n_categories;
+  std::vector<size_t> offsets;
+  EnsembleInstances instances;
+
+  EnsembleDataset();
+
+  void load(const std::string & path);
+
+  unsigned size() const;
+
+  /// The sentence id of the i-th instance.
+  unsigned id(unsigned i) const;
+
+  void get(unsigned i, EnsembleInstance & instance) const;
+};
+
 }
 
-#endif  //  end for __TWPIPE_ENSEMBLE_H__
\ No newline at end of file
+#endif  //  end for __TWPIPE_ENSEMBLE_H__
@@ -0,0 +1,220 @@
+#include "hogwild.h"
+#include "logging.h"
+#include "checkpoint.h"
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include "dynet/globals.h"
+#if !_MSC_VER
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <signal.h>
+#endif
+
+namespace twpipe {
+
+SharedParameters::SharedParameters() : memory(nullptr), size(0) {
+}
+
+SharedParameters::~SharedParameters() {
+  restore();
+}
+
+bool SharedParameters::is_shared() const {
+  return memory != nullptr;
+}
+
+bool SharedParameters::share(dynet::ParameterCollection & model) {
+#if _MSC_VER
+  return false;
+#else
+  if (is_shared()) { return true; }
+
+  for (auto & p : model.parameters_list()) {
+    tensors.push_back(std::make_pair(&p->values, p->values.v));
+  }
+  for (auto & p : model.lookup_parameters_list()) {
+    tensors.push_back(std::make_pair(&p->all_values, p->all_values.v));
+    lookups.push_back(p.get());
+  }
+  size = 0;
+  for (auto & t : tensors) { size += t.first->d.size() * sizeof(float); }
+  if (size == 0) { tensors.clear(); lookups.clear(); return false; }
+
+  void * ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    tensors.clear();
+    lookups.clear();
+    return false;
+  }
+  memory = static_cast<char *>(ptr);
+
+  char * p = memory;
+  for (auto & t : tensors) {
+    size_t n = t.first->d.size();
+    std::memcpy(p, t.second, n * sizeof(float));
+    t.first->v = reinterpret_cast<float *>(p);
+    p += n * sizeof(float);
+  }
+  // the rows of a lookup parameter are views of its all_values.
+  for (dynet::LookupParameterStorage * p : lookups) {
+    unsigned row_size = p->dim.size();
+    for (unsigned i = 0; i < p->values.size(); ++i) {
+      p->values[i].v = p->all_values.v + i * row_size;
+    }
+  }
+  return true;
+#endif
+}
+
+void SharedParameters::restore() {
+#if !_MSC_VER
+  if (!is_shared()) { return; }
+  for (auto & t : tensors) {
+    std::memcpy(t.second, t.first->v, t.first->d.size() * sizeof(float));
+    t.first->v = t.second;
+  }
+  for (dynet::LookupParameterStorage * p : lookups) {
+    unsigned row_size = p->dim.size();
+    for (unsigned i = 0; i < p->values.size(); ++i) {
+      p->values[i].v = p->all_values.v + i * row_size;
+    }
+  }
+  munmap(memory, size);
+  memory = nullptr;
+  size = 0;
+  tensors.clear();
+  lookups.clear();
+#endif
+}
+
+HogwildRunner::HogwildRunner(unsigned n_workers, dynet::ParameterCollection & model) :
+  n_workers(n_workers) {
+  if (n_workers > 1 && !shared.share(model)) {
+    _WARN << "[twpipe|hogwild] failed to share the parameters, train in one process.";
+    this->n_workers = 1;
+  }
+  if (enabled()) {
+    _INFO << "[twpipe|hogwild] training with " << this->n_workers << " worker processes.";
+  }
+}
+
+bool HogwildRunner::enabled() const {
+  return n_workers > 1;
+}
+
+bool fork_workers(unsigned n_workers,
+                  const std::function<void(unsigned)> & work,
+                  bool reseed) {
+#if _MSC_VER
+  for (unsigned k = 0; k < n_workers; ++k) { work(k); }
+  return true;
+#else
+  // a thread holding a lock at the fork leaves it locked in the children.
+  Checkpointer::get()->wait();
+  std::vector<pid_t> pids;
+  for (unsigned k = 0; k < n_workers; ++k) {
+    // flush before fork, or the buffered output is written by every child.
+    std::cout.flush();
+    std::cerr.flush();
+    std::clog.flush();
+    unsigned seed = (reseed ? (*dynet::rndeng)() : 0);
+    pid_t pid = fork();
+    if (pid < 0) {
+      _ERROR << "[twpipe|worker] failed to fork worker " << k;
+      for (pid_t p : pids) { kill(p, SIGKILL); waitpid(p, nullptr, 0); }
+      return false;
+    }
+    if (pid == 0) {
+      // the workers draw different dropout masks and noises.
+      if (reseed) { dynet::rndeng->seed(seed); }
+      work(k);
+      std::clog.flush();
+      _exit(0);
+    }
+    pids.push_back(pid);
+  }
+
+  bool ok = true;
+  unsigned n_running = n_workers;
+  while (n_running > 0) {
+    int status = 0;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) { ok = false; break; }
+    auto it = std::find(pids.begin(), pids.end(), pid);
+    if (it == pids.end()) { continue; }
+    *it = 0;
+    --n_running;
+    if (ok && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+      ok = false;
+      for (pid_t p : pids) { if (p > 0) { kill(p, SIGKILL); } }
+    }
+  }
+  return ok;
+#endif
+}
+
+bool has_optimizer_state(const dynet::Trainer & trainer) {
+  return dynamic_cast<const dynet::SimpleSGDTrainer *>(&trainer) == nullptr;
+}
+
+float HogwildRunner::run(const std::vector<std::vector<unsigned>> & batches,
+                         const Step & step,
+                         dynet::Trainer & trainer) {
+  float loss = 0.f;
+#if _MSC_VER
+  for (const std::vector<unsigned> & batch : batches) { loss += step(batch); trainer.update(); }
+#else
+  if (has_optimizer_state(trainer)) {
+    _ERROR << "[twpipe|hogwild] the optimizer state of the workers is lost after each epoch, "
+      << "use --optimizer simple_sgd with --train-workers.";
+    exit(1);
+  }
+  size_t stat_size = n_workers * sizeof(WorkerStat);
+  void * ptr = mmap(nullptr, stat_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    _ERROR << "[twpipe|hogwild] failed to map the worker statistics.";
+    exit(1);
+  }
+  WorkerStat * stats = static_cast<WorkerStat *>(ptr);
+  std::memset(stats, 0, stat_size);
+
+  auto start = std::chrono::steady_clock::now();
+  bool ok = fork_workers(n_workers, [&](unsigned k) {
+    WorkerStat & stat = stats[k];
+    auto worker_start = std::chrono::steady_clock::now();
+    for (unsigned i = k; i < batches.size(); i += n_workers) {
+      stat.loss += step(batches[i]);
+      trainer.update();
+      stat.n_batches++;
+      stat.n_instances += batches[i].size();
+    }
+    stat.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - worker_start).count();
+    _INFO << "[twpipe|hogwild] worker " << k << " trained " << stat.n_instances
+      << " instances in " << stat.seconds << "s, loss = " << stat.loss << ", "
+      << (stat.seconds > 0 ? stat.n_instances / stat.seconds : 0.) << " instances/s.";
+    stat.done = 1;
+  });
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  unsigned n_instances = 0;
+  for (unsigned k = 0; k < n_workers; ++k) {
+    if (!stats[k].done) { ok = false; }
+    loss += stats[k].loss;
+    n_instances += stats[k].n_instances;
+  }
+  munmap(ptr, stat_size);
+  if (!ok) {
+    _ERROR << "[twpipe|hogwild] a worker failed.";
+    exit(1);
+  }
+  _INFO << "[twpipe|hogwild] " << n_instances << " instances in " << seconds << "s, "
+    << (seconds > 0 ? n_instances / seconds : 0.) << " instances/s.";
+#endif
+  return loss;
+}
+
+}
@@ -0,0 +1,84 @@
+#ifndef __TWPIPE_HOGWILD_H__
+#define __TWPIPE_HOGWILD_H__
+
+#include <vector>
+#include <functional>
+#include "dynet/model.h"
+#include "dynet/training.h"
+
+namespace twpipe {
+
+/// Move the values of the parameters into MAP_SHARED memory, so the processes
+/// forked afterwards read and update the same weights. The gradients and the
+/// optimizer states stay private to each process. restore() copies the
+/// values back to their own memory. Only the CPU device is supported.
+struct SharedParameters {
+  SharedParameters();
+
+  ~SharedParameters();
+
+  bool share(dynet::ParameterCollection & model);
+
+  void restore();
+
+  bool is_shared() const;
+
+private:
+  SharedParameters(const SharedParameters &);
+  SharedParameters & operator = (const SharedParameters &);
+
+  char * memory;
+  size_t size;
+  /// The shared tensors and their original storage.
+  std::vector<std::pair<dynet::Tensor *, float *>> tensors;
+  std::vector<dynet::LookupParameterStorage *> lookups;
+};
+
+/// The statistics that a worker reports to the parent.
+struct WorkerStat {
+  double loss;
+  unsigned n_batches;
+  unsigned n_instances;
+  double seconds;
+  int done;
+};
+
+/// Fork n_workers processes, the k-th one runs work(k) and exits. With reseed,
+/// the workers reseed the random engine from the parent's one. Return false
+/// if a worker failed, the others are killed then since they may be waiting
+/// for it.
+bool fork_workers(unsigned n_workers,
+                  const std::function<void(unsigned)> & work,
+                  bool reseed = true);
+
+/// Whether the trainer keeps a state besides the weights, e.g. the momentum
+/// or the moments of adam. Only the simple SGD trainer doesn't.
+bool has_optimizer_state(const dynet::Trainer & trainer);
+
+/// Hogwild training: the batches of an epoch are spread over forked workers,
+/// each builds its own graph and updates the shared parameters without locks.
+/// The lookup parameters are updated sparsely by dynet, so the workers
+/// seldom write the same rows. The optimizer state of a worker dies with it
+/// at the end of the epoch, so only the simple SGD trainer is accepted.
+struct HogwildRunner {
+  /// Compute the loss and the gradients of one batch, return the loss. The
+  /// runner updates the parameters.
+  typedef std::function<float(const std::vector<unsigned> & batch)> Step;
+
+  unsigned n_workers;
+  SharedParameters shared;
+
+  HogwildRunner(unsigned n_workers, dynet::ParameterCollection & model);
+
+  bool enabled() const;
+
+  /// Run the step on the batches, worker k takes the batches k, k + n, ...
+  /// Return the sum of the losses.
+  float run(const std::vector<std::vector<unsigned>> & batches,
+            const Step & step,
+            dynet::Trainer & trainer);
+};
+
+}
+
+#endif  //  end for __TWPIPE_HOGWILD_H__
@@ -0,0 +1,126 @@
+#include "input_reader.h"
+#include <cstring>
+#include <cerrno>
+#include <limits>
+#include <unistd.h>
+
+namespace twpipe {
+
+namespace {
+
+bool is_space(char c) {
+  return (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f');
+}
+
+}
+
+bool StringPiece::starts_with(const char * prefix) const {
+  size_t len = std::strlen(prefix);
+  return (len <= size && std::memcmp(data, prefix, len) == 0);
+}
+
+StringPiece StringPiece::substr(size_t pos) const {
+  if (pos >= size) { return StringPiece(data + size, 0); }
+  return StringPiece(data + pos, size - pos);
+}
+
+bool StringPiece::to_unsigned(unsigned & value) const {
+  if (size == 0) { return false; }
+  unsigned long long ret = 0;
+  for (size_t i = 0; i < size; ++i) {
+    if (data[i] < '0' || data[i] > '9') { return false; }
+    ret = ret * 10 + (data[i] - '0');
+    if (ret > std::numeric_limits<unsigned>::max()) { return false; }
+  }
+  value = static_cast<unsigned>(ret);
+  return true;
+}
+
+bool StringPiece::operator == (const char * s) const {
+  size_t len = std::strlen(s);
+  return (len == size && std::memcmp(data, s, len) == 0);
+}
+
+std::ostream & operator << (std::ostream & os, const StringPiece & piece) {
+  return os.write(piece.data, piece.size);
+}
+
+InputReader::InputReader() : fd(-1), cursor(nullptr), last(nullptr), eof(true) {
+}
+
+InputReader::~InputReader() {
+}
+
+bool InputReader::open(const std::string & path) {
+  if (path == "-") {
+    fd = STDIN_FILENO;
+    buffer.resize(kBlockSize);
+    cursor = last = buffer.data();
+    eof = false;
+    return true;
+  }
+  if (!file.open(path)) { return false; }
+  cursor = file.data;
+  last = file.data + file.size;
+  eof = true;
+  return true;
+}
+
+bool InputReader::fill() {
+  if (eof) { return false; }
+  size_t n_unread = last - cursor;
+  if (n_unread > 0 && cursor != buffer.data()) {
+    std::memmove(buffer.data(), cursor, n_unread);
+  }
+  // a line longer than the buffer grows it.
+  if (n_unread + kBlockSize / 2 > buffer.size()) { buffer.resize(buffer.size() * 2); }
+  // read(2) returns what is available, fread would wait for a full block.
+  ssize_t n_read = 0;
+  do {
+    n_read = ::read(fd, buffer.data() + n_unread, buffer.size() - n_unread);
+  } while (n_read < 0 && errno == EINTR);
+  if (n_read <= 0) { eof = true; n_read = 0; }
+  cursor = buffer.data();
+  last = buffer.data() + n_unread + n_read;
+  return n_read > 0;
+}
+
+bool InputReader::next_line(StringPiece & line) {
+  const char * line_end = nullptr;
+  while (true) {
+    if (cursor != nullptr && cursor < last) {
+      line_end = static_cast<const char *>(std::memchr(cursor, '\n', last - cursor));
+    }
+    if (line_end != nullptr || !fill()) { break; }
+  }
+  if (cursor == nullptr || cursor >= last) { return false; }
+  // the last line may come without a newline.
+  if (line_end == nullptr) { line_end = last; }
+
+  const char * begin = cursor;
+  const char * end = line_end;
+  cursor = (line_end < last ? line_end + 1 : last);
+  while (begin < end && is_space(*begin)) { ++begin; }
+  while (end > begin && is_space(*(end - 1))) { --end; }
+  line = StringPiece(begin, end - begin);
+  return true;
+}
+
+bool InputReader::has_buffered_line() const {
+  if (eof) { return true; }
+  return (cursor < last && std::memchr(cursor, '\n', last - cursor) != nullptr);
+}
+
+void InputReader::split_fields(const StringPiece & line, std::vector<StringPiece> & fields) {
+  fields.clear();
+  const char * begin = line.begin();
+  for (const char * p = line.begin(); p < line.end(); ++p) {
+    if (*p == '\t' || *p == ' ') {
+      fields.push_back(StringPiece(begin, p - begin));
+      begin = p + 1;
+    }
+  }
+  fields.push_back(StringPiece(begin, line.end() - begin));
+}
+
+}
@@ -0,0 +1,80 @@
+#ifndef __TWPIPE_INPUT_READER_H__
+#define __TWPIPE_INPUT_READER_H__
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include "mapped_file.h"
+
+namespace twpipe {
+
+/// A view of bytes owned by someone else, the InputReader for the lines.
+struct StringPiece {
+  const char * data;
+  size_t size;
+
+  StringPiece() : data(nullptr), size(0) {}
+  StringPiece(const char * data, size_t size) : data(data), size(size) {}
+
+  bool empty() const { return size == 0; }
+  const char * begin() const { return data; }
+  const char * end() const { return data + size; }
+  char operator[](size_t i) const { return data[i]; }
+
+  std::string str() const { return std::string(data, size); }
+
+  bool starts_with(const char * prefix) const;
+
+  StringPiece substr(size_t pos) const;
+
+  /// Parse the piece as a decimal number. It fails on an empty piece, on
+  /// anything but digits and on overflow, and leaves value untouched then.
+  bool to_unsigned(unsigned & value) const;
+
+  bool operator == (const char * s) const;
+  bool operator != (const char * s) const { return !(*this == s); }
+};
+
+std::ostream & operator << (std::ostream & os, const StringPiece & piece);
+
+/// Reads the input line by line without a copy per line. A file is memory
+/// mapped, "-" reads the standard input in blocks of what is available.
+struct InputReader {
+  static const size_t kBlockSize = 1 << 20;
+
+  InputReader();
+
+  ~InputReader();
+
+  bool open(const std::string & path);
+
+  /// The next line with its surrounding spaces trimmed. It stays valid until
+  /// the next call.
+  bool next_line(StringPiece & line);
+
+  /// Whether next_line returns without waiting for the input, i.e. the next
+  /// line is already read or the input is at its end.
+  bool has_buffered_line() const;
+
+  /// Split a CoNLL line at every tab and space, as boost::split with
+  /// is_any_of("\t ") does, into fields that point into the line.
+  static void split_fields(const StringPiece & line, std::vector<StringPiece> & fields);
+
+private:
+  InputReader(const InputReader &);
+  InputReader & operator = (const InputReader &);
+
+  /// Move the unread bytes to the front and read a block after them.
+  bool fill();
+
+  MappedFile file;
+  int fd;
+  std::vector<char> buffer;
+  const char * cursor;
+  const char * last;
+  bool eof;
+};
+
+}
+
+#endif  //  end for __TWPIPE_INPUT_READER_H__
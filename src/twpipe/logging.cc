@@ -1,38 +1,191 @@
 #include "logging.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <boost/make_shared.hpp>
+#include <boost/core/null_deleter.hpp>
 #include <boost/log/core.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/log/expressions.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
+#include <boost/log/sinks/unbounded_fifo_queue.hpp>
 #include <boost/log/utility/setup/console.hpp>
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/log/support/date_time.hpp>
+#if !_MSC_VER
+#include <pthread.h>
+#endif
 
 namespace twpipe {
 
-void init_boost_log(bool verbose) {
-  namespace logging = boost::log;
-  namespace src = boost::log::sources;
-  namespace expr = boost::log::expressions;
-  namespace keywords = boost::log::keywords;
-
-  logging::add_console_log(
-    std::clog,
-    keywords::format = (
-    expr::stream
-    << expr::format_date_time< boost::posix_time::ptime >(
-    "TimeStamp",
-    "%Y-%m-%d %H:%M:%S")
+namespace logging = boost::log;
+namespace sinks = boost::log::sinks;
+namespace expr = boost::log::expressions;
+namespace keywords = boost::log::keywords;
+
+typedef sinks::asynchronous_sink<
+  sinks::text_ostream_backend,
+  sinks::unbounded_fifo_queue
+> async_text_sink;
+
+namespace {
+
+/// A queued sink, its feeding thread starts with it.
+struct AsyncSink {
+  boost::shared_ptr<sinks::text_ostream_backend> backend;
+  logging::formatter formatter;
+  boost::shared_ptr<async_text_sink> sink;
+
+  void start() {
+    sink = boost::make_shared<async_text_sink>(backend);
+    sink->set_formatter(formatter);
+    logging::core::get()->add_sink(sink);
+  }
+
+  /// Write out the queue and join the feeding thread.
+  void stop() {
+    if (sink) {
+      logging::core::get()->remove_sink(sink);
+      sink->stop();
+      sink->feed_records();
+      sink->flush();
+      sink.reset();
+    }
+  }
+};
+
+AsyncSink console_sink;
+AsyncSink json_sink;
+
+logging::formatter console_formatter() {
+  return expr::stream
+    << expr::format_date_time< boost::posix_time::ptime >("TimeStamp", "%Y-%m-%d %H:%M:%S")
     << " [" << logging::trivial::severity << "] "
-    << expr::smessage
-  )
-  );
+    << expr::smessage;
+}
+
+void write_json_string(logging::formatting_ostream & strm, const std::string & str) {
+  strm << '"';
+  for (char c : str) {
+    switch (c) {
+    case '"': strm << "\\\""; break;
+    case '\\': strm << "\\\\"; break;
+    case '\n': strm << "\\n"; break;
+    case '\r': strm << "\\r"; break;
+    case '\t': strm << "\\t"; break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+        strm << buf;
+      } else {
+        strm << c;
+      }
+    }
+  }
+  strm << '"';
+}
+
+/// One json object per line. The leading "[module|sub]" of the message, as
+/// all the messages in twpipe have, goes to its own field.
+void json_formatter(const logging::record_view & rec, logging::formatting_ostream & strm) {
+  auto timestamp = logging::extract<boost::posix_time::ptime>("TimeStamp", rec);
+  auto severity = logging::extract<logging::trivial::severity_level>("Severity", rec);
+  auto message = rec[expr::smessage];
+
+  std::string text = (message ? message.get() : std::string());
+  std::string module;
+  if (!text.empty() && text[0] == '[') {
+    std::string::size_type end = text.find(']');
+    if (end != std::string::npos) {
+      module = text.substr(1, end - 1);
+      std::string::size_type begin = text.find_first_not_of(' ', end + 1);
+      text = (begin == std::string::npos ? std::string() : text.substr(begin));
+    }
+  }
+
+  strm << "{\"time\":";
+  write_json_string(strm, timestamp ? boost::posix_time::to_iso_extended_string(timestamp.get()) : std::string());
+  strm << ",\"level\":";
+  write_json_string(strm, severity ? logging::trivial::to_string(severity.get()) : "");
+  strm << ",\"module\":";
+  write_json_string(strm, module);
+  strm << ",\"message\":";
+  write_json_string(strm, text);
+  strm << "}";
+}
+
+void shutdown_boost_log() {
+  console_sink.stop();
+  json_sink.stop();
+}
+
+#if !_MSC_VER
+/// The feeding threads don't survive fork, so the queues are written out and
+/// the threads joined before it. The parent starts new ones, the child logs
+/// to the console synchronously.
+void before_fork() {
+  console_sink.stop();
+  json_sink.stop();
+}
+
+void after_fork_in_parent() {
+  console_sink.start();
+  if (json_sink.backend) { json_sink.start(); }
+}
+
+void after_fork_in_child() {
+  console_sink.backend.reset();
+  json_sink.backend.reset();
+  logging::add_console_log(std::clog, keywords::format = console_formatter());
+}
+#endif
+
+}
+
+void init_boost_log(bool verbose, const std::string & json_path) {
+  console_sink.backend = boost::make_shared<sinks::text_ostream_backend>();
+  console_sink.backend->add_stream(boost::shared_ptr<std::ostream>(&std::clog, boost::null_deleter()));
+  console_sink.backend->auto_flush(true);
+  console_sink.formatter = console_formatter();
+  console_sink.start();
+
+  bool json_failed = false;
+  if (!json_path.empty()) {
+    auto ofs = boost::make_shared<std::ofstream>(json_path);
+    if (ofs->good()) {
+      json_sink.backend = boost::make_shared<sinks::text_ostream_backend>();
+      json_sink.backend->add_stream(ofs);
+      json_sink.backend->auto_flush(true);
+      json_sink.formatter = &json_formatter;
+      json_sink.start();
+    } else {
+      json_failed = true;
+    }
+  }
 
   if (verbose) {
     logging::core::get()->set_filter(logging::trivial::severity >= logging::trivial::trace);
   } else {
-    logging::core::get()->set_filter(logging::trivial::severity > logging::trivial::trace);
+    logging::core::get()->set_filter(logging::trivial::severity >= logging::trivial::info);
   }
 
   logging::add_common_attributes();
+
+  std::atexit(shutdown_boost_log);
+#if !_MSC_VER
+  pthread_atfork(before_fork, after_fork_in_parent, after_fork_in_child);
+#endif
+
+  if (json_failed) {
+    _WARN << "[twpipe|logging] failed to open " << json_path << ", json log is disabled.";
+  }
+}
+
+void flush_boost_log() {
+  if (console_sink.sink) { console_sink.sink->flush(); }
+  if (json_sink.sink) { json_sink.sink->flush(); }
 }
 
-}
\ No newline at end of file
+}
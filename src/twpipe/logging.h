@@ -1,15 +1,54 @@
 #ifndef LOGGING_UTILS_H
 #define LOGGING_UTILS_H
 
+#include <string>
 #include <boost/log/trivial.hpp>
+
+// The levels below TWPIPE_LOG_LEVEL are compiled out: the statement is dead
+// code and its stream arguments are never evaluated. 0 trace, 1 debug,
+// 2 info, 3 warning; errors are always logged.
+#ifndef TWPIPE_LOG_LEVEL
+#define TWPIPE_LOG_LEVEL 0
+#endif
+
+#define TWPIPE_LOG_DISABLED(severity) while (false) BOOST_LOG_TRIVIAL(severity)
+
+#if TWPIPE_LOG_LEVEL > 0
+#define _TRACE TWPIPE_LOG_DISABLED(trace)
+#else
 #define _TRACE BOOST_LOG_TRIVIAL(trace)
+#endif
+
+// _DBG rather than _DEBUG, which MSVC defines in debug builds.
+#if TWPIPE_LOG_LEVEL > 1
+#define _DBG   TWPIPE_LOG_DISABLED(debug)
+#else
+#define _DBG   BOOST_LOG_TRIVIAL(debug)
+#endif
+
+#if TWPIPE_LOG_LEVEL > 2
+#define _INFO  TWPIPE_LOG_DISABLED(info)
+#else
 #define _INFO  BOOST_LOG_TRIVIAL(info)
+#endif
+
+#if TWPIPE_LOG_LEVEL > 3
+#define _WARN  TWPIPE_LOG_DISABLED(warning)
+#else
 #define _WARN  BOOST_LOG_TRIVIAL(warning)
+#endif
+
 #define _ERROR BOOST_LOG_TRIVIAL(error)
 
 namespace twpipe {
 
-void init_boost_log(bool verbose);
+/// The records are queued and written by a background thread, to the console
+/// and as json lines to json_path if it's not empty. The queue is drained at
+/// exit and around fork, the forked children log synchronously.
+void init_boost_log(bool verbose, const std::string & json_path = "");
+
+/// Write out the queued records.
+void flush_boost_log();
 
 }
 
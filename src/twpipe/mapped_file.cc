@@ -0,0 +1,69 @@
+#include "mapped_file.h"
+#include <fstream>
+#include <iterator>
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace twpipe {
+
+MappedFile::MappedFile() : data(nullptr), size(0), fd(-1) {
+}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+bool MappedFile::open(const std::string & path) {
+  close();
+#if _MSC_VER
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs.good()) { return false; }
+  buffer.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  data = buffer.data();
+  size = buffer.size();
+  return true;
+#else
+  fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) { return false; }
+  struct stat st;
+  if (fstat(fd, &st) != 0) { close(); return false; }
+  size = static_cast<size_t>(st.st_size);
+  if (size == 0) {
+    // mmap rejects empty files, an empty view is fine.
+    data = buffer.data();
+    return true;
+  }
+  void * addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED) { close(); return false; }
+  data = static_cast<const char *>(addr);
+  return true;
+#endif
+}
+
+void MappedFile::close() {
+#if _MSC_VER
+  buffer.clear();
+#else
+  if (data != nullptr && size > 0) {
+    munmap(const_cast<char *>(data), size);
+  }
+  if (fd >= 0) { ::close(fd); }
+  fd = -1;
+#endif
+  data = nullptr;
+  size = 0;
+}
+
+bool MappedFile::is_open() const {
+#if _MSC_VER
+  return data != nullptr;
+#else
+  return fd >= 0;
+#endif
+}
+
+}
@@ -0,0 +1,36 @@
+#ifndef __TWPIPE_MAPPED_FILE_H__
+#define __TWPIPE_MAPPED_FILE_H__
+
+#include <string>
+#include <vector>
+
+namespace twpipe {
+
+/// A read-only view of a whole file. The file is memory mapped, so the pages
+/// are only read when they are touched. On the platforms without mmap, the
+/// file is read into memory.
+struct MappedFile {
+  const char * data;
+  size_t size;
+
+  MappedFile();
+
+  ~MappedFile();
+
+  bool open(const std::string & path);
+
+  void close();
+
+  bool is_open() const;
+
+private:
+  MappedFile(const MappedFile &);
+  MappedFile & operator = (const MappedFile &);
+
+  int fd;
+  std::vector<char> buffer;
+};
+
+}
+
+#endif  //  end for __TWPIPE_MAPPED_FILE_H__
@@ -1,4 +1,5 @@
 #include "math.h"
+#include <cstring>
 
 void twpipe::Math::softmax_inplace(std::vector<float>& x) {
   float m = x[0];
@@ -16,3 +17,59 @@ unsigned twpipe::Math::distribution_sample(const std::vector<float>& prob,
   std::discrete_distribution<unsigned> distrib(prob.begin(), prob.end());
   return distrib(gen);
 }
+
+uint16_t twpipe::Math::float_to_half(float x) {
+  uint32_t f;
+  std::memcpy(&f, &x, sizeof(f));
+  uint16_t sign = static_cast<uint16_t>((f >> 16) & 0x8000);
+  int exponent = static_cast<int>((f >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = f & 0x7fffff;
+
+  if (((f >> 23) & 0xff) == 0xff) {
+    // inf and nan
+    return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+  }
+  if (exponent >= 0x1f) {
+    return sign | 0x7c00;
+  }
+  if (exponent <= 0) {
+    // subnormal or zero
+    if (exponent < -10) { return sign; }
+    mantissa |= 0x800000;
+    unsigned shift = static_cast<unsigned>(14 - exponent);
+    uint16_t h = static_cast<uint16_t>(mantissa >> shift);
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t half = 1u << (shift - 1);
+    if (rest > half || (rest == half && (h & 1))) { h++; }
+    return sign | h;
+  }
+  uint16_t h = static_cast<uint16_t>((exponent << 10) | (mantissa >> 13));
+  uint32_t rest = mantissa & 0x1fff;
+  // a carry into the exponent is still the correctly rounded value.
+  if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) { h++; }
+  return sign | h;
+}
+
+float twpipe::Math::half_to_float(uint16_t h) {
+  uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  uint32_t f;
+  if (exponent == 0) {
+    if (mantissa == 0) {
+      f = sign;
+    } else {
+      // normalize the subnormal
+      exponent = 127 - 15 + 1;
+      while ((mantissa & 0x400) == 0) { mantissa <<= 1; exponent--; }
+      f = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+  } else if (exponent == 0x1f) {
+    f = sign | 0x7f800000 | (mantissa << 13);
+  } else {
+    f = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+  }
+  float x;
+  std::memcpy(&x, &f, sizeof(x));
+  return x;
+}
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <random>
+#include <cstdint>
 
 namespace twpipe {
 
@@ -11,6 +12,11 @@ struct Math {
 
   static unsigned distribution_sample(const std::vector<float>& prob,
                                       std::mt19937& gen);
+
+  /// Convert between float and IEEE half precision, rounded to the nearest.
+  static uint16_t float_to_half(float x);
+
+  static float half_to_float(uint16_t h);
 };
 
 }
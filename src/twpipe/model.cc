@@ -12,6 +12,20 @@ const char* Model::kParserName = "parser";
 
 Model* Model::instance = nullptr;
 
+void ParameterSnapshot::take(dynet::ParameterCollection & model) {
+  const dynet::ParameterCollectionStorage & storage = model.get_storage();
+  params.resize(storage.params.size());
+  for (unsigned i = 0; i < storage.params.size(); ++i) {
+    params[i].first = storage.params[i]->name;
+    params[i].second = dynet::as_vector(storage.params[i]->values);
+  }
+  lookup_params.resize(storage.lookup_params.size());
+  for (unsigned i = 0; i < storage.lookup_params.size(); ++i) {
+    lookup_params[i].first = storage.lookup_params[i]->name;
+    lookup_params[i].second = dynet::as_vector(storage.lookup_params[i]->all_values);
+  }
+}
+
 Model::Model() {
   payload[kSentenceSegmentAndTokenizeName] = nullptr;
   payload[kTokenizerName] = nullptr;
@@ -71,15 +85,25 @@ void Model::to_json(const std::string & phase_name,
     BOOST_ASSERT_MSG(false, "[model] invalid phase name.");
   }
 
-  const dynet::ParameterCollectionStorage & storage = model.get_storage();
+  ParameterSnapshot snapshot;
+  snapshot.take(model);
+  to_json(phase_name, snapshot);
+}
+
+void Model::to_json(const std::string & phase_name,
+                    const ParameterSnapshot & snapshot) {
+  if (!valid_phase_name(phase_name)) {
+    BOOST_ASSERT_MSG(false, "[model] invalid phase name.");
+  }
+
   auto & json = payload[phase_name]["model"];
-  for (auto & p : storage.params) { 
-    json[p->name]["dim"] = p->dim.size();
-    json[p->name]["value"] = dynet::as_vector(p->values);
+  for (auto & p : snapshot.params) {
+    json[p.first]["dim"] = p.second.size();
+    json[p.first]["value"] = p.second;
   }
-  for (auto & p : storage.lookup_params) {
-    json[p->name]["dim"] = p->all_dim.size();
-    json[p->name]["value"] = dynet::as_vector(p->all_values);
+  for (auto & p : snapshot.lookup_params) {
+    json[p.first]["dim"] = p.second.size();
+    json[p.first]["value"] = p.second;
   }
 }
 
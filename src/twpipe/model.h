@@ -14,6 +14,14 @@ namespace twpipe {
 typedef std::pair<std::string, std::string> StrConfigItemType;
 typedef std::pair<std::string, unsigned> IntConfigItemType;
 
+/// A copy of the values of the parameters, keyed by the parameter names.
+struct ParameterSnapshot {
+  std::vector<std::pair<std::string, std::vector<float>>> params;
+  std::vector<std::pair<std::string, std::vector<float>>> lookup_params;
+
+  void take(dynet::ParameterCollection & model);
+};
+
 class Model {
 protected:
   nlohmann::json payload;
@@ -45,6 +53,9 @@ public:
   void to_json(const std::string & phase_name,
                dynet::ParameterCollection & model);
 
+  void to_json(const std::string & phase_name,
+               const ParameterSnapshot & snapshot);
+
   std::string from_json(const std::string & phase_name, const std::string & key);
 
   void from_json(const std::string & name,
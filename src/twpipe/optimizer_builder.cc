@@ -2,6 +2,7 @@
 #include "logging.h"
 #include <fstream>
 #include <sstream>
+#include <algorithm>
 
 
 po::options_description twpipe::OptimizerBuilder::get_options() {
@@ -13,16 +14,17 @@ po::options_description twpipe::OptimizerBuilder::get_options() {
     ("optimizer-adam-beta1", po::value<float>()->default_value(0.9f), "The beta1 hyper-parameter of adam")
     ("optimizer-adam-beta2", po::value<float>()->default_value(0.999f), "The beta2 hyper-parameter of adam.")
     ("optimizer-enable-clipping", po::value<bool>()->default_value(false), "enable clipping.")
+    ("optimizer-schedule", po::value<std::string>()->default_value("inverse"), "The learning rate schedule [inverse, plateau, constant].")
+    ("optimizer-decay", po::value<float>()->default_value(0.5f), "The decay of learning rate when the heldout score plateaus.")
+    ("optimizer-decay-patience", po::value<unsigned>()->default_value(1), "The number of iterations without improvement before decaying.")
     ;
 
   return cmd;
 }
 
-twpipe::OptimizerBuilder::OptimizerBuilder(const po::variables_map & conf) : enable_clipping(false) {
+twpipe::OptimizerBuilder::OptimizerBuilder(const po::variables_map & conf) :
+  eta(0.f), n_plateau(0), enable_clipping(false) {
   eta0 = 0.1f;
-  if (conf.count("optimizer-eta0")) {
-    eta0 = conf["optimizer-eta0"].as<float>();
-  }
 
   if (!conf.count("optimizer") || conf["optimizer"].as<std::string>() == "simple_sgd") {
     optimizer_type = kSimpleSGD;
@@ -43,8 +45,25 @@ twpipe::OptimizerBuilder::OptimizerBuilder(const po::variables_map & conf) : ena
     _ERROR << "[optimizer] unknown optimizer: " << conf["optimizer"].as<std::string>();
     exit(1);
   }
+  if (conf.count("optimizer-eta")) {
+    eta0 = conf["optimizer-eta"].as<float>();
+  }
   _INFO << "[optimizer] using " << conf["optimizer"].as<std::string>() << " optimizer";
 
+  std::string schedule = conf["optimizer-schedule"].as<std::string>();
+  if (schedule == "inverse") {
+    schedule_type = kInverse;
+  } else if (schedule == "plateau") {
+    schedule_type = kPlateau;
+  } else if (schedule == "constant") {
+    schedule_type = kConstant;
+  } else {
+    _ERROR << "[optimizer] unknown schedule: " << schedule;
+    exit(1);
+  }
+  decay = conf["optimizer-decay"].as<float>();
+  decay_patience = std::max(1u, conf["optimizer-decay-patience"].as<unsigned>());
+
   enable_clipping = conf["optimizer-enable-clipping"].as<bool>();
 }
 
@@ -66,9 +85,21 @@ dynet::Trainer* twpipe::OptimizerBuilder::build(dynet::ParameterCollection & mod
   }
 
   ret->clipping_enabled = enable_clipping;
+  eta = eta0;
+  n_plateau = 0;
   return ret;
 }
 
-void twpipe::OptimizerBuilder::update(dynet::Trainer *trainer, unsigned iter) {
-  trainer->learning_rate = eta0 / (1.f + static_cast<float>(iter) * .08f);
+void twpipe::OptimizerBuilder::update(dynet::Trainer *trainer, unsigned iter, bool improved) {
+  if (schedule_type == kInverse) {
+    trainer->learning_rate = eta0 / (1.f + static_cast<float>(iter) * .08f);
+  } else if (schedule_type == kPlateau) {
+    n_plateau = (improved ? 0 : n_plateau + 1);
+    if (n_plateau >= decay_patience) {
+      eta *= decay;
+      n_plateau = 0;
+      _INFO << "[optimizer] heldout score plateaued, learning rate decayed to " << eta;
+    }
+    trainer->learning_rate = eta;
+  }
 }
@@ -21,8 +21,20 @@ struct OptimizerBuilder {
     kAdam
   };
 
+  enum ScheduleType {
+    kInverse,
+    kPlateau,
+    kConstant
+  };
+
   OptimizerType optimizer_type;
+  ScheduleType schedule_type;
   float eta0;
+  float decay;
+  unsigned decay_patience;
+  /// The states of the plateau schedule, reset by build().
+  float eta;
+  unsigned n_plateau;
   float adam_beta1;
   float adam_beta2;
   bool enable_clipping;
@@ -33,7 +45,9 @@ struct OptimizerBuilder {
 
   dynet::Trainer * build(dynet::ParameterCollection & model);
 
-  void update(dynet::Trainer * trainer, unsigned iter);
+  /// Update the learning rate at the end of an iteration, improved tells
+  /// whether the heldout score improved in the iteration.
+  void update(dynet::Trainer * trainer, unsigned iter, bool improved = true);
 };
 
 }
@@ -0,0 +1,132 @@
+#include "profiler.h"
+#include "logging.h"
+#include "json.hpp"
+#include <cmath>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+
+namespace twpipe {
+
+const char* Profiler::stage_names[] = { "preprocess", "tokenize", "postag", "parse", "output", "input" };
+const char* Profiler::counter_names[] = { "inputs", "sentences", "tokens" };
+
+bool Profiler::enabled = false;
+Profiler * Profiler::instance = nullptr;
+
+namespace {
+
+const unsigned kBucketsPerOctave = 4;
+const unsigned kNumBuckets = 64 * kBucketsPerOctave;
+
+}
+
+Profiler::Histogram::Histogram() : count(0), total(0), max(0), buckets(kNumBuckets, 0) {
+}
+
+void Profiler::Histogram::add(uint64_t ns) {
+  unsigned b = (ns <= 1 ? 0 : static_cast<unsigned>(kBucketsPerOctave * std::log2(static_cast<double>(ns))));
+  if (b >= kNumBuckets) { b = kNumBuckets - 1; }
+  buckets[b]++;
+  count++;
+  total += ns;
+  if (ns > max) { max = ns; }
+}
+
+double Profiler::Histogram::percentile(double q) const {
+  if (count == 0) { return 0.; }
+  uint64_t rank = static_cast<uint64_t>(std::ceil(q * count));
+  uint64_t seen = 0;
+  for (unsigned b = 0; b < kNumBuckets; ++b) {
+    seen += buckets[b];
+    if (seen >= rank && seen > 0) {
+      double upper = std::pow(2., static_cast<double>(b + 1) / kBucketsPerOctave);
+      return std::min(upper, static_cast<double>(max));
+    }
+  }
+  return static_cast<double>(max);
+}
+
+Profiler::Profiler() : interval(0), start(std::chrono::steady_clock::now()) {
+  for (unsigned i = 0; i < kNumCounters; ++i) { counters[i] = 0; }
+}
+
+po::options_description Profiler::get_options() {
+  po::options_description profile_opts("Profiling options");
+  profile_opts.add_options()
+    ("profile", po::value<std::string>(), "record the latencies of the stages and write them as json to the file.")
+    ("profile-interval", po::value<unsigned>()->default_value(0), "rewrite the profile every n inputs, 0 to write it at exit only.")
+    ;
+  return profile_opts;
+}
+
+Profiler * Profiler::get() {
+  if (instance == nullptr) {
+    instance = new Profiler();
+  }
+  return instance;
+}
+
+void Profiler::configure(const po::variables_map & conf) {
+  if (!conf.count("profile")) { return; }
+  path = conf["profile"].as<std::string>();
+  interval = conf["profile-interval"].as<unsigned>();
+  start = std::chrono::steady_clock::now();
+  enabled = true;
+  _INFO << "[profile] writing the profile to " << path;
+}
+
+void Profiler::record(Stage stage, uint64_t ns) {
+  stages[stage].add(ns);
+}
+
+void Profiler::count(Counter counter, uint64_t n) {
+  if (enabled) { counters[counter] += n; }
+}
+
+void Profiler::tick() {
+  if (!enabled) { return; }
+  counters[kInputs]++;
+  if (interval > 0 && counters[kInputs] % interval == 0) { report(); }
+}
+
+void Profiler::report() {
+  if (!enabled) { return; }
+  std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream ofs(tmp_path);
+    if (!ofs.good()) {
+      _WARN << "[profile] failed to open " << tmp_path;
+      return;
+    }
+    report(ofs);
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    _WARN << "[profile] failed to write " << path;
+  }
+}
+
+void Profiler::report(std::ostream & os) const {
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  nlohmann::json payload;
+  payload["elapsed_s"] = elapsed;
+  for (unsigned i = 0; i < kNumCounters; ++i) {
+    payload["counters"][counter_names[i]] = counters[i];
+    payload["throughput"][std::string(counter_names[i]) + "_per_s"] = (elapsed > 0 ? counters[i] / elapsed : 0.);
+  }
+  for (unsigned i = 0; i < kNumStages; ++i) {
+    const Histogram & h = stages[i];
+    if (h.count == 0) { continue; }
+    auto & json = payload["stages"][stage_names[i]];
+    json["count"] = h.count;
+    json["total_ms"] = h.total / 1e6;
+    json["mean_us"] = h.total / 1e3 / h.count;
+    json["p50_us"] = h.percentile(.5) / 1e3;
+    json["p95_us"] = h.percentile(.95) / 1e3;
+    json["p99_us"] = h.percentile(.99) / 1e3;
+    json["max_us"] = h.max / 1e3;
+  }
+  os << payload.dump(2) << std::endl;
+}
+
+}
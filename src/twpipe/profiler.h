@@ -0,0 +1,108 @@
+#ifndef __TWPIPE_PROFILER_H__
+#define __TWPIPE_PROFILER_H__
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <iostream>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+namespace twpipe {
+
+/// Per-stage latencies and counters of the pipeline. When it's disabled, a
+/// timer costs one check of Profiler::enabled.
+struct Profiler {
+  enum Stage {
+    kPreprocess,
+    kTokenize,
+    kPostag,
+    kParse,
+    kOutput,
+    kInput,
+    kNumStages
+  };
+
+  enum Counter {
+    kInputs,
+    kSentences,
+    kTokens,
+    kNumCounters
+  };
+
+  static const char* stage_names[];
+  static const char* counter_names[];
+
+  static bool enabled;
+
+protected:
+  /// Log-scale histogram of nanoseconds, 4 buckets per power of two.
+  struct Histogram {
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    std::vector<uint64_t> buckets;
+
+    Histogram();
+
+    void add(uint64_t ns);
+
+    /// The upper bound of the bucket holding the q-quantile.
+    double percentile(double q) const;
+  };
+
+  static Profiler * instance;
+  Histogram stages[kNumStages];
+  uint64_t counters[kNumCounters];
+  std::string path;
+  unsigned interval;
+  std::chrono::steady_clock::time_point start;
+
+  Profiler();
+
+public:
+  static po::options_description get_options();
+
+  static Profiler * get();
+
+  void configure(const po::variables_map & conf);
+
+  void record(Stage stage, uint64_t ns);
+
+  void count(Counter counter, uint64_t n = 1);
+
+  /// Count an input, the report is rewritten every interval inputs.
+  void tick();
+
+  /// Write the report as json to the profile file.
+  void report();
+
+  void report(std::ostream & os) const;
+};
+
+/// With n > 1, the elapsed time is shared by n items, e.g. the sentences of
+/// a batch, and recorded once per item.
+struct ScopedTimer {
+  Profiler::Stage stage;
+  unsigned n;
+  bool on;
+  std::chrono::steady_clock::time_point start;
+
+  explicit ScopedTimer(Profiler::Stage stage, unsigned n = 1) : stage(stage), n(n), on(Profiler::enabled && n > 0) {
+    if (on) { start = std::chrono::steady_clock::now(); }
+  }
+
+  ~ScopedTimer() {
+    if (on) {
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+      for (unsigned i = 0; i < n; ++i) { Profiler::get()->record(stage, ns / n); }
+    }
+  }
+};
+
+}
+
+#endif  //  end for __TWPIPE_PROFILER_H__
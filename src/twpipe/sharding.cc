@@ -0,0 +1,231 @@
+#include "sharding.h"
+#include "hogwild.h"
+#include "logging.h"
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <memory>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <sys/stat.h>
+#if _MSC_VER
+#include <direct.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace twpipe {
+
+po::options_description ShardRunner::get_options() {
+  po::options_description cmd("Sharding options");
+  cmd.add_options()
+    ("shards", po::value<unsigned>()->default_value(1), "the number of shards, sentence sid goes to shard (sid % shards).")
+    ("workers", po::value<unsigned>()->default_value(1), "the number of worker processes.")
+    ("shard-dir", po::value<std::string>()->default_value("shards"), "the directory to keep the finished shards, used to resume.")
+    ;
+  return cmd;
+}
+
+ShardRunner::ShardRunner(const po::variables_map & conf,
+                         const std::vector<std::string> & inputs,
+                         const std::string & output_name) : output_name(output_name), inputs(inputs) {
+  n_shards = conf["shards"].as<unsigned>();
+  if (n_shards == 0) { n_shards = 1; }
+  n_workers = conf["workers"].as<unsigned>();
+  if (n_workers == 0) { n_workers = 1; }
+  shard_dir = conf["shard-dir"].as<std::string>();
+}
+
+bool ShardRunner::enabled() const {
+  return n_shards > 1;
+}
+
+bool ShardRunner::own(unsigned sid, unsigned shard) const {
+  return sid % n_shards == shard;
+}
+
+std::string ShardRunner::shard_path(unsigned shard) const {
+  // the number of shards and the output settings are in the name, so shards
+  // of a run with different sharding or output are never resumed.
+  std::string path = shard_dir + "/shard-" + std::to_string(shard) + "-of-" + std::to_string(n_shards);
+  if (!output_name.empty()) { path += "." + output_name; }
+  return path;
+}
+
+std::string ShardRunner::manifest_path() const {
+  std::string path = shard_dir + "/manifest-of-" + std::to_string(n_shards);
+  if (!output_name.empty()) { path += "." + output_name; }
+  return path;
+}
+
+std::string ShardRunner::manifest() const {
+  std::ostringstream oss;
+  oss << "shards\t" << n_shards << "\n";
+  oss << "output\t" << output_name << "\n";
+  for (const std::string & input : inputs) {
+    struct stat st;
+    oss << "input\t" << input;
+    if (stat(input.c_str(), &st) == 0) {
+      oss << "\t" << static_cast<long long>(st.st_size) << "\t" << static_cast<long long>(st.st_mtime) << "\n";
+    } else {
+      oss << "\t_\t_\n";
+    }
+  }
+  return oss.str();
+}
+
+void ShardRunner::write_record(std::ostream & os, unsigned sid, const std::string & payload) {
+  uint32_t header[2] = { sid, static_cast<uint32_t>(payload.size()) };
+  os.write(reinterpret_cast<const char *>(header), sizeof(header));
+  os.write(payload.data(), payload.size());
+}
+
+bool ShardRunner::read_record(std::istream & is, unsigned & sid, std::string & payload) {
+  uint32_t header[2];
+  if (!is.read(reinterpret_cast<char *>(header), sizeof(header))) { return false; }
+  sid = header[0];
+  payload.resize(header[1]);
+  if (header[1] > 0 && !is.read(&payload[0], header[1])) { return false; }
+  return true;
+}
+
+bool ShardRunner::run_shard(const Job & job, unsigned shard) const {
+  std::string path = shard_path(shard);
+  std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream ofs(tmp_path, std::ios::binary);
+    if (!ofs.good()) {
+      _ERROR << "[twpipe|shard] failed to open " << tmp_path;
+      return false;
+    }
+    job(shard, ofs);
+    ofs.flush();
+    if (!ofs.good()) {
+      _ERROR << "[twpipe|shard] failed to write " << tmp_path;
+      return false;
+    }
+  }
+  return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+bool ShardRunner::run(const Job & job) {
+#if _MSC_VER
+  int ret = _mkdir(shard_dir.c_str());
+#else
+  int ret = mkdir(shard_dir.c_str(), 0755);
+#endif
+  if (ret != 0 && errno != EEXIST) {
+    _ERROR << "[twpipe|shard] failed to create " << shard_dir;
+    return false;
+  }
+
+  std::vector<unsigned> pending;
+  for (unsigned shard = 0; shard < n_shards; ++shard) {
+    std::ifstream ifs(shard_path(shard));
+    if (!ifs.good()) { pending.push_back(shard); }
+  }
+
+  // the finished shards are resumed only if they are computed from the same
+  // inputs, a changed corpus or model would otherwise be mixed into the output.
+  std::string expected = manifest();
+  std::string path = manifest_path();
+  std::ifstream mfs(path);
+  if (mfs.good()) {
+    std::string found((std::istreambuf_iterator<char>(mfs)), std::istreambuf_iterator<char>());
+    if (found != expected) {
+      _ERROR << "[twpipe|shard] the shards in " << shard_dir << " are computed from other inputs, "
+        << "see " << path << ". Remove them or use another --shard-dir.";
+      exit(1);
+    }
+  } else {
+    if (pending.size() < n_shards) {
+      _ERROR << "[twpipe|shard] the shards in " << shard_dir << " have no manifest, "
+        << "remove them or use another --shard-dir.";
+      exit(1);
+    }
+    std::string tmp_path = path + ".tmp";
+    std::ofstream ofs(tmp_path);
+    ofs << expected;
+    ofs.close();
+    if (!ofs.good() || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+      _ERROR << "[twpipe|shard] failed to write " << path;
+      return false;
+    }
+  }
+  for (unsigned shard = 0; shard < n_shards; ++shard) {
+    if (std::find(pending.begin(), pending.end(), shard) == pending.end()) {
+      _INFO << "[twpipe|shard] shard " << shard << " is finished, skipped.";
+    }
+  }
+  _INFO << "[twpipe|shard] " << pending.size() << " of " << n_shards << " shards to run on "
+    << n_workers << " workers.";
+
+  bool ok = true;
+#if _MSC_VER
+  for (unsigned shard : pending) {
+    if (!run_shard(job, shard)) { ok = false; }
+  }
+#else
+  if (pending.empty()) { return true; }
+  // the workers mark the shards they finish in shared memory.
+  size_t size = pending.size() * sizeof(int);
+  void * ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    _ERROR << "[twpipe|shard] failed to map the shard status.";
+    return false;
+  }
+  int * done = static_cast<int *>(ptr);
+  std::memset(done, 0, size);
+
+  // the job seeds its own random stream if it needs one.
+  unsigned n = std::min<unsigned>(n_workers, pending.size());
+  ok = fork_workers(n, [&](unsigned k) {
+    for (unsigned i = k; i < pending.size(); i += n) {
+      if (run_shard(job, pending[i])) { done[i] = 1; }
+    }
+  }, false);
+
+  for (unsigned i = 0; i < pending.size(); ++i) {
+    if (done[i]) {
+      _INFO << "[twpipe|shard] shard " << pending[i] << " finished.";
+    } else {
+      _ERROR << "[twpipe|shard] shard " << pending[i] << " failed.";
+      ok = false;
+    }
+  }
+  munmap(ptr, size);
+#endif
+  return ok;
+}
+
+void ShardRunner::merge(std::ostream & os) const {
+  std::vector<std::unique_ptr<std::ifstream>> streams(n_shards);
+  std::vector<unsigned> sids(n_shards);
+  std::vector<std::string> payloads(n_shards);
+  std::vector<bool> alive(n_shards, false);
+  for (unsigned shard = 0; shard < n_shards; ++shard) {
+    streams[shard].reset(new std::ifstream(shard_path(shard), std::ios::binary));
+    alive[shard] = read_record(*streams[shard], sids[shard], payloads[shard]);
+  }
+
+  unsigned n_records = 0;
+  while (true) {
+    unsigned best = n_shards;
+    for (unsigned shard = 0; shard < n_shards; ++shard) {
+      if (alive[shard] && (best == n_shards || sids[shard] < sids[best])) { best = shard; }
+    }
+    if (best == n_shards) { break; }
+    os.write(payloads[best].data(), payloads[best].size());
+    n_records++;
+    alive[best] = read_record(*streams[best], sids[best], payloads[best]);
+  }
+  os.flush();
+  _INFO << "[twpipe|shard] merged " << n_records << " records.";
+}
+
+}
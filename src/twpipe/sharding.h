@@ -0,0 +1,70 @@
+#ifndef __TWPIPE_SHARDING_H__
+#define __TWPIPE_SHARDING_H__
+
+#include <iostream>
+#include <functional>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+namespace twpipe {
+
+/// Run a job over a corpus as several shards in forked worker processes. The
+/// sentence sid belongs to shard (sid % n_shards). A shard is written to a
+/// temporary file and renamed when it completes, so a restarted run only
+/// processes the unfinished shards. A manifest of the inputs is kept with the
+/// shards, and a restart over changed inputs is refused. The workers are
+/// forked after the models are loaded, so they share the read-only weights
+/// with the parent.
+struct ShardRunner {
+  /// The job processes the sentences of one shard and writes records to os.
+  typedef std::function<void(unsigned shard, std::ostream & os)> Job;
+
+  unsigned n_shards;
+  unsigned n_workers;
+  std::string shard_dir;
+  /// The settings that change the output, e.g. its format. They are in the
+  /// shard names, so shards written with other settings are never resumed.
+  std::string output_name;
+  /// The files the shards are computed from, e.g. the corpus and the models.
+  std::vector<std::string> inputs;
+
+  static po::options_description get_options();
+
+  ShardRunner(const po::variables_map & conf,
+              const std::vector<std::string> & inputs,
+              const std::string & output_name = "");
+
+  bool enabled() const;
+
+  bool own(unsigned sid, unsigned shard) const;
+
+  /// Run the unfinished shards. Return false if any of the workers failed.
+  bool run(const Job & job);
+
+  /// Merge the payloads of all the shards into os in the order of sentence id.
+  void merge(std::ostream & os) const;
+
+  std::string shard_path(unsigned shard) const;
+
+  std::string manifest_path() const;
+
+  /// The number of shards, the output settings, and the path, size and mtime
+  /// of every input, one per line.
+  std::string manifest() const;
+
+  /// A record is the sentence id and the payload size as uint32, followed by
+  /// the payload, so the payload can be text or binary.
+  static void write_record(std::ostream & os, unsigned sid, const std::string & payload);
+
+  static bool read_record(std::istream & is, unsigned & sid, std::string & payload);
+
+private:
+  bool run_shard(const Job & job, unsigned shard) const;
+};
+
+}
+
+#endif  //  end for __TWPIPE_SHARDING_H__
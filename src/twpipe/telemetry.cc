@@ -0,0 +1,152 @@
+#include "telemetry.h"
+#include "logging.h"
+#include <cstdio>
+#if !_MSC_VER
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+namespace twpipe {
+
+bool TrainingTelemetry::enabled = false;
+TrainingTelemetry * TrainingTelemetry::instance = nullptr;
+
+namespace {
+
+/// The resident and the peak resident memory in KB, 0 when unknown.
+void get_memory(uint64_t & rss_kb, uint64_t & peak_rss_kb) {
+  rss_kb = 0;
+  peak_rss_kb = 0;
+#if !_MSC_VER
+  FILE * fp = std::fopen("/proc/self/statm", "r");
+  if (fp != nullptr) {
+    unsigned long size = 0, resident = 0;
+    if (std::fscanf(fp, "%lu %lu", &size, &resident) == 2) {
+      rss_kb = static_cast<uint64_t>(resident) * sysconf(_SC_PAGESIZE) / 1024;
+    }
+    std::fclose(fp);
+  }
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if __APPLE__
+    peak_rss_kb = usage.ru_maxrss / 1024;
+#else
+    peak_rss_kb = usage.ru_maxrss;
+#endif
+  }
+#endif
+}
+
+}
+
+TrainingTelemetry::TrainingTelemetry() : interval(0) {
+  reset();
+}
+
+po::options_description TrainingTelemetry::get_options() {
+  po::options_description telemetry_opts("Telemetry options");
+  telemetry_opts.add_options()
+    ("telemetry", po::value<std::string>()->implicit_value(""), "log the training throughput and its time split, also write them as csv to the file if given.")
+    ("telemetry-interval", po::value<unsigned>()->default_value(1000), "write a telemetry row every n training instances, 0 for once per iteration.")
+    ;
+  return telemetry_opts;
+}
+
+TrainingTelemetry * TrainingTelemetry::get() {
+  if (instance == nullptr) {
+    instance = new TrainingTelemetry();
+  }
+  return instance;
+}
+
+void TrainingTelemetry::configure(const po::variables_map & conf) {
+  if (!conf.count("telemetry")) { return; }
+  path = conf["telemetry"].as<std::string>();
+  interval = conf["telemetry-interval"].as<unsigned>();
+  if (!path.empty()) {
+    ofs.open(path);
+    if (!ofs.good()) {
+      _WARN << "[twpipe|telemetry] failed to open " << path << ", only logging.";
+    } else {
+      ofs << "phase,arch,objective,iter,instances,tokens,seconds,instances_per_s,tokens_per_s,"
+        << "nodes_per_instance,build_s,forward_s,backward_s,update_s,other_s,rss_kb,peak_rss_kb" << std::endl;
+      _INFO << "[twpipe|telemetry] writing the training telemetry to " << path;
+    }
+  }
+  enabled = true;
+}
+
+void TrainingTelemetry::begin(const std::string & phase,
+                              const std::string & arch,
+                              const std::string & objective) {
+  this->phase = phase;
+  this->arch = arch;
+  this->objective = objective;
+  reset();
+}
+
+void TrainingTelemetry::reset() {
+  n_instances = 0;
+  n_tokens = 0;
+  n_nodes = 0;
+  n_graphs = 0;
+  for (unsigned i = 0; i < kNumStages; ++i) { stages[i] = 0; }
+  start = std::chrono::steady_clock::now();
+}
+
+void TrainingTelemetry::record(Stage stage, uint64_t ns) {
+  stages[stage] += ns;
+}
+
+void TrainingTelemetry::add_graph(unsigned n_tokens, unsigned n_nodes) {
+  if (!enabled) { return; }
+  this->n_tokens += n_tokens;
+  this->n_nodes += n_nodes;
+  n_graphs++;
+}
+
+void TrainingTelemetry::count(unsigned iter, unsigned n_instances) {
+  if (!enabled) { return; }
+  this->n_instances += n_instances;
+  if (interval > 0 && this->n_instances >= interval) { write(iter); }
+}
+
+void TrainingTelemetry::end_iter(unsigned iter) {
+  if (!enabled || n_instances == 0) { return; }
+  write(iter);
+}
+
+void TrainingTelemetry::write(unsigned iter) {
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double stage_seconds[kNumStages];
+  double other = seconds;
+  for (unsigned i = 0; i < kNumStages; ++i) {
+    stage_seconds[i] = stages[i] / 1e9;
+    other -= stage_seconds[i];
+  }
+  uint64_t rss_kb, peak_rss_kb;
+  get_memory(rss_kb, peak_rss_kb);
+
+  double instances_per_s = (seconds > 0 ? n_instances / seconds : 0.);
+  double tokens_per_s = (seconds > 0 ? n_tokens / seconds : 0.);
+  double nodes_per_instance = (n_instances > 0 ? static_cast<double>(n_nodes) / n_instances : 0.);
+
+  _INFO << "[twpipe|telemetry] phase=" << phase << " arch=" << arch << " objective=" << objective
+    << " iter=" << iter << " instances=" << n_instances << " instances/s=" << instances_per_s
+    << " tokens/s=" << tokens_per_s << " nodes/instance=" << nodes_per_instance
+    << " build=" << stage_seconds[kBuild] << "s forward=" << stage_seconds[kForward]
+    << "s backward=" << stage_seconds[kBackward] << "s update=" << stage_seconds[kUpdate]
+    << "s other=" << other << "s rss=" << rss_kb << "KB peak_rss=" << peak_rss_kb << "KB";
+
+  if (ofs.is_open() && ofs.good()) {
+    // flushed at once, so the forked workers don't inherit buffered rows.
+    ofs << phase << "," << arch << "," << objective << "," << iter << "," << n_instances << ","
+      << n_tokens << "," << seconds << "," << instances_per_s << "," << tokens_per_s << ","
+      << nodes_per_instance << "," << stage_seconds[kBuild] << "," << stage_seconds[kForward] << ","
+      << stage_seconds[kBackward] << "," << stage_seconds[kUpdate] << "," << other << ","
+      << rss_kb << "," << peak_rss_kb << std::endl;
+  }
+  reset();
+}
+
+}
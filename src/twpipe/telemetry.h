@@ -0,0 +1,99 @@
+#ifndef __TWPIPE_TELEMETRY_H__
+#define __TWPIPE_TELEMETRY_H__
+
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <fstream>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+namespace twpipe {
+
+/// The throughput of training and where its time goes. A row is written
+/// every telemetry-interval instances: instances/s, tokens/s, graph nodes
+/// per instance, the time of building the graphs, forward, backward and
+/// update, and the resident memory. The rows are logged and written as csv
+/// to the telemetry file. With the forked workers the graphs are built in
+/// the workers, so only the instances and the time are reported.
+struct TrainingTelemetry {
+  enum Stage {
+    kBuild,
+    kForward,
+    kBackward,
+    kUpdate,
+    kNumStages
+  };
+
+  static bool enabled;
+
+protected:
+  static TrainingTelemetry * instance;
+  std::string path;
+  std::ofstream ofs;
+  unsigned interval;
+
+  std::string phase;
+  std::string arch;
+  std::string objective;
+
+  /// The counts since the last row.
+  uint64_t n_instances;
+  uint64_t n_tokens;
+  uint64_t n_nodes;
+  uint64_t n_graphs;
+  uint64_t stages[kNumStages];
+  std::chrono::steady_clock::time_point start;
+
+  TrainingTelemetry();
+
+  void reset();
+
+  void write(unsigned iter);
+
+public:
+  static po::options_description get_options();
+
+  static TrainingTelemetry * get();
+
+  void configure(const po::variables_map & conf);
+
+  /// Start a training phase, arch and objective label its rows.
+  void begin(const std::string & phase, const std::string & arch, const std::string & objective);
+
+  void record(Stage stage, uint64_t ns);
+
+  /// Count a graph built for n_tokens tokens.
+  void add_graph(unsigned n_tokens, unsigned n_nodes);
+
+  /// Count the instances of an update, a row is written every interval instances.
+  void count(unsigned iter, unsigned n_instances);
+
+  /// Write the instances of the iteration that are not in a row yet.
+  void end_iter(unsigned iter);
+};
+
+struct TelemetryTimer {
+  TrainingTelemetry::Stage stage;
+  bool on;
+  std::chrono::steady_clock::time_point start;
+
+  explicit TelemetryTimer(TrainingTelemetry::Stage stage) : stage(stage), on(TrainingTelemetry::enabled) {
+    if (on) { start = std::chrono::steady_clock::now(); }
+  }
+
+  ~TelemetryTimer() { stop(); }
+
+  void stop() {
+    if (on) {
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      TrainingTelemetry::get()->record(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+      on = false;
+    }
+  }
+};
+
+}
+
+#endif  //  end for __TWPIPE_TELEMETRY_H__
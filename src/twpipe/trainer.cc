@@ -1,7 +1,15 @@
 #include "trainer.h"
+#include "logging.h"
+#include "hogwild.h"
 #include <fstream>
+#include <algorithm>
+#include <cstring>
+#include "dynet/globals.h"
 #include <boost/algorithm/string.hpp>
 #include <boost/assert.hpp>
+#if !_MSC_VER
+#include <sys/mman.h>
+#endif
 
 namespace twpipe {
 
@@ -19,6 +27,12 @@ po::options_description Trainer::get_options() {
     ("max-iter", po::value<unsigned>()->default_value(100), "the maximum number of training.")
     ("evaluate-stops", po::value<unsigned>()->default_value(0), "perform early stopping.")
     ("evaluate-skips", po::value<unsigned>()->default_value(0), "skip the first n evaluation.")
+    ("batch-size", po::value<unsigned>()->default_value(1), "the number of instances in one update, use with --dynet-autobatch 1.")
+    ("train-workers", po::value<unsigned>()->default_value(1), "the number of processes for asynchronous (hogwild) training.")
+    ("workers", po::value<unsigned>()->default_value(1), "the number of processes for synchronous training, the gradients are averaged before each update.")
+    ("evaluate-workers", po::value<unsigned>()->default_value(1), "the number of processes decoding the heldout data.")
+    ("evaluate-adaptive", po::value<bool>()->default_value(false), "double the interval of evaluation stops when the heldout score doesn't improve.")
+    ("early-stop-patience", po::value<unsigned>()->default_value(0), "stop when the heldout score doesn't improve in n iterations, 0 to disable.")
     ;
   return training_opts;
 }
@@ -28,6 +42,20 @@ Trainer::Trainer(const po::variables_map & conf) {
   evaluate_stops = conf["evaluate-stops"].as<unsigned>();
   evaluate_skips = conf["evaluate-skips"].as<unsigned>();
   lambda_ = conf["lambda"].as<float>();
+  batch_size = std::max(1u, conf["batch-size"].as<unsigned>());
+  n_workers = std::max(1u, conf["train-workers"].as<unsigned>());
+  n_sync_workers = std::max(1u, conf["workers"].as<unsigned>());
+  n_eval_workers = std::max(1u, conf["evaluate-workers"].as<unsigned>());
+  evaluate_adaptive = conf["evaluate-adaptive"].as<bool>();
+  early_stop_patience = conf["early-stop-patience"].as<unsigned>();
+  n_bad_iters = 0;
+  improved_in_iter = false;
+  evaluate_interval = evaluate_stops;
+  last_evaluate = 0;
+  if (n_workers > 1 && n_sync_workers > 1) {
+    _ERROR << "[twpipe|trainer] --train-workers and --workers can't be used together.";
+    exit(1);
+  }
 }
 
 bool Trainer::need_evaluate(unsigned iter) {
@@ -38,4 +66,108 @@ bool Trainer::need_evaluate(unsigned iter, unsigned n_trained) {
   return ((iter > evaluate_skips) && evaluate_stops > 0 && (n_trained % evaluate_stops == 0));
 }
 
+bool Trainer::need_evaluate(unsigned iter, unsigned n_trained, unsigned n_batch) {
+  if (evaluate_adaptive) {
+    if (iter <= evaluate_skips || evaluate_stops == 0 || n_trained - last_evaluate < evaluate_interval) {
+      if (iter <= evaluate_skips) { last_evaluate = n_trained; }
+      return false;
+    }
+    last_evaluate = n_trained;
+    return true;
+  }
+  if (n_batch == 1) { return need_evaluate(iter, n_trained); }
+  return ((iter > evaluate_skips) && evaluate_stops > 0 &&
+          (n_trained / evaluate_stops != (n_trained - n_batch) / evaluate_stops));
+}
+
+bool Trainer::check_best(float score, float best_score) {
+  bool improved = score > best_score;
+  if (improved) { improved_in_iter = true; }
+  if (evaluate_adaptive && evaluate_stops > 0) {
+    if (improved) {
+      evaluate_interval = evaluate_stops;
+    } else if (evaluate_interval < (1u << 30)) {
+      evaluate_interval *= 2;
+    }
+  }
+  return improved;
+}
+
+bool Trainer::finish_iter(unsigned iter, OptimizerBuilder & opt_builder, dynet::Trainer * trainer) {
+  // the iterations without evaluation are neither good nor bad.
+  bool evaluated = need_evaluate(iter);
+  bool improved = (!evaluated || improved_in_iter);
+  improved_in_iter = false;
+  opt_builder.update(trainer, iter, improved);
+
+  if (!evaluated) { return false; }
+  n_bad_iters = (improved ? 0 : n_bad_iters + 1);
+  if (early_stop_patience > 0 && n_bad_iters >= early_stop_patience) {
+    _INFO << "[twpipe|trainer] heldout score didn't improve in " << n_bad_iters
+      << " iterations, stopped at iter #" << iter;
+    return true;
+  }
+  return false;
+}
+
+void Trainer::get_batches(const std::vector<unsigned> & order,
+                          const std::vector<unsigned> & lengths,
+                          std::vector<std::vector<unsigned>> & batches) const {
+  batches.clear();
+  if (batch_size == 1) {
+    for (unsigned id : order) { batches.push_back(std::vector<unsigned>(1, id)); }
+    return;
+  }
+
+  // sorting within a pool instead of the whole data keeps the batches random.
+  const unsigned pool_size = batch_size * 32;
+  std::vector<unsigned> pool;
+  for (unsigned start = 0; start < order.size(); start += pool_size) {
+    unsigned end = std::min<unsigned>(start + pool_size, order.size());
+    pool.assign(order.begin() + start, order.begin() + end);
+    std::stable_sort(pool.begin(), pool.end(),
+                     [&lengths](unsigned a, unsigned b) { return lengths[a] < lengths[b]; });
+    for (unsigned i = 0; i < pool.size(); i += batch_size) {
+      unsigned j = std::min<unsigned>(i + batch_size, pool.size());
+      batches.push_back(std::vector<unsigned>(pool.begin() + i, pool.begin() + j));
+    }
+  }
+  std::shuffle(batches.begin(), batches.end(), *dynet::rndeng);
+}
+
+
+void Trainer::parallel_evaluate(unsigned n_instances,
+                                std::vector<float> & counts,
+                                const EvaluateRange & eval) const {
+  std::fill(counts.begin(), counts.end(), 0.f);
+  unsigned n_workers = std::min(n_eval_workers, n_instances);
+#if !_MSC_VER
+  if (n_workers > 1) {
+    size_t size = n_workers * counts.size() * sizeof(float);
+    void * ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ptr != MAP_FAILED) {
+      float * shared = static_cast<float *>(ptr);
+      std::memset(shared, 0, size);
+      // the random engine is left untouched, so the training doesn't depend
+      // on the number of evaluation workers.
+      bool ok = fork_workers(n_workers, [&](unsigned k) {
+        std::vector<float> local(counts.size(), 0.f);
+        eval(n_instances * k / n_workers, n_instances * (k + 1) / n_workers, local);
+        std::copy(local.begin(), local.end(), shared + k * counts.size());
+      }, false);
+      if (ok) {
+        for (unsigned k = 0; k < n_workers; ++k) {
+          for (unsigned i = 0; i < counts.size(); ++i) { counts[i] += shared[k * counts.size() + i]; }
+        }
+      }
+      munmap(ptr, size);
+      if (ok) { return; }
+      std::fill(counts.begin(), counts.end(), 0.f);
+    }
+    _WARN << "[twpipe|trainer] parallel evaluation failed, evaluate in one process.";
+  }
+#endif
+  eval(0, n_instances, counts);
+}
+
 }
\ No newline at end of file
@@ -2,7 +2,10 @@
 #define __TWPIPE_TRAINER_H__
 
 #include <iostream>
+#include <vector>
+#include <functional>
 #include <boost/program_options.hpp>
+#include "optimizer_builder.h"
 
 namespace po = boost::program_options;
 
@@ -14,6 +17,18 @@ struct Trainer {
   unsigned evaluate_stops;
   unsigned evaluate_skips;
   float lambda_;
+  unsigned batch_size;
+  unsigned n_workers;
+  unsigned n_sync_workers;
+  unsigned n_eval_workers;
+  unsigned early_stop_patience;
+  bool evaluate_adaptive;
+
+  /// The states of the early stopping and the adaptive evaluation.
+  unsigned n_bad_iters;
+  bool improved_in_iter;
+  unsigned evaluate_interval;
+  unsigned last_evaluate;
 
   static po::options_description get_options();
 
@@ -22,6 +37,37 @@ struct Trainer {
   bool need_evaluate(unsigned iter);
   
   bool need_evaluate(unsigned iter, unsigned n_trained);
+
+  /// Whether an evaluation stop is passed by the last n_batch instances. With
+  /// evaluate-adaptive, the stops are evaluate_interval instances apart.
+  bool need_evaluate(unsigned iter, unsigned n_trained, unsigned n_batch);
+
+  /// Return whether the heldout score beats the best one. The result is recorded
+  /// for the early stopping and the adaptive evaluation: the interval doubles
+  /// when the score doesn't improve and is reset when it does.
+  bool check_best(float score, float best_score);
+
+  /// Called at the end of each iteration, update the learning rate and return
+  /// true if the score hasn't improved in early_stop_patience iterations.
+  bool finish_iter(unsigned iter, OptimizerBuilder & opt_builder, dynet::Trainer * trainer);
+
+  /// Split the shuffled order into the minibatches. The instances are sorted by
+  /// length within pools of several batches, so the instances in a batch are of
+  /// similar length, and the batches are shuffled. lengths is indexed by the
+  /// elements of order.
+  void get_batches(const std::vector<unsigned> & order,
+                   const std::vector<unsigned> & lengths,
+                   std::vector<std::vector<unsigned>> & batches) const;
+
+  /// Add the counts of the instances [begin, end) to counts.
+  typedef std::function<void(unsigned begin, unsigned end, std::vector<float> & counts)> EvaluateRange;
+
+  /// Evaluate n_instances heldout instances with n_eval_workers forked
+  /// processes, each takes a contiguous part. The workers decode on a
+  /// copy-on-write snapshot of the parameters and their counts are summed.
+  void parallel_evaluate(unsigned n_instances,
+                         std::vector<float> & counts,
+                         const EvaluateRange & eval) const;
 };
 
 }
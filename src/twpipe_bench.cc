@@ -0,0 +1,551 @@
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <fstream>
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+#include <boost/program_options.hpp>
+#include "dynet/dynet.h"
+#include "tokenizer/tokenize_model.h"
+#include "tokenizer/tokenize_model_builder.h"
+#include "postagger/postag_model.h"
+#include "postagger/postag_model_builder.h"
+#include "parser/parse_model.h"
+#include "parser/parse_model_builder.h"
+#include "parser/arcstd.h"
+#include "parser/arceager.h"
+#include "parser/archybrid.h"
+#include "parser/swap.h"
+#include "twpipe/logging.h"
+#include "twpipe/alphabet_collection.h"
+#include "twpipe/corpus.h"
+#include "twpipe/embedding.h"
+#include "twpipe/cluster.h"
+#include "twpipe/normalizer.h"
+#include "twpipe/unicode.h"
+
+namespace po = boost::program_options;
+
+// The benchmarks run on a synthetic corpus and on models with random
+// parameters, so they need no data and the numbers are comparable between
+// releases. The results are written as json unless --benchmark_format or
+// --benchmark_out_format is given.
+
+namespace {
+
+const unsigned kNumSentences = 500;
+const unsigned kVocabSize = 2000;
+const unsigned kSeed = 1;
+
+const char* kPostags[] = { "ADJ", "ADP", "ADV", "AUX", "CCONJ", "DET", "INTJ", "NOUN",
+  "NUM", "PART", "PRON", "PROPN", "PUNCT", "SCONJ", "SYM", "VERB", "X" };
+const char* kDeprels[] = { "root", "nsubj", "obj", "iobj", "obl", "advmod", "amod", "nmod",
+  "det", "case", "cc", "conj", "punct", "compound", "discourse", "parataxis" };
+const char* kPieces[] = { "a", "e", "i", "o", "u", "n", "r", "s", "t", "l", "k", "m",
+  "\xc3\xa9", "\xc3\xb1", "\xe4\xb8\xad", "\xf0\x9f\x98\x80" };
+
+struct SyntheticCorpus {
+  std::vector<std::string> vocab;
+  /// The conllu text of each sentence.
+  std::vector<std::string> conllu;
+  twpipe::Corpus corpus;
+  std::vector<std::vector<std::string>> words;
+  std::vector<std::vector<std::string>> postags;
+  std::vector<std::vector<unsigned>> heads;
+  std::vector<std::vector<unsigned>> deprels;
+  unsigned n_tokens;
+
+  SyntheticCorpus() : n_tokens(0) {}
+
+  std::string make_word(std::mt19937 & rng, unsigned i) {
+    switch (i % 50) {
+    case 0: return "@user" + std::to_string(i);
+    case 1: return "http://t.co/" + std::to_string(i);
+    case 2: return "#tag" + std::to_string(i);
+    case 3: return std::to_string(i);
+    case 4: return ":)";
+    case 5: return "loooool";
+    default: break;
+    }
+    std::uniform_int_distribution<unsigned> len(2, 8);
+    std::uniform_int_distribution<unsigned> piece(0, sizeof(kPieces) / sizeof(kPieces[0]) - 1);
+    std::string word;
+    for (unsigned n = len(rng); n > 0; --n) { word += kPieces[piece(rng)]; }
+    return word;
+  }
+
+  /// Attach the words in [begin, end) to parent, the tree is projective.
+  void make_tree(std::mt19937 & rng, unsigned begin, unsigned end, unsigned parent,
+                 std::vector<unsigned> & tree) {
+    if (begin >= end) { return; }
+    unsigned root = std::uniform_int_distribution<unsigned>(begin, end - 1)(rng);
+    tree[root] = parent;
+    make_tree(rng, begin, root, root, tree);
+    make_tree(rng, root + 1, end, root, tree);
+  }
+
+  void build() {
+    std::mt19937 rng(kSeed);
+    for (unsigned i = 0; i < kVocabSize; ++i) { vocab.push_back(make_word(rng, i)); }
+
+    twpipe::AlphabetCollection * collection = twpipe::AlphabetCollection::get();
+    collection->word_map.insert(twpipe::Corpus::BAD0);
+    collection->word_map.insert(twpipe::Corpus::UNK);
+    collection->word_map.insert(twpipe::Corpus::ROOT);
+    collection->char_map.insert(twpipe::Corpus::BAD0);
+    collection->char_map.insert(twpipe::Corpus::UNK);
+    collection->char_map.insert(twpipe::Corpus::ROOT);
+    collection->char_map.insert(twpipe::Corpus::SPACE);
+    collection->pos_map.insert(twpipe::Corpus::ROOT);
+
+    // zipfian word frequencies.
+    std::vector<double> weights(kVocabSize);
+    for (unsigned i = 0; i < kVocabSize; ++i) { weights[i] = 1. / (i + 1); }
+    std::discrete_distribution<unsigned> word_dist(weights.begin(), weights.end());
+    std::uniform_int_distribution<unsigned> len_dist(5, 40);
+    std::uniform_int_distribution<unsigned> pos_dist(0, sizeof(kPostags) / sizeof(kPostags[0]) - 1);
+    std::uniform_int_distribution<unsigned> rel_dist(1, sizeof(kDeprels) / sizeof(kDeprels[0]) - 1);
+    std::bernoulli_distribution no_space(.1);
+
+    for (unsigned s = 0; s < kNumSentences; ++s) {
+      unsigned len = len_dist(rng);
+      std::vector<unsigned> tree(len + 1, 0);
+      make_tree(rng, 1, len + 1, 0, tree);
+
+      std::string payload;
+      for (unsigned i = 1; i <= len; ++i) {
+        payload += std::to_string(i) + "\t" + vocab[word_dist(rng)] + "\t_\t" +
+          kPostags[pos_dist(rng)] + "\t_\t_\t" + std::to_string(tree[i]) + "\t" +
+          (tree[i] == 0 ? kDeprels[0] : kDeprels[rel_dist(rng)]) + "\t_\t" +
+          (no_space(rng) ? "SpaceAfter=No" : "_") + "\n";
+      }
+      conllu.push_back(payload);
+
+      corpus.training_data.push_back(twpipe::Instance());
+      twpipe::Instance & inst = corpus.training_data.back();
+      corpus.parse_data(payload, inst, true);
+
+      words.push_back(std::vector<std::string>());
+      postags.push_back(std::vector<std::string>());
+      for (unsigned i = 1; i < inst.input_units.size(); ++i) {
+        words.back().push_back(inst.input_units.word(i));
+        postags.back().push_back(inst.input_units.postag(i));
+      }
+      heads.push_back(std::vector<unsigned>());
+      deprels.push_back(std::vector<unsigned>());
+      twpipe::Corpus::parse_units_to_vector(inst.parse_units, heads.back(), deprels.back());
+      n_tokens += len;
+    }
+    corpus.n_train = corpus.training_data.size();
+  }
+
+  /// Load a pretrained embedding for half of the vocabulary. The file name
+  /// contains glove, so the words are normalized when rendered.
+  void build_embedding(unsigned dim) {
+    char path[] = "/tmp/twpipe_bench_glove_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+      _WARN << "[twpipe|bench] failed to create the embedding file, using an empty one.";
+      twpipe::WordEmbedding::get()->empty(dim);
+      return;
+    }
+    close(fd);
+    {
+      std::mt19937 rng(kSeed);
+      std::uniform_real_distribution<float> value(-1.f, 1.f);
+      std::ofstream ofs(path);
+      ofs << kVocabSize / 2 << " " << dim << "\n";
+      for (unsigned i = 0; i < kVocabSize; i += 2) {
+        ofs << twpipe::GloveNormalizer::normalize(vocab[i]);
+        for (unsigned d = 0; d < dim; ++d) { ofs << " " << value(rng); }
+        ofs << "\n";
+      }
+    }
+    twpipe::WordEmbedding::get()->load(path, dim);
+    std::remove(path);
+  }
+};
+
+SyntheticCorpus * bench_data = nullptr;
+
+po::variables_map model_conf(const std::vector<std::string> & args) {
+  po::options_description opts;
+  opts.add(twpipe::WordEmbedding::get_options())
+    .add(twpipe::AbstractTokenizeModel::get_options())
+    .add(twpipe::PostagModel::get_options())
+    .add(twpipe::ParseModel::get_options())
+    ;
+  po::variables_map conf;
+  po::store(po::command_line_parser(args).options(opts).run(), conf);
+  po::notify(conf);
+  return conf;
+}
+
+twpipe::TransitionSystem * get_system(const std::string & name) {
+  static std::map<std::string, twpipe::TransitionSystem *> systems;
+  if (!systems.count(name)) {
+    if (name == "arcstd") {
+      systems[name] = new twpipe::ArcStandard();
+    } else if (name == "arceager") {
+      systems[name] = new twpipe::ArcEager();
+    } else if (name == "archybrid") {
+      systems[name] = new twpipe::ArcHybrid();
+    } else {
+      systems[name] = new twpipe::Swap();
+    }
+  }
+  return systems[name];
+}
+
+void init_state(unsigned len, twpipe::State & state) {
+  // same as ParseModel::initialize_state
+  state.buffer.resize(len + 1);
+  for (unsigned i = 0; i < len; ++i) { state.buffer[len - i] = i; }
+  state.buffer[0] = twpipe::Corpus::BAD_HED;
+  state.stack.push_back(twpipe::Corpus::BAD_HED);
+}
+
+void BM_AlphabetGetString(benchmark::State & state) {
+  const twpipe::Alphabet & word_map = twpipe::AlphabetCollection::get()->word_map;
+  size_t n = 0;
+  unsigned s = 0;
+  for (auto _ : state) {
+    for (const std::string & word : bench_data->words[s]) {
+      benchmark::DoNotOptimize(word_map.get(word));
+    }
+    n += bench_data->words[s].size();
+    s = (s + 1) % kNumSentences;
+  }
+  state.SetItemsProcessed(n);
+}
+
+void BM_AlphabetGetId(benchmark::State & state) {
+  const twpipe::Alphabet & word_map = twpipe::AlphabetCollection::get()->word_map;
+  unsigned size = word_map.size();
+  unsigned id = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(word_map.get(id));
+    id = (id + 1) % size;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_AlphabetContains(benchmark::State & state) {
+  const twpipe::Alphabet & word_map = twpipe::AlphabetCollection::get()->word_map;
+  // half of the queries miss.
+  std::vector<std::string> queries;
+  for (unsigned i = 0; i < 1000; ++i) {
+    queries.push_back(i % 2 ? bench_data->vocab[i] : bench_data->vocab[i] + "#");
+  }
+  unsigned i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(word_map.contains(queries[i]));
+    i = (i + 1) % queries.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_Utf8Len(benchmark::State & state) {
+  size_t n = 0;
+  unsigned s = 0;
+  for (auto _ : state) {
+    const std::string & raw = bench_data->corpus.training_data[s].raw_sentence;
+    unsigned n_chars = 0;
+    for (unsigned cur = 0; cur < raw.size(); cur += twpipe::utf8_len(raw[cur])) { ++n_chars; }
+    benchmark::DoNotOptimize(n_chars);
+    n += raw.size();
+    s = (s + 1) % kNumSentences;
+  }
+  state.SetBytesProcessed(n);
+}
+
+void BM_Utf8Decode(benchmark::State & state) {
+  // split into characters and get their categories, as the tokenizers do.
+  size_t n = 0;
+  unsigned s = 0;
+  std::string ch;
+  for (auto _ : state) {
+    const std::string & raw = bench_data->corpus.training_data[s].raw_sentence;
+    unsigned n_letters = 0;
+    for (unsigned cur = 0; cur < raw.size(); ) {
+      unsigned len = twpipe::utf8_len(raw[cur]);
+      ch.assign(raw, cur, len);
+      char32_t c = twpipe::utf8_to_unicode_first_(ch);
+      if (ufal::unilib::unicode::category(c) & ufal::unilib::unicode::L) { ++n_letters; }
+      cur += len;
+    }
+    benchmark::DoNotOptimize(n_letters);
+    n += raw.size();
+    s = (s + 1) % kNumSentences;
+  }
+  state.SetBytesProcessed(n);
+}
+
+template <typename Normalizer>
+void BM_Normalize(benchmark::State & state) {
+  size_t n = 0;
+  unsigned s = 0;
+  for (auto _ : state) {
+    for (const std::string & word : bench_data->words[s]) {
+      benchmark::DoNotOptimize(Normalizer::normalize(word));
+    }
+    n += bench_data->words[s].size();
+    s = (s + 1) % kNumSentences;
+  }
+  state.SetItemsProcessed(n);
+}
+
+void BM_EmbeddingRender(benchmark::State & state) {
+  size_t n = 0;
+  unsigned s = 0;
+  std::vector<std::vector<float>> values;
+  for (auto _ : state) {
+    twpipe::WordEmbedding::get()->render(bench_data->words[s], values);
+    benchmark::DoNotOptimize(values.data());
+    n += bench_data->words[s].size();
+    s = (s + 1) % kNumSentences;
+  }
+  state.SetItemsProcessed(n);
+}
+
+void BM_CorpusParseData(benchmark::State & state) {
+  size_t n = 0;
+  unsigned s = 0;
+  twpipe::Instance inst;
+  for (auto _ : state) {
+    bench_data->corpus.parse_data(bench_data->conllu[s], inst, false);
+    n += bench_data->conllu[s].size();
+    s = (s + 1) % kNumSentences;
+  }
+  state.SetBytesProcessed(n);
+}
+
+void BM_TransitionOracle(benchmark::State & state, const std::string & name) {
+  twpipe::TransitionSystem * system = get_system(name);
+  size_t n = 0;
+  unsigned s = 0;
+  std::vector<unsigned> actions;
+  for (auto _ : state) {
+    // some of the oracles append to the actions.
+    actions.clear();
+    system->get_oracle_actions(bench_data->heads[s], bench_data->deprels[s], actions);
+    n += actions.size();
+    s = (s + 1) % kNumSentences;
+  }
+  state.SetItemsProcessed(n);
+}
+
+void BM_TransitionPerform(benchmark::State & state, const std::string & name) {
+  // replay the oracle, asking for the valid actions before each action as the
+  // decoder does.
+  twpipe::TransitionSystem * system = get_system(name);
+  std::vector<std::vector<unsigned>> oracles(kNumSentences);
+  for (unsigned s = 0; s < kNumSentences; ++s) {
+    system->get_oracle_actions(bench_data->heads[s], bench_data->deprels[s], oracles[s]);
+  }
+  size_t n = 0;
+  unsigned s = 0;
+  std::vector<unsigned> valid_actions;
+  for (auto _ : state) {
+    twpipe::State parse_state(bench_data->heads[s].size());
+    init_state(bench_data->heads[s].size(), parse_state);
+    for (unsigned action : oracles[s]) {
+      system->get_valid_actions(parse_state, valid_actions);
+      system->perform_action(parse_state, action);
+    }
+    benchmark::DoNotOptimize(parse_state.heads.data());
+    n += oracles[s].size();
+    s = (s + 1) % kNumSentences;
+  }
+  state.SetItemsProcessed(n);
+}
+
+void BM_Tokenize(benchmark::State & state, const std::string & name) {
+  static std::map<std::string, twpipe::TokenizeModel *> engines;
+  static std::map<std::string, dynet::ParameterCollection *> models;
+  if (!engines.count(name)) {
+    po::variables_map conf = model_conf({ "--tok-model-name", name });
+    twpipe::TokenizeModelBuilder builder(conf);
+    models[name] = new dynet::ParameterCollection;
+    engines[name] = builder.build(*models[name]);
+  }
+  twpipe::TokenizeModel * engine = engines[name];
+  size_t n = 0;
+  unsigned s = 0;
+  std::vector<std::string> tokens;
+  for (auto _ : state) {
+    const std::string & raw = bench_data->corpus.training_data[s].raw_sentence;
+    engine->tokenize(raw, tokens);
+    n += raw.size();
+    s = (s + 1) % kNumSentences;
+  }
+  state.SetBytesProcessed(n);
+}
+
+void BM_SegmentAndTokenize(benchmark::State & state, const std::string & name) {
+  static std::map<std::string, twpipe::SentenceSegmentAndTokenizeModel *> engines;
+  static std::map<std::string, dynet::ParameterCollection *> models;
+  if (!engines.count(name)) {
+    po::variables_map conf = model_conf({ "--tok-model-name", name });
+    twpipe::SentenceSegmentAndTokenizeModelBuilder builder(conf);
+    models[name] = new dynet::ParameterCollection;
+    engines[name] = builder.build(*models[name]);
+  }
+  twpipe::SentenceSegmentAndTokenizeModel * engine = engines[name];
+  size_t n = 0;
+  unsigned s = 0;
+  std::vector<std::vector<std::string>> sentences;
+  for (auto _ : state) {
+    const std::string & raw = bench_data->corpus.training_data[s].raw_sentence;
+    engine->sentsegment_and_tokenize(raw, sentences);
+    n += raw.size();
+    s = (s + 1) % kNumSentences;
+  }
+  state.SetBytesProcessed(n);
+}
+
+void BM_Postag(benchmark::State & state, const std::string & name) {
+  static std::map<std::string, twpipe::PostagModel *> engines;
+  static std::map<std::string, dynet::ParameterCollection *> models;
+  if (!engines.count(name)) {
+    po::variables_map conf = model_conf({ "--pos-model-name", name });
+    twpipe::PostagModelBuilder builder(conf);
+    models[name] = new dynet::ParameterCollection;
+    engines[name] = builder.build(*models[name]);
+  }
+  twpipe::PostagModel * engine = engines[name];
+  size_t n = 0;
+  unsigned s = 0;
+  std::vector<std::string> tags;
+  for (auto _ : state) {
+    engine->postag(bench_data->words[s], tags);
+    n += bench_data->words[s].size();
+    s = (s + 1) % kNumSentences;
+  }
+  state.SetItemsProcessed(n);
+}
+
+void BM_Parse(benchmark::State & state, const std::string & arch, const std::string & system) {
+  static std::map<std::string, twpipe::ParseModel *> engines;
+  static std::map<std::string, dynet::ParameterCollection *> models;
+  std::string key = arch + "/" + system;
+  if (!engines.count(key)) {
+    po::variables_map conf = model_conf({ "--parse-arch", arch, "--parse-system", system });
+    twpipe::ParseModelBuilder builder(conf);
+    models[key] = new dynet::ParameterCollection;
+    engines[key] = builder.build(*models[key]);
+  }
+  twpipe::ParseModel * engine = engines[key];
+  size_t n = 0;
+  unsigned s = 0;
+  std::vector<unsigned> heads;
+  std::vector<std::string> deprels;
+  for (auto _ : state) {
+    engine->predict(bench_data->words[s], bench_data->postags[s], heads, deprels);
+    n += bench_data->words[s].size();
+    s = (s + 1) % kNumSentences;
+  }
+  state.SetItemsProcessed(n);
+}
+
+void register_benchmarks() {
+  benchmark::RegisterBenchmark("alphabet/get_string", BM_AlphabetGetString);
+  benchmark::RegisterBenchmark("alphabet/get_id", BM_AlphabetGetId);
+  benchmark::RegisterBenchmark("alphabet/contains", BM_AlphabetContains);
+  benchmark::RegisterBenchmark("unicode/utf8_len", BM_Utf8Len);
+  benchmark::RegisterBenchmark("unicode/decode", BM_Utf8Decode);
+  benchmark::RegisterBenchmark("normalizer/glove", BM_Normalize<twpipe::GloveNormalizer>);
+  benchmark::RegisterBenchmark("normalizer/owoputi", BM_Normalize<twpipe::OwoputiNormalizer>);
+  benchmark::RegisterBenchmark("embedding/render", BM_EmbeddingRender);
+  benchmark::RegisterBenchmark("corpus/parse_data", BM_CorpusParseData);
+
+  for (const char * name : { "arcstd", "arceager", "archybrid", "swap" }) {
+    std::string system = name;
+    benchmark::RegisterBenchmark(("transition/oracle/" + system).c_str(),
+                                 [system](benchmark::State & state) { BM_TransitionOracle(state, system); });
+    benchmark::RegisterBenchmark(("transition/perform/" + system).c_str(),
+                                 [system](benchmark::State & state) { BM_TransitionPerform(state, system); });
+  }
+
+  for (const char * name : { "bi-gru", "bi-lstm", "seg-gru", "seg-lstm" }) {
+    std::string model_name = name;
+    benchmark::RegisterBenchmark(("decode/tokenize/" + model_name).c_str(),
+                                 [model_name](benchmark::State & state) { BM_Tokenize(state, model_name); })
+      ->Unit(benchmark::kMicrosecond);
+  }
+  for (const char * name : { "bi-gru", "bi-lstm" }) {
+    std::string model_name = name;
+    benchmark::RegisterBenchmark(("decode/segment_and_tokenize/" + model_name).c_str(),
+                                 [model_name](benchmark::State & state) { BM_SegmentAndTokenize(state, model_name); })
+      ->Unit(benchmark::kMicrosecond);
+  }
+  for (const char * name : { "char-gru", "char-lstm", "char-cnn-gru", "char-cnn-lstm",
+                             "char-gru-crf", "char-lstm-crf", "word-gru", "word-lstm",
+                             "word-char-gru", "word-char-lstm" }) {
+    std::string model_name = name;
+    benchmark::RegisterBenchmark(("decode/postag/" + model_name).c_str(),
+                                 [model_name](benchmark::State & state) { BM_Postag(state, model_name); })
+      ->Unit(benchmark::kMicrosecond);
+  }
+  for (const char * arch_name : { "dyer15", "ballesteros15", "kiperwasser16" }) {
+    for (const char * system_name : { "arcstd", "arceager", "archybrid", "swap" }) {
+      std::string arch = arch_name, system = system_name;
+      benchmark::RegisterBenchmark(("decode/parse/" + arch + "/" + system).c_str(),
+                                   [arch, system](benchmark::State & state) { BM_Parse(state, arch, system); })
+        ->Unit(benchmark::kMicrosecond);
+    }
+  }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  // a fixed dynet seed by default, so the random parameters, and with them the
+  // parsers' action paths, are the same in every run.
+  std::vector<char *> dynet_args(argv, argv + argc);
+  bool has_seed = false;
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]).find("--dynet-seed") == 0) { has_seed = true; }
+  }
+  char seed_flag[] = "--dynet-seed";
+  std::string seed_value = std::to_string(kSeed);
+  if (!has_seed) {
+    dynet_args.insert(dynet_args.begin() + 1, &seed_value[0]);
+    dynet_args.insert(dynet_args.begin() + 1, seed_flag);
+  }
+  dynet_args.push_back(nullptr);
+  int n_dynet_args = dynet_args.size() - 1;
+  char ** dynet_argv = dynet_args.data();
+  dynet::initialize(n_dynet_args, dynet_argv);
+  argc = n_dynet_args;
+  argv = dynet_argv;
+
+  // json by default, the flags given later win.
+  std::vector<char *> args(argv, argv + argc);
+  bool has_format = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.find("--benchmark_format") == 0 || arg.find("--benchmark_out_format") == 0) {
+      has_format = true;
+    }
+  }
+  char json_format[] = "--benchmark_format=json";
+  if (!has_format) { args.insert(args.begin() + 1, json_format); }
+  int n_args = args.size();
+
+  benchmark::Initialize(&n_args, args.data());
+  if (benchmark::ReportUnrecognizedArguments(n_args, args.data())) { return 1; }
+  twpipe::init_boost_log(false);
+
+  bench_data = new SyntheticCorpus();
+  bench_data->build();
+  bench_data->build_embedding(model_conf({})["embedding-dim"].as<unsigned>());
+  twpipe::WordCluster::get()->empty();
+  _INFO << "[twpipe|bench] synthetic corpus of " << kNumSentences << " sentences, "
+    << bench_data->n_tokens << " tokens.";
+
+  register_benchmarks();
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,321 @@
+#include <iostream>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include "tokenizer/tokenize_model.h"
+#include "twpipe/logging.h"
+#include "twpipe/mapped_file.h"
+
+namespace po = boost::program_options;
+
+namespace {
+
+/// A sentence of a CoNLL-U file, comments, multiword token ranges and empty
+/// nodes are skipped.
+struct ConllSentence {
+  std::vector<std::string> words;
+  std::vector<std::string> postags;
+  std::vector<unsigned> heads;
+  std::vector<std::string> deprels;
+  /// The words joined without spaces, sentences are matched by it.
+  std::string key;
+
+  void clear() {
+    words.clear(); postags.clear(); heads.clear(); deprels.clear(); key.clear();
+  }
+};
+
+/// The counts of one chunk, summed up at the end. They are 64-bit integers,
+/// a float stops counting single words beyond 2^24 of them.
+struct EvalCounts {
+  uint64_t n_recall, n_pred, n_gold;
+  uint64_t n_pos_corr, n_uas_corr, n_las_corr, n_total;
+  uint64_t n_sentences, n_not_found;
+
+  EvalCounts() : n_recall(0), n_pred(0), n_gold(0),
+    n_pos_corr(0), n_uas_corr(0), n_las_corr(0), n_total(0),
+    n_sentences(0), n_not_found(0) {
+  }
+
+  void add(const EvalCounts & other) {
+    n_recall += other.n_recall; n_pred += other.n_pred; n_gold += other.n_gold;
+    n_pos_corr += other.n_pos_corr; n_uas_corr += other.n_uas_corr;
+    n_las_corr += other.n_las_corr; n_total += other.n_total;
+    n_sentences += other.n_sentences; n_not_found += other.n_not_found;
+  }
+};
+
+bool is_blank(const char * begin, const char * end) {
+  for (; begin < end; ++begin) {
+    if (*begin != ' ' && *begin != '\t' && *begin != '\r') { return false; }
+  }
+  return true;
+}
+
+const char * line_end(const char * p, const char * end) {
+  const char * q = static_cast<const char *>(memchr(p, '\n', end - p));
+  return (q == nullptr ? end : q);
+}
+
+/// The start of the first sentence at or after p, that is the line after a
+/// blank line. The chunks of the threads are cut there.
+const char * next_sentence(const char * data, const char * p, const char * end) {
+  if (p <= data) { return data; }
+  // move to the start of a line.
+  if (*(p - 1) != '\n') {
+    p = line_end(p, end);
+    if (p < end) { ++p; }
+  }
+  while (p < end) {
+    const char * e = line_end(p, end);
+    if (is_blank(p, e)) { return (e < end ? e + 1 : end); }
+    p = (e < end ? e + 1 : end);
+  }
+  return end;
+}
+
+void split_fields(const char * p, const char * end, std::vector<std::pair<const char *, const char *>> & fields) {
+  fields.clear();
+  while (p < end) {
+    while (p < end && (*p == '\t' || *p == ' ' || *p == '\r')) { ++p; }
+    if (p == end) { break; }
+    const char * q = p;
+    while (q < end && *q != '\t' && *q != ' ' && *q != '\r') { ++q; }
+    fields.push_back(std::make_pair(p, q));
+    p = q;
+  }
+}
+
+/// Read the sentence starting at p into sentence, return the position after it.
+const char * read_sentence(const char * p, const char * end, ConllSentence & sentence) {
+  sentence.clear();
+  std::vector<std::pair<const char *, const char *>> fields;
+  // skip the blank lines before the sentence.
+  while (p < end) {
+    const char * e = line_end(p, end);
+    if (!is_blank(p, e)) { break; }
+    p = (e < end ? e + 1 : end);
+  }
+  while (p < end) {
+    const char * e = line_end(p, end);
+    if (is_blank(p, e)) { break; }
+    const char * next = (e < end ? e + 1 : end);
+    if (*p == '#') { p = next; continue; }
+
+    split_fields(p, e, fields);
+    p = next;
+    if (fields.size() < 2) { continue; }
+    const char * id_end = fields[0].second;
+    if (std::find(fields[0].first, id_end, '-') != id_end ||
+        std::find(fields[0].first, id_end, '.') != id_end) {
+      continue;
+    }
+    sentence.words.emplace_back(fields[1].first, fields[1].second);
+    sentence.key.append(fields[1].first, fields[1].second);
+    sentence.postags.emplace_back(fields.size() > 3 ? std::string(fields[3].first, fields[3].second) : "_");
+    unsigned head = 0;
+    if (fields.size() > 6) {
+      for (const char * c = fields[6].first; c < fields[6].second && *c >= '0' && *c <= '9'; ++c) {
+        head = head * 10 + (*c - '0');
+      }
+    }
+    sentence.heads.push_back(head);
+    sentence.deprels.emplace_back(fields.size() > 7 ? std::string(fields[7].first, fields[7].second) : "_");
+  }
+  return p;
+}
+
+uint64_t hash_key(const std::string & key) {
+  // FNV-1a
+  uint64_t h = 14695981039346656037ULL;
+  for (char c : key) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+bool is_punct(const std::string & postag) {
+  return (postag == "PUNCT" || postag == "." || postag == "," || postag == ":" ||
+          postag == "''" || postag == "``");
+}
+
+/// Cut [data, data + size) into n chunks at sentence boundaries.
+void get_chunks(const char * data, size_t size, unsigned n,
+                std::vector<std::pair<const char *, const char *>> & chunks) {
+  chunks.clear();
+  const char * end = data + size;
+  const char * begin = data;
+  for (unsigned i = 1; i <= n; ++i) {
+    const char * cut = (i == n ? end : next_sentence(data, data + size / n * i, end));
+    if (cut < begin) { cut = begin; }
+    chunks.push_back(std::make_pair(begin, cut));
+    begin = cut;
+  }
+}
+
+template <class Function>
+void run_chunks(const std::vector<std::pair<const char *, const char *>> & chunks, Function f) {
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < chunks.size(); ++i) {
+    threads.push_back(std::thread(f, i, chunks[i].first, chunks[i].second));
+  }
+  for (std::thread & t : threads) { t.join(); }
+}
+
+/// Compare the system sentence against the gold one with the same key. When
+/// the tokenization differs, the words are aligned by their character spans
+/// and the heads are compared by the spans of the head words.
+void evaluate(const ConllSentence & system, const ConllSentence & gold, bool exclude_punct,
+              EvalCounts & counts) {
+  auto payload = twpipe::AbstractTokenizeModel::fscore(gold.words, system.words);
+  counts.n_recall += static_cast<uint64_t>(std::lround(std::get<0>(payload)));
+  counts.n_pred += static_cast<uint64_t>(std::lround(std::get<1>(payload)));
+  counts.n_gold += static_cast<uint64_t>(std::lround(std::get<2>(payload)));
+
+  unsigned n_gold = gold.words.size();
+  std::vector<unsigned> gold_to_system(n_gold + 1, 0);
+  if (system.words == gold.words) {
+    for (unsigned i = 0; i <= n_gold; ++i) { gold_to_system[i] = i; }
+  } else {
+    // 0 is the root, the unaligned words map to n_system + 1.
+    unsigned n_system = system.words.size();
+    std::vector<std::pair<unsigned, unsigned>> system_spans(n_system);
+    unsigned offset = 0;
+    for (unsigned i = 0; i < n_system; ++i) {
+      system_spans[i] = std::make_pair(offset, static_cast<unsigned>(system.words[i].size()));
+      offset += system.words[i].size();
+    }
+    offset = 0;
+    unsigned j = 0;
+    for (unsigned i = 0; i < n_gold; ++i) {
+      std::pair<unsigned, unsigned> span(offset, static_cast<unsigned>(gold.words[i].size()));
+      while (j < n_system && system_spans[j].first < span.first) { ++j; }
+      gold_to_system[i + 1] = (j < n_system && system_spans[j] == span ? j + 1 : n_system + 1);
+      offset += gold.words[i].size();
+    }
+  }
+
+  for (unsigned i = 0; i < n_gold; ++i) {
+    if (exclude_punct && is_punct(gold.postags[i])) { continue; }
+    counts.n_total++;
+    unsigned s = gold_to_system[i + 1];
+    if (s == 0 || s > system.words.size()) { continue; }
+    if (system.postags[s - 1] == gold.postags[i]) { counts.n_pos_corr++; }
+    unsigned gold_head = gold.heads[i];
+    unsigned expected = (gold_head <= n_gold ? gold_to_system[gold_head] : system.words.size() + 1);
+    if (system.heads[s - 1] == expected) {
+      counts.n_uas_corr++;
+      if (system.deprels[s - 1] == gold.deprels[i]) { counts.n_las_corr++; }
+    }
+  }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  po::options_description cmd("Usage: ./twpipe_eval --system system.conllu --answer gold.conllu");
+  cmd.add_options()
+    ("help,h", "show help information.")
+    ("verbose,v", "Details logging.")
+    ("system", po::value<std::string>(), "the path to the system output.")
+    ("answer", po::value<std::string>(), "the path to the gold standard.")
+    ("exclude-punct", "exclude punctuation from the postag and parse scores.")
+    ("threads", po::value<unsigned>()->default_value(0), "the number of threads, 0 for the number of cores.")
+    ;
+
+  po::variables_map conf;
+  po::store(po::parse_command_line(argc, argv, cmd), conf);
+  po::notify(conf);
+
+  if (conf.count("help") || !conf.count("system") || !conf.count("answer")) {
+    std::cerr << cmd << std::endl;
+    return 1;
+  }
+  twpipe::init_boost_log(conf.count("verbose") > 0);
+
+  twpipe::MappedFile system_file, gold_file;
+  if (!system_file.open(conf["system"].as<std::string>())) {
+    _ERROR << "[evaluate] failed to open " << conf["system"].as<std::string>();
+    exit(1);
+  }
+  if (!gold_file.open(conf["answer"].as<std::string>())) {
+    _ERROR << "[evaluate] failed to open " << conf["answer"].as<std::string>();
+    exit(1);
+  }
+  bool exclude_punct = conf.count("exclude-punct") > 0;
+  unsigned n_threads = conf["threads"].as<unsigned>();
+  if (n_threads == 0) { n_threads = std::max(1u, std::thread::hardware_concurrency()); }
+
+  // index the gold sentences by the hash of their keys, the text stays in the mapped file.
+  std::vector<std::pair<const char *, const char *>> chunks;
+  get_chunks(gold_file.data, gold_file.size, n_threads, chunks);
+  std::vector<std::vector<std::pair<uint64_t, const char *>>> chunk_index(chunks.size());
+  run_chunks(chunks, [&](unsigned i, const char * p, const char * end) {
+    ConllSentence sentence;
+    while (p < end) {
+      const char * begin = p;
+      p = read_sentence(p, end, sentence);
+      if (sentence.words.empty()) { continue; }
+      chunk_index[i].push_back(std::make_pair(hash_key(sentence.key), begin));
+    }
+  });
+  std::vector<std::pair<uint64_t, const char *>> index;
+  for (auto & entries : chunk_index) {
+    index.insert(index.end(), entries.begin(), entries.end());
+    std::vector<std::pair<uint64_t, const char *>>().swap(entries);
+  }
+  std::sort(index.begin(), index.end());
+  _INFO << "[evaluate] indexed " << index.size() << " gold sentences.";
+
+  get_chunks(system_file.data, system_file.size, n_threads, chunks);
+  std::vector<EvalCounts> chunk_counts(chunks.size());
+  const char * gold_end = gold_file.data + gold_file.size;
+  run_chunks(chunks, [&](unsigned i, const char * p, const char * end) {
+    ConllSentence system, gold;
+    EvalCounts & counts = chunk_counts[i];
+    while (p < end) {
+      p = read_sentence(p, end, system);
+      if (system.words.empty()) { continue; }
+      counts.n_sentences++;
+
+      uint64_t h = hash_key(system.key);
+      auto range = std::equal_range(index.begin(), index.end(), std::make_pair(h, static_cast<const char *>(nullptr)),
+                                    [](const std::pair<uint64_t, const char *> & a,
+                                       const std::pair<uint64_t, const char *> & b) { return a.first < b.first; });
+      // the last one wins when a sentence repeats in the gold standard.
+      bool found = false;
+      for (auto it = range.second; it != range.first; ) {
+        --it;
+        read_sentence(it->second, gold_end, gold);
+        if (gold.key == system.key) { found = true; break; }
+      }
+      if (!found) {
+        _TRACE << "[evaluate] key " << system.key << " not found in answer";
+        counts.n_not_found++;
+        continue;
+      }
+      evaluate(system, gold, exclude_punct, counts);
+    }
+  });
+
+  EvalCounts counts;
+  for (const EvalCounts & c : chunk_counts) { counts.add(c); }
+  if (counts.n_not_found > 0) {
+    _WARN << "[evaluate] " << counts.n_not_found << " of " << counts.n_sentences
+      << " system sentences not found in answer.";
+  }
+
+  double p = (counts.n_pred > 0 ? static_cast<double>(counts.n_recall) / counts.n_pred : 0.);
+  double r = (counts.n_gold > 0 ? static_cast<double>(counts.n_recall) / counts.n_gold : 0.);
+  double f = (p + r > 0 ? 2 * p * r / (p + r) : 0.);
+  double n_total = (counts.n_total > 0 ? static_cast<double>(counts.n_total) : 1.);
+  std::cout << "tokenization p: " << p << ", r: " << r << ", f: " << f << std::endl;
+  std::cout << "postag accuracy: " << counts.n_pos_corr / n_total << std::endl;
+  std::cout << "UAS: " << counts.n_uas_corr / n_total << std::endl;
+  std::cout << "LAS: " << counts.n_las_corr / n_total << std::endl;
+  return 0;
+}